@@ -0,0 +1,522 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+   File: xrpSMEngineBench.c
+   Descripton:
+   Microbenchmarks for the State Machine Engine hot paths, run with "make bench".
+   A synthetic state graph is built at runtime:
+    - every state has fan-out rows, row k takes event id k + 1 to state i + k + 1
+    - even states also accept BENCH_EVT_DEFER and move to the next state,
+      odd states can only defer it
+    - every state defers all the event ids, so an event a guard rejected is
+      replayed after the next transition instead of being tossed
+   All guards say no at the reject rate.  The events are generated up front
+   so only SmEnqueueEvent + SmProcessEvents are timed.
+   Each scenario reports events/sec, ns per event, ns per transition and,
+   when the kernel lets us count them, cache misses per event.  The
+   "1by1" scenarios turn SmSetBatchDrain off, to compare the batched
+   drain of the active queue with taking one event at a time.
+   */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+// the event id the odd states defer, follows the fan-out ids
+#define BENCH_EVT_DEFER( pCfg )          ( ( tStEventID ) ( ( pCfg )->mFanOut + 1 ) )
+
+#define BENCH_MAX_STATES                 4096
+#define BENCH_MAX_FANOUT                 250
+#define BENCH_NAME_SIZE                  16
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _BenchConfig
+{
+    UInt32          mStates;
+    UInt32          mFanOut;
+        // percent of guard calls that say no
+    UInt32          mRejectPct;
+        // percent of events that are BENCH_EVT_DEFER
+    UInt32          mDeferPct;
+    UInt32          mEvents;
+        // events enqueued between SmProcessEvents calls
+    UInt32          mBurst;
+    tSmQIndex       mActiveQSize;
+    tSmQIndex       mDeferredQSize;
+    UInt8           mInitFlags;
+        // see SmSetBatchDrain
+    BOOL            bBatchDrain;
+} tBenchConfig;
+
+typedef struct _BenchGraph
+{
+    tStateInfo      *mpStates;
+    tStateGuard     *mpRows;
+    tStEventID      *mpDeferIDs;
+    char            *mpNames;
+} tBenchGraph;
+
+typedef struct _BenchResult
+{
+    char            mName[ 32 ];
+    uint64_t        mNs;
+    UInt32          mEvents;
+    UInt32          mTransitions;
+        // -1 when the counter is not available
+    long long       mCacheMisses;
+} tBenchResult;
+
+//-------------------------------------------------------------------------------
+// Globals
+//-------------------------------------------------------------------------------
+
+static UInt32 gBenchRand = 0x12345678;
+static UInt32 gBenchRejectPct;
+static UInt32 gBenchTransitions;
+
+/*********************************************************************
+ *
+ * xorshift32, cheap enough to not hide the engine costs.
+ *
+ *********************************************************************/
+static UInt32 _BenchRand( void )
+{
+    gBenchRand ^= gBenchRand << 13;
+    gBenchRand ^= gBenchRand >> 17;
+    gBenchRand ^= gBenchRand << 5;
+
+    return gBenchRand;
+}
+
+static uint64_t _BenchNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000000 ) + now.tv_nsec;
+}
+
+/*********************************************************************
+ *
+ * The one entry point shared by all the synthetic states.
+ *
+ *********************************************************************/
+static void St_Bench( tStateEvent *pEvent, eStateAction eAction, BOOL *bGuardResponse )
+{
+    ( void ) pEvent;
+
+    switch ( eAction )
+    {
+        case ACT_GUARD:
+            *bGuardResponse = ( ( _BenchRand() % 100 ) >= gBenchRejectPct ) ? TRUE : FALSE;
+            break;
+
+        case ACT_ENTER:
+            ++gBenchTransitions;
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*********************************************************************
+ *
+ * Open a cache miss counter for this thread.
+ *
+ * Returns:
+ *  the counter's file descriptor, -1 if not available
+ *
+ *********************************************************************/
+static int _BenchMissCounterOpen( void )
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+
+    memset( &attr, 0, sizeof( attr ) );
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof( attr );
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return ( int ) syscall( __NR_perf_event_open, &attr, 0, -1, -1, 0 );
+#else
+    return -1;
+#endif
+}
+
+static long long _BenchMissCounterRead( int fd )
+{
+    long long count;
+
+    if ( ( fd < 0 ) || ( sizeof( count ) != read( fd, &count, sizeof( count ) ) ) )
+    {
+        return -1;
+    }
+
+    return count;
+}
+
+/*********************************************************************
+ *
+ * Build the synthetic state graph described at the top of this file.
+ *
+ * Parameters:
+ *  pCfg - size of the graph
+ *  pGraph - filled in, release with _BenchGraphFree
+ *
+ * Returns:
+ *  TRUE, if the graph was built
+ *  FALSE, out of memory
+ *
+ *********************************************************************/
+static BOOL _BenchGraphBuild( const tBenchConfig *pCfg, tBenchGraph *pGraph )
+{
+    UInt32 stateIdx, rowIdx, rowCount;
+    UInt32 rowsPerState = pCfg->mFanOut + 1;
+    UInt32 deferCount = pCfg->mFanOut + 1;
+    tStateGuard *pRows;
+
+    pGraph->mpStates = calloc( pCfg->mStates, sizeof( tStateInfo ) );
+    pGraph->mpRows = calloc( pCfg->mStates * rowsPerState, sizeof( tStateGuard ) );
+    pGraph->mpDeferIDs = calloc( deferCount, sizeof( tStEventID ) );
+    pGraph->mpNames = calloc( pCfg->mStates, BENCH_NAME_SIZE );
+
+    if ( ( NULL == pGraph->mpStates ) || ( NULL == pGraph->mpRows ) || ( NULL == pGraph->mpDeferIDs ) || ( NULL == pGraph->mpNames ) )
+    {
+        return FALSE;
+    }
+
+    // every state shares the same defer list
+    for ( rowIdx = 0 ; rowIdx < deferCount ; ++rowIdx )
+    {
+        pGraph->mpDeferIDs[ rowIdx ] = ( tStEventID ) ( rowIdx + 1 );
+    }
+
+    for ( stateIdx = 0 ; stateIdx < pCfg->mStates ; ++stateIdx )
+    {
+        pRows = &pGraph->mpRows[ stateIdx * rowsPerState ];
+
+        for ( rowIdx = 0 ; rowIdx < pCfg->mFanOut ; ++rowIdx )
+        {
+            pRows[ rowIdx ].mID = ( tStEventID ) ( rowIdx + 1 );
+            pRows[ rowIdx ].mStInfo = &pGraph->mpStates[ ( stateIdx + rowIdx + 1 ) % pCfg->mStates ];
+        }
+        rowCount = pCfg->mFanOut;
+
+        if ( 0 == ( stateIdx & 1 ) )
+        {
+            pRows[ rowCount ].mID = BENCH_EVT_DEFER( pCfg );
+            pRows[ rowCount ].mStInfo = &pGraph->mpStates[ ( stateIdx + 1 ) % pCfg->mStates ];
+            ++rowCount;
+        }
+
+        snprintf( &pGraph->mpNames[ stateIdx * BENCH_NAME_SIZE ], BENCH_NAME_SIZE, "St_%u", stateIdx );
+        pGraph->mpStates[ stateIdx ].mStateName = &pGraph->mpNames[ stateIdx * BENCH_NAME_SIZE ];
+        pGraph->mpStates[ stateIdx ].mEntry = St_Bench;
+        pGraph->mpStates[ stateIdx ].mNextStCount = ( tStateCount ) rowCount;
+        pGraph->mpStates[ stateIdx ].mpNextStates = pRows;
+        pGraph->mpStates[ stateIdx ].mDeferEvtIDCount = ( tStateCount ) deferCount;
+        pGraph->mpStates[ stateIdx ].mpDeferEvtIDs = pGraph->mpDeferIDs;
+    }
+
+    return TRUE;
+}
+
+static void _BenchGraphFree( tBenchGraph *pGraph )
+{
+    free( pGraph->mpStates );
+    free( pGraph->mpRows );
+    free( pGraph->mpDeferIDs );
+    free( pGraph->mpNames );
+}
+
+/*********************************************************************
+ *
+ * Run one scenario: enqueue the events in bursts and run the engine
+ * after every burst.
+ *
+ * Parameters:
+ *  pCfg - the scenario
+ *  pGraph - the state graph, compiled or not
+ *  pPacked - packed table of the graph, or NULL
+ *  pEvents - pCfg->mEvents events to feed the engine
+ *  pName - scenario name for the report
+ *  pResult - filled in
+ *
+ * Returns:
+ *  TRUE, if the scenario ran
+ *  FALSE, the instance could not be created
+ *
+ *********************************************************************/
+static BOOL _BenchRun( const tBenchConfig *pCfg, tBenchGraph *pGraph, const tSmPackedTable *pPacked, const tStateEvent *pEvents, const char *pName, tBenchResult *pResult )
+{
+    tSmInstance *pSM;
+    UInt32 evtIdx, burstEnd;
+    uint64_t startNs;
+    int missFd;
+
+    pSM = SmInitEx( &pGraph->mpStates[ 0 ], ( char * ) pName, pCfg->mActiveQSize, pCfg->mDeferredQSize, pCfg->mInitFlags, NULL );
+    if ( NULL == pSM )
+    {
+        return FALSE;
+    }
+    SmSetLogMask( pSM, 0 );
+    SmSetBatchDrain( pSM, pCfg->bBatchDrain );
+    SmSetPackedTable( pSM, pPacked );
+
+    gBenchRand = 0x12345678;
+    gBenchRejectPct = pCfg->mRejectPct;
+    gBenchTransitions = 0;
+
+    missFd = _BenchMissCounterOpen();
+    if ( missFd >= 0 )
+    {
+        ioctl( missFd, PERF_EVENT_IOC_RESET, 0 );
+        ioctl( missFd, PERF_EVENT_IOC_ENABLE, 0 );
+    }
+
+    startNs = _BenchNow();
+    for ( evtIdx = 0 ; evtIdx < pCfg->mEvents ; )
+    {
+        burstEnd = evtIdx + pCfg->mBurst;
+        if ( burstEnd > pCfg->mEvents )
+        {
+            burstEnd = pCfg->mEvents;
+        }
+
+        for ( ; evtIdx < burstEnd ; ++evtIdx )
+        {
+            SmEnqueueEvent( pSM, pEvents[ evtIdx ].mID, pEvents[ evtIdx ].mData );
+        }
+
+        SmProcessEvents( pSM );
+    }
+    pResult->mNs = _BenchNow() - startNs;
+
+    if ( missFd >= 0 )
+    {
+        ioctl( missFd, PERF_EVENT_IOC_DISABLE, 0 );
+    }
+    pResult->mCacheMisses = _BenchMissCounterRead( missFd );
+    if ( missFd >= 0 )
+    {
+        close( missFd );
+    }
+
+    snprintf( pResult->mName, sizeof( pResult->mName ), "%s", pName );
+    pResult->mEvents = pCfg->mEvents;
+    pResult->mTransitions = gBenchTransitions;
+
+    SmFreeInstance( pSM );
+
+    return TRUE;
+}
+
+static void _BenchReport( const tBenchResult *pResult )
+{
+    double seconds = ( double ) pResult->mNs / 1e9;
+
+    printf( "%-20s %12.0f %10.1f %10.1f ", pResult->mName,
+            ( seconds > 0 ) ? ( double ) pResult->mEvents / seconds : 0.0,
+            ( double ) pResult->mNs / pResult->mEvents,
+            ( 0 != pResult->mTransitions ) ? ( double ) pResult->mNs / pResult->mTransitions : 0.0 );
+
+    if ( pResult->mCacheMisses < 0 )
+    {
+        printf( "%12s\n", "n/a" );
+    }
+    else
+    {
+        printf( "%12.3f\n", ( double ) pResult->mCacheMisses / pResult->mEvents );
+    }
+}
+
+static void _BenchUsage( const char *pProg )
+{
+    printf( "usage: %s [options]\n"
+            "  -s states       states in the graph (default 16)\n"
+            "  -f fan-out      next state rows per state (default 4)\n"
+            "  -r percent      guard rejection rate (default 10)\n"
+            "  -d percent      events only the even states accept (default 20)\n"
+            "  -n events       events per scenario (default 1000000)\n"
+            "  -b burst        events enqueued per SmProcessEvents (default 16)\n"
+            "  -a size         active queue size (default 64)\n"
+            "  -q size         deferred queue size (default 64)\n"
+            "  -p              power of 2 queues\n", pProg );
+}
+
+int main( int argc, char *argv[] )
+{
+    static const tSmQIndex deferSweep[] = { 16, 64, 256, 1024 };
+    tBenchConfig cfg = { 16, 4, 10, 20, 1000000, 16, 64, 64, 0, TRUE };
+    tBenchConfig sweepCfg, oneCfg;
+    tBenchGraph graph;
+    tBenchResult results[ 5 + ARRAY_COUNT( deferSweep ) ];
+    tSmPackedTable *pPacked;
+    tStateEvent *pEvents;
+    char name[ 32 ];
+    int resultCount = 0;
+    int opt, idx;
+    UInt32 evtIdx;
+
+    while ( -1 != ( opt = getopt( argc, argv, "s:f:r:d:n:b:a:q:ph" ) ) )
+    {
+        switch ( opt )
+        {
+            case 's': cfg.mStates = strtoul( optarg, NULL, 0 ); break;
+            case 'f': cfg.mFanOut = strtoul( optarg, NULL, 0 ); break;
+            case 'r': cfg.mRejectPct = strtoul( optarg, NULL, 0 ); break;
+            case 'd': cfg.mDeferPct = strtoul( optarg, NULL, 0 ); break;
+            case 'n': cfg.mEvents = strtoul( optarg, NULL, 0 ); break;
+            case 'b': cfg.mBurst = strtoul( optarg, NULL, 0 ); break;
+            case 'a': cfg.mActiveQSize = ( tSmQIndex ) strtoul( optarg, NULL, 0 ); break;
+            case 'q': cfg.mDeferredQSize = ( tSmQIndex ) strtoul( optarg, NULL, 0 ); break;
+            case 'p': cfg.mInitFlags |= SM_INIT_POW2_QUEUES; break;
+            default:
+                _BenchUsage( argv[ 0 ] );
+                return ( 'h' == opt ) ? 0 : 1;
+        }
+    }
+
+    if ( ( cfg.mStates < 2 ) || ( cfg.mStates > BENCH_MAX_STATES ) || ( 0 == cfg.mFanOut ) || ( cfg.mFanOut > BENCH_MAX_FANOUT ) ||
+         ( cfg.mRejectPct > 100 ) || ( cfg.mDeferPct > 100 ) || ( 0 == cfg.mEvents ) || ( 0 == cfg.mBurst ) )
+    {
+        _BenchUsage( argv[ 0 ] );
+        return 1;
+    }
+
+    if ( cfg.mBurst > cfg.mActiveQSize )
+    {   // a burst must fit, otherwise we only measure drops
+        cfg.mBurst = cfg.mActiveQSize;
+    }
+
+    if ( FALSE == _BenchGraphBuild( &cfg, &graph ) )
+    {
+        printf( "out of memory\n" );
+        return 1;
+    }
+
+    pEvents = malloc( cfg.mEvents * sizeof( tStateEvent ) );
+    if ( NULL == pEvents )
+    {
+        printf( "out of memory\n" );
+        return 1;
+    }
+
+    for ( evtIdx = 0 ; evtIdx < cfg.mEvents ; ++evtIdx )
+    {
+        if ( ( _BenchRand() % 100 ) < cfg.mDeferPct )
+        {
+            pEvents[ evtIdx ].mID = BENCH_EVT_DEFER( &cfg );
+        }
+        else
+        {
+            pEvents[ evtIdx ].mID = ( tStEventID ) ( ( _BenchRand() % cfg.mFanOut ) + 1 );
+        }
+        pEvents[ evtIdx ].mData = ( tStEventData ) ( uintptr_t ) evtIdx;
+    }
+
+    // linear scans of the next state and defer lists
+    if ( TRUE == _BenchRun( &cfg, &graph, NULL, pEvents, "linear", &results[ resultCount ] ) )
+    {
+        ++resultCount;
+    }
+
+    // the same, the active queue taken one event at a time
+    oneCfg = cfg;
+    oneCfg.bBatchDrain = FALSE;
+    if ( TRUE == _BenchRun( &oneCfg, &graph, NULL, pEvents, "linear 1by1", &results[ resultCount ] ) )
+    {
+        ++resultCount;
+    }
+
+    // deferred queue churn as the queue grows
+    for ( idx = 0 ; idx < ( int ) ARRAY_COUNT( deferSweep ) ; ++idx )
+    {
+        sweepCfg = cfg;
+        sweepCfg.mDeferredQSize = deferSweep[ idx ];
+        snprintf( name, sizeof( name ), "linear defq=%u", ( unsigned ) deferSweep[ idx ] );
+        if ( TRUE == _BenchRun( &sweepCfg, &graph, NULL, pEvents, name, &results[ resultCount ] ) )
+        {
+            ++resultCount;
+        }
+    }
+
+    // dispatch tables from SmCompileStateTable
+    if ( TRUE == SmCompileStateTable( &graph.mpStates[ 0 ] ) )
+    {
+        if ( TRUE == _BenchRun( &cfg, &graph, NULL, pEvents, "compiled", &results[ resultCount ] ) )
+        {
+            ++resultCount;
+        }
+        if ( TRUE == _BenchRun( &oneCfg, &graph, NULL, pEvents, "compiled 1by1", &results[ resultCount ] ) )
+        {
+            ++resultCount;
+        }
+
+        // one packed table for the whole machine from SmPackStateTable, the
+        // defer checks still use the compiled bitmaps
+        pPacked = SmPackStateTable( &graph.mpStates[ 0 ] );
+        if ( NULL != pPacked )
+        {
+            if ( TRUE == _BenchRun( &cfg, &graph, pPacked, pEvents, "packed", &results[ resultCount ] ) )
+            {
+                ++resultCount;
+            }
+            SmFreePackedTable( pPacked );
+        }
+
+        SmFreeStateTable( &graph.mpStates[ 0 ] );
+    }
+
+    printf( "\nstates %u, fan-out %u, reject %u%%, defer %u%%, events %u, burst %u, queues %u/%u%s\n",
+            cfg.mStates, cfg.mFanOut, cfg.mRejectPct, cfg.mDeferPct, cfg.mEvents, cfg.mBurst,
+            ( unsigned ) cfg.mActiveQSize, ( unsigned ) cfg.mDeferredQSize, ( cfg.mInitFlags & SM_INIT_POW2_QUEUES ) ? " pow2" : "" );
+    printf( "%-20s %12s %10s %10s %12s\n", "scenario", "events/s", "ns/event", "ns/trans", "misses/event" );
+    for ( idx = 0 ; idx < resultCount ; ++idx )
+    {
+        _BenchReport( &results[ idx ] );
+    }
+
+    free( pEvents );
+    _BenchGraphFree( &graph );
+
+    return 0;
+}
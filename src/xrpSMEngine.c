@@ -63,23 +63,114 @@
 //#include <xrpTimer.h>
 //#include <xrpDebug.h>
 
+#include <stddef.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include "xrpSMEngine.h"
+#include "xrpSMScheduler.h"
+
+#if ( XRP_SM_SIMD ) && defined( __SSE2__ )
+#include <emmintrin.h>
+#define SM_SIMD_SSE2
+#elif ( XRP_SM_SIMD ) && ( defined( __ARM_NEON ) || defined( __ARM_NEON__ ) )
+#include <arm_neon.h>
+#define SM_SIMD_NEON
+#endif
 
 //-------------------------------------------------------------------------------
 // Macros
 //-------------------------------------------------------------------------------
 #define DBG_MODULE_LEVEL  DBG_LEVEL_SM_ENGINE
 
+// round a size or address up to the next cache line
+#define SM_ROUND_UP_LINE( n )           ( ( ( n ) + ( SM_CACHE_LINE_SIZE - 1 ) ) & ~( ( size_t ) SM_CACHE_LINE_SIZE - 1 ) )
+
+// event id lists shorter than this are not worth a SIMD compare
+#define SM_SIMD_MIN_IDS                 ( 8 )
+
+// engine trace logs, compiled out above XRP_SM_LOG_LEVEL and otherwise
+// gated by the instance's runtime log mask
+#if ( XRP_SM_LOG_LEVEL >= SM_LOG_LEVEL_WARN )
+#define SM_LOG_WARN( pSM, ... )   do { if ( ( pSM )->logMask & SM_LOG_MASK_WARN ) { XLOGD_WARN( __VA_ARGS__ ); } } while ( 0 )
+#else
+#define SM_LOG_WARN( pSM, ... )   do { } while ( 0 )
+#endif
+
+#if ( XRP_SM_LOG_LEVEL >= SM_LOG_LEVEL_INFO )
+#define SM_LOG_INFO( pSM, ... )   do { if ( ( pSM )->logMask & SM_LOG_MASK_INFO ) { XLOGD_INFO( __VA_ARGS__ ); } } while ( 0 )
+#else
+#define SM_LOG_INFO( pSM, ... )   do { } while ( 0 )
+#endif
+
+#if ( XRP_SM_LOG_LEVEL >= SM_LOG_LEVEL_DEBUG )
+#define SM_LOG_DEBUG( pSM, ... )  do { if ( ( pSM )->logMask & SM_LOG_MASK_DEBUG ) { XLOGD_DEBUG( __VA_ARGS__ ); } } while ( 0 )
+#else
+#define SM_LOG_DEBUG( pSM, ... )  do { } while ( 0 )
+#endif
+
 //-------------------------------------------------------------------------------
 // Typedefs
 //-------------------------------------------------------------------------------
 
+// how much work one engine run may do
+typedef struct _SmBudget
+{
+    BOOL            bCounted;
+    UInt32          mEventsLeft;
+    BOOL            bTimed;
+    struct timespec mDeadline;
+} tSmBudget;
+
+// signed distance between two free running queue positions
+#if ( XRP_SM_QINDEX_BITS == 32 )
+typedef int32_t tSmQSIndex;
+#else
+typedef int16_t tSmQSIndex;
+#endif
+
 
 //-------------------------------------------------------------------------------
 // Prototypes
 //-------------------------------------------------------------------------------
 
 void _SmEngine( void *unused );
+BOOL _SmCollectStates( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, int *pStateCount );
+void _SmQReset( tSmQueueEvt *pEvQ );
+tSmQIndex _SmQCount( tSmQueueEvt *pEvQ );
+BOOL _SmQPow2Size( tSmQIndex size );
+BOOL _SmQueuesSet( tSmInstance *pSM );
+BOOL _SmEnqueueEventMP( tSmQueueEvt *pEvQ, const tStateEvent *pEvent );
+BOOL _SmDequeueEventMP( tSmQueueEvt *pEvQ, tStateEvent *pNewEvent );
+BOOL _SmEngineRun( tSmInstance *pSM, tSmBudget *pBudget );
+tStateEvent *_SmQSlot( tSmQueueEvt *pEvQ, tSmQIndex n );
+void _SmQSave( tStateEvent *pSlot, const tStateEvent *pEvent );
+void _SmStateIdMasks( const tStateInfo *pStateInfo, uint64_t *pRowMask, uint64_t *pDeferMask );
+void _SmSchedulerReady( tSmInstance *pSM );
+void _SmNotify( tSmInstance *pSM );
+void _SmTimerStart( tSmInstance *pSM, tStateInfo *pStateInfo );
+void _SmTimerStop( tSmInstance *pSM, tStateInfo *pStateInfo );
+void _SmTimerStopAll( tSmInstance *pSM );
+void _SmTimerDetach( tSmInstance *pSM );
+void _SmTimerStartAll( tSmInstance *pSM );
+void _SmTrace( tSmInstance *pSM, const tStateInfo *pStateInfo, tStEventID evtID, UInt8 action, UInt8 result );
+UInt16 _SmPackedIndex( const tSmPackedTable *pPacked, const tStateInfo *pStateInfo );
+UInt32 _SmMatchID( const tStEventID *pIDs, UInt32 first, UInt32 count, tStEventID evtID );
+BOOL _SmNotifyRearm( tSmInstance *pSM );
+BOOL _SmActiveEmpty( tSmInstance *pSM );
+BOOL _SmLanesEmpty( tSmInstance *pSM );
+UInt32 _SmDrainActiveBatch( tSmInstance *pSM, tSmBudget *pBudget );
+BOOL _SmCoalesceID( tSmInstance *pSM, tStEventID evtID );
+tSmGuardCacheEntry *_SmGuardCacheSlot( tSmInstance *pSM, const tStateInfo *pStateInfo, tStEventID evtID );
+BOOL _SmCoalesceEvent( tSmQueueEvt *pEvQ, const tStateEvent *pEvent );
+void _SmCoalesceRunMP( tSmQueueEvt *pEvQ, tStateEvent *pActEvent );
+tSmStateStats *_SmStatsSlot( tSmStats *pStats, const tStateInfo *pStateInfo, BOOL bInsert );
+#if ( XRP_SM_STATS )
+uint64_t _SmStatsNow( void );
+void _SmStatsTime( tSmCallbackStats *pCbStats, uint64_t startNs );
+void _SmStatsEnqueue( tSmInstance *pSM, tSmQIndex *pHighWater, tSmQueueEvt *pEvQ, UInt32 accepted, UInt32 failed );
+void _SmDeferStats( tSmInstance *pSM, BOOL bDeferred );
+#endif
 
 //-------------------------------------------------------------------------------
 // Globals
@@ -101,30 +192,279 @@ void _SmEngine( void *unused );
 void SmInit( tSmInstance *pSM, tStateInfo *pInitialStateInfo )
 {
     pSM->pCurrState = pInitialStateInfo;
+    pSM->logMask = SM_LOG_MASK_ALL;
+    pSM->bBatchDrain = TRUE;
 #if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
         if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
         {
             DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s Init: %s" INST_NAME ST_NAME );
         }
 #elif defined( RDK )
-    XLOGD_INFO( "%s Init: %s" INST_NAME ST_NAME );
+    SM_LOG_INFO( pSM, "%s Init: %s" INST_NAME ST_NAME );
 #endif
 
-    pSM->activeEvtQueue.mQCount = 0;
-    pSM->activeEvtQueue.mQHead = 0;
-    pSM->activeEvtQueue.mQTail = 0;
-
-    pSM->deferredEvtQueue.mQCount = 0;
-    pSM->deferredEvtQueue.mQHead = 0;
-    pSM->deferredEvtQueue.mQTail = 0;
+    // the layout is picked after init, SmSetQueuePow2 and SmSetMultiProducer
+    pSM->activeEvtQueue.mQFlags = 0;
+    pSM->activeEvtQueue.mpQSeq = NULL;
+    pSM->deferredEvtQueue.mQFlags = 0;
+    pSM->deferredEvtQueue.mpQSeq = NULL;
+
+    _SmQReset( &pSM->activeEvtQueue );
+    _SmQReset( &pSM->deferredEvtQueue );
+    // SmSetPriorityLane comes after init
+    memset( pSM->mPriorityEvtQueue, 0, sizeof( pSM->mPriorityEvtQueue ) );
+    memset( &pSM->mSelfEvtQueue, 0, sizeof( pSM->mSelfEvtQueue ) );
+    pSM->mSelfEvtQueue.mpQData = pSM->mSelfEvtData;
+    pSM->mSelfEvtQueue.mQSize = SM_SELF_QUEUE_SIZE;
+
+    pSM->mEnginePhase = SM_PHASE_ACTIVE;
+    pSM->bActiveConsumed = FALSE;
+    pSM->bDeferredConsumed = FALSE;
+    pSM->mDeferredLeft = 0;
+    pSM->mDeferredDone = 0;
+    pSM->bInEngine = FALSE;
+    pSM->bEngineRerun = FALSE;
+
+    pSM->mDeferPending = 0;
+    memset( pSM->mDeferPendingCount, 0, sizeof( pSM->mDeferPendingCount ) );
+
+    // SmSchedulerAdd comes after init
+    pSM->mpScheduler = NULL;
+    pSM->mSchedFlags = 0;
+    pSM->mSchedHome = 0;
+    pSM->mpNotify = NULL;
+    pSM->mpNotifyContext = NULL;
+    pSM->bNotifyArmed = FALSE;
+
+    // SmSetTimerWheel comes after init
+    pSM->mpTimerWheel = NULL;
+    memset( pSM->mStateTimers, 0, sizeof( pSM->mStateTimers ) );
+    pSM->mpWheelNext = NULL;
+    pSM->mpWheelPrev = NULL;
+
+    pSM->mpPacked = NULL;
+    pSM->mPackedIdx = SM_PACKED_NONE;
+
+    pSM->mCoalesceMask = 0;
+    pSM->mpCoalesceIDs = NULL;
+    pSM->mCoalesceIDCount = 0;
+
+    pSM->mpTrace = NULL;
+
+    pSM->mGuardGeneration = 0;
+    pSM->mGuardCacheGen = 0;
+    memset( pSM->mGuardCache, 0, sizeof( pSM->mGuardCache ) );
+
+#if ( XRP_SM_STATS )
+    memset( &pSM->mStats, 0, sizeof( pSM->mStats ) );
+#endif
 
     pSM->bInitFinished = TRUE;
 }
 
+/*********************************************************************
+ *
+ * Number of bytes SmInitEx needs for an instance with these queues,
+ * use it to size an arena.  The instance and every queue array start
+ * on their own cache line.
+ *
+ * Parameters:
+ *  activeQSize - number of events the active queue holds
+ *  deferredQSize - number of events the deferred queue holds
+ *  initFlags - SM_INIT_xxx
+ *
+ * Returns:
+ *  the size in bytes, not counting the alignment of the first byte
+ *
+ *********************************************************************/
+size_t SmInstanceSize( tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags )
+{
+    size_t size = SM_ROUND_UP_LINE( sizeof( tSmInstance ) );
+
+    size += SM_ROUND_UP_LINE( activeQSize * sizeof( tStateEvent ) );
+    size += SM_ROUND_UP_LINE( deferredQSize * sizeof( tStateEvent ) );
+
+    if ( initFlags & SM_INIT_MULTI_PRODUCER )
+    {
+        size += SM_ROUND_UP_LINE( activeQSize * sizeof( tSmQIndex ) );
+    }
+
+    if ( initFlags & SM_INIT_PRIORITY_LANES )
+    {
+        size += XRP_SM_PRIORITY_LANES * SM_ROUND_UP_LINE( SM_PRIORITY_LANE_SIZE * sizeof( tStateEvent ) );
+        if ( initFlags & SM_INIT_MULTI_PRODUCER )
+        {
+            size += XRP_SM_PRIORITY_LANES * SM_ROUND_UP_LINE( SM_PRIORITY_LANE_SIZE * sizeof( tSmQIndex ) );
+        }
+    }
+
+    return size;
+}
+
+/*********************************************************************
+ *
+ * Create an instance with engine owned queues and init it.  The
+ * instance and both ring buffers are placed in one cache line aligned
+ * block, either taken from the caller's arena or allocated from the
+ * heap.  With SM_INIT_MULTI_PRODUCER the active queue's sequence
+ * numbers go in the same block and the queue is switched to multi
+ * producer mode, activeQSize must then be a power of two.  With
+ * SM_INIT_POW2_QUEUES both queues use the power of two layout.  With
+ * SM_INIT_PRIORITY_LANES every priority lane gets SM_PRIORITY_LANE_SIZE
+ * events from the same block.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *  pInstanceName - name used in the logs, must stay valid
+ *  activeQSize - number of events the active queue holds
+ *  deferredQSize - number of events the deferred queue holds
+ *  initFlags - SM_INIT_xxx
+ *  pArena - memory to carve the instance from, NULL to use the heap
+ *
+ * Returns:
+ *  the new instance, or NULL if there is not enough memory or a queue
+ *  size does not fit initFlags
+ *
+ *********************************************************************/
+tSmInstance *SmInitEx( tStateInfo *pInitialStateInfo, char *pInstanceName, tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags, tSmArena *pArena )
+{
+    size_t size = SmInstanceSize( activeQSize, deferredQSize, initFlags );
+    uintptr_t start;
+    UInt8 *pBlock;
+    tStateEvent *pLaneData;
+    tSmQIndex *pLaneSeq;
+    tSmInstance *pSM;
+    UInt8 lane;
+
+    if ( ( 0 == activeQSize ) || ( 0 == deferredQSize ) )
+    {
+        XLOGD_ERROR( "InitEx: queue sizes must not be 0" );
+        return NULL;
+    }
+
+    if ( NULL != pArena )
+    {
+        start = SM_ROUND_UP_LINE( ( uintptr_t ) ( pArena->mpBase + pArena->mUsed ) );
+        if ( start + size > ( uintptr_t ) ( pArena->mpBase + pArena->mSize ) )
+        {
+            XLOGD_ERROR( "InitEx: arena too small, need %u bytes", ( unsigned ) size );
+            return NULL;
+        }
+        pBlock = ( UInt8 * ) start;
+    }
+    else if ( 0 != posix_memalign( ( void ** ) &pBlock, SM_CACHE_LINE_SIZE, size ) )
+    {
+        XLOGD_ERROR( "InitEx: out of memory" );
+        return NULL;
+    }
+
+    memset( pBlock, 0, size );
+
+    pSM = ( tSmInstance * ) pBlock;
+    pBlock += SM_ROUND_UP_LINE( sizeof( tSmInstance ) );
+
+    pSM->activeEvtQueue.mpQData = ( tStateEvent * ) pBlock;
+    pSM->activeEvtQueue.mQSize = activeQSize;
+    pBlock += SM_ROUND_UP_LINE( activeQSize * sizeof( tStateEvent ) );
+
+    pSM->deferredEvtQueue.mpQData = ( tStateEvent * ) pBlock;
+    pSM->deferredEvtQueue.mQSize = deferredQSize;
+    pBlock += SM_ROUND_UP_LINE( deferredQSize * sizeof( tStateEvent ) );
+
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) ) || defined( RDK )
+    pSM->mInstanceName = pInstanceName;
+#endif
+    pSM->bEngineOwned = ( NULL == pArena ) ? TRUE : FALSE;
+
+    SmInit( pSM, pInitialStateInfo );
+
+    if ( ( FALSE == pSM->bInitFinished ) ||
+         ( ( initFlags & SM_INIT_POW2_QUEUES ) && ( FALSE == SmSetQueuePow2( pSM ) ) ) ||
+         ( ( initFlags & SM_INIT_MULTI_PRODUCER ) && ( FALSE == SmSetMultiProducer( pSM, ( tSmQIndex * ) pBlock ) ) ) )
+    {
+        SmFreeInstance( pSM );
+        return NULL;
+    }
+
+    if ( initFlags & SM_INIT_PRIORITY_LANES )
+    {
+        if ( initFlags & SM_INIT_MULTI_PRODUCER )
+        {
+            pBlock += SM_ROUND_UP_LINE( activeQSize * sizeof( tSmQIndex ) );
+        }
+
+        for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+        {
+            pLaneData = ( tStateEvent * ) pBlock;
+            pBlock += SM_ROUND_UP_LINE( SM_PRIORITY_LANE_SIZE * sizeof( tStateEvent ) );
+            pLaneSeq = NULL;
+            if ( initFlags & SM_INIT_MULTI_PRODUCER )
+            {
+                pLaneSeq = ( tSmQIndex * ) pBlock;
+                pBlock += SM_ROUND_UP_LINE( SM_PRIORITY_LANE_SIZE * sizeof( tSmQIndex ) );
+            }
+            SmSetPriorityLane( pSM, lane + 1, pLaneData, SM_PRIORITY_LANE_SIZE, pLaneSeq );
+        }
+    }
+
+    if ( NULL != pArena )
+    {   // only now, a failed init leaves the arena as it was
+        pArena->mUsed = ( ( UInt8 * ) pSM + size ) - pArena->mpBase;
+    }
+
+    return pSM;
+}
+
+/*********************************************************************
+ *
+ * Release an instance created by SmInitEx.  Instances carved from an
+ * arena are only marked as not initialized, the arena belongs to the
+ * caller.  Stop the producers of the instance first.  An instance
+ * still on a scheduler is taken off with SmSchedulerRemove, which
+ * unlinks it from its ready list or waits for the worker running it,
+ * and one still on a timer wheel is detached from it.  It can be freed
+ * from any thread, a worker included, but not from one of its own
+ * state callbacks, that is refused and the instance is left alone.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmFreeInstance( tSmInstance *pSM )
+{
+    if ( ( TRUE == pSM->bInEngine ) && ( 0 != pthread_equal( pSM->mEngineThread, pthread_self() ) ) )
+    {   // the engine would run on in a freed instance
+        XLOGD_ERROR( "%s Free: called from the instance's own callback" INST_NAME );
+        return;
+    }
+
+    if ( ( NULL != pSM->mpScheduler ) && ( FALSE == SmSchedulerRemove( pSM->mpScheduler, pSM ) ) )
+    {   // a worker must not run or queue a freed instance
+        return;
+    }
+
+    pSM->bInitFinished = FALSE;
+
+    if ( NULL != pSM->mpTimerWheel )
+    {   // the wheel must not fire into or point at a freed instance
+        _SmTimerDetach( pSM );
+    }
+
+    if ( TRUE == pSM->bEngineOwned )
+    {
+        free( pSM );
+    }
+}
+
 /*********************************************************************
  *
  * Caller wants to know if we are in a certain state.  Compare the
- * state pointer passed in, to the state pointer kept by the SM.
+ * state pointer passed in, to the state pointer kept by the SM and
+ * to the parents of that state, being in a nested state also means
+ * being in the states enclosing it.
  *
  * Parameters:
  *  pSM - pointer to state machine instance
@@ -137,8 +477,18 @@ void SmInit( tSmInstance *pSM, tStateInfo *pInitialStateInfo )
  *********************************************************************/
 BOOL SmInThisState( tSmInstance *pSM, tStateInfo *pTestStateInfo )
 {
+    tStateInfo *pStateInfo;
+
     // compare the 2 pointers to determine if the SM is in that state
-    return pSM->pCurrState == pTestStateInfo;
+    for ( pStateInfo = pSM->pCurrState ; NULL != pStateInfo ; pStateInfo = pStateInfo->mpParent )
+    {
+        if ( pStateInfo == pTestStateInfo )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
 }
 
 /*********************************************************************
@@ -156,491 +506,3359 @@ BOOL SmInThisState( tSmInstance *pSM, tStateInfo *pTestStateInfo )
  *********************************************************************/
 void SmSetThisState( tSmInstance *pSM, tStateInfo *pNewStateInfo )
 {
+    if ( NULL != pSM->mpTimerWheel )
+    {   // no exit or enter, but the timeouts follow the state
+        _SmTimerStopAll( pSM );
+    }
+
     // force the SM to a certain state
     pSM->pCurrState = pNewStateInfo;
+
+    if ( NULL != pSM->mpPacked )
+    {
+        pSM->mPackedIdx = _SmPackedIndex( pSM->mpPacked, pNewStateInfo );
+        if ( SM_PACKED_NONE == pSM->mPackedIdx )
+        {
+            SM_LOG_WARN( pSM, "%s Packed: %s is not in the table" INST_NAME INFO_ST_NAME( pNewStateInfo ) );
+        }
+    }
+
+    if ( NULL != pSM->mpTimerWheel )
+    {
+        _SmTimerStartAll( pSM );
+    }
 }
 
 /*********************************************************************
  *
- * Simple full check for the queue.  Check the count against the size.
+ * Check that a queue size can be used with the power of two layout.
  *
  * Parameters:
- *  pEvQ, pointer to either the active or deferred queue
+ *  size, number of events in the queue
  *
  * Returns:
- *  TRUE, if the queue is full
- *  FALSE, if the queue is NOT full
+ *  TRUE, if the size is a power of two that the indexes can hold
+ *  FALSE, if not
  *
  *********************************************************************/
-BOOL _SmQFull( tSmQueueEvt *pEvQ )
+BOOL _SmQPow2Size( tSmQIndex size )
 {
-    return ( pEvQ->mQCount == pEvQ->mQSize ) ? TRUE : FALSE;
+    return ( ( 0 != size ) && ( 0 == ( size & ( size - 1 ) ) ) && ( size <= SM_QUEUE_MAX_POW2_SIZE ) ) ? TRUE : FALSE;
 }
 
 /*********************************************************************
  *
- * Simple empty check for the queue.
+ * Check that the client gave both event queues their storage.  The
+ * storage may be set after SmInit, so this is checked when events come
+ * in rather than at init.
  *
  * Parameters:
- *  pEvQ, pointer to either the active or deferred queue
+ *  pSM - pointer to state machine instance
  *
  * Returns:
- *  TRUE, if the queue is empty
- *  FALSE, if the queue is NOT empty
+ *  TRUE, if the active and the deferred queue have storage
+ *  FALSE, if not, events would be written through a NULL pointer
  *
  *********************************************************************/
-BOOL _SmQEmpty( tSmQueueEvt *pEvQ )
+BOOL _SmQueuesSet( tSmInstance *pSM )
 {
-    return ( 0 == pEvQ->mQCount ) ? TRUE : FALSE;
+    return ( ( NULL != pSM->activeEvtQueue.mpQData ) && ( 0 != pSM->activeEvtQueue.mQSize ) &&
+             ( NULL != pSM->deferredEvtQueue.mpQData ) && ( 0 != pSM->deferredEvtQueue.mQSize ) ) ? TRUE : FALSE;
 }
 
 /*********************************************************************
  *
- * This routine puts the event onto the queue/array.
+ * Empty the queue.  A multi producer queue also gets every slot's
+ * sequence number set back to its position.
  *
  * Parameters:
  *  pEvQ, pointer to either the active or deferred queue
- *  evtID, event to enqueue onto the queue
- *  evtData, data associated with the event
  *
  * Returns:
  *  none
  *
  *********************************************************************/
-void _SmEnqueueEvent( tSmQueueEvt *pEvQ, tStEventID evtID, tStEventData evtData )
+void _SmQReset( tSmQueueEvt *pEvQ )
 {
-    if ( TRUE == _SmQFull( pEvQ ) )
-    {   // this should never happen
-        //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s: event q is full!" INST_NAME );
-        return;
-    }
+    tSmQIndex idx;
 
-    // go to the next element in the array
-    ++pEvQ->mQTail;
-    ++pEvQ->mQCount;
+    pEvQ->mQCount = 0;
+    pEvQ->mQHead = 0;
+    pEvQ->mQTail = 0;
 
-    // valid tail: pEvQ->mQSize - 1, so wrap to 0
-    if ( pEvQ->mQTail == pEvQ->mQSize )
+    pEvQ->mQEnqPos = 0;
+    pEvQ->mQDeqPos = 0;
+
+    pEvQ->mQDropCount = 0;
+    pEvQ->mQCoalesceCount = 0;
+
+    if ( NULL != pEvQ->mpQSeq )
     {
-        pEvQ->mQTail = 0;
+        for ( idx = 0 ; idx < pEvQ->mQSize ; ++idx )
+        {
+            pEvQ->mpQSeq[ idx ] = idx;
+        }
+        __atomic_thread_fence( __ATOMIC_RELEASE );
     }
-
-    // save the event
-    pEvQ->mpQData[ pEvQ->mQTail ].mID = evtID;
-    pEvQ->mpQData[ pEvQ->mQTail ].mData = evtData;
 }
 
-void SmEnqueueEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData )
+/*********************************************************************
+ *
+ * Number of events on the queue.  For a multi producer queue this is
+ * a snapshot that can already be stale, only use it for logs.
+ *
+ * Parameters:
+ *  pEvQ, pointer to either the active or deferred queue
+ *
+ * Returns:
+ *  the event count
+ *
+ *********************************************************************/
+tSmQIndex _SmQCount( tSmQueueEvt *pEvQ )
 {
-    if ( FALSE == pSM->bInitFinished )
-    {   // don't accept events until our init routine is called
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-        if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-        {
-            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s Enqueue: No init, tossing e: %d, c: %d " INST_NAME, evtID, pSM->activeEvtQueue.mQCount );
-        }
-#elif defined( RDK )
-        XLOGD_FATAL( "%s Enqueue: No init, tossing e: %d, c: %d " INST_NAME, evtID, pSM->activeEvtQueue.mQCount );
-#endif
-        return;
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+    {   // the count is derived from the free running positions
+        return ( tSmQIndex ) ( __atomic_load_n( &pEvQ->mQEnqPos, __ATOMIC_RELAXED ) - pEvQ->mQDeqPos );
     }
 
-    _SmEnqueueEvent( &pSM->activeEvtQueue, evtID, evtData );
-    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s Enqueue: e: %d, c: %d " INST_NAME, evtID, gSmActEvtQueue.mQCount );
-#ifdef RDK
-    XLOGD_DEBUG( "%s Enqueue: e: %d, c: %d " INST_NAME, evtID, pSM->activeEvtQueue.mQCount );
-#endif
+    return pEvQ->mQCount;
 }
 
-void _SmEnqueueDeferredEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData )
+/*********************************************************************
+ *
+ * Simple full check for the queue.  Check the count against the size.
+ *
+ * Parameters:
+ *  pEvQ, pointer to either the active or deferred queue
+ *
+ * Returns:
+ *  TRUE, if the queue is full
+ *  FALSE, if the queue is NOT full
+ *
+ *********************************************************************/
+BOOL _SmQFull( tSmQueueEvt *pEvQ )
 {
-    _SmEnqueueEvent( &pSM->deferredEvtQueue, evtID, evtData );
-    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s DefQueue: e: %d, c: %d " INST_NAME, evtID, pSM->deferredEvtQueue.mQCount );
-#ifdef RDK
-    XLOGD_DEBUG( "%s DefQueue: e: %d, c: %d " INST_NAME, evtID, pSM->deferredEvtQueue.mQCount );
-#endif
+    return ( _SmQCount( pEvQ ) == pEvQ->mQSize ) ? TRUE : FALSE;
 }
 
 /*********************************************************************
  *
- * This routine returns an event if there is one on the queue.
+ * Simple empty check for the queue.
  *
  * Parameters:
- *  pEvQ, pointer to queue data structure
- *  pNewEvent, place to put the dequeued event
+ *  pEvQ, pointer to either the active or deferred queue
  *
  * Returns:
- *  TRUE, if event was dequeued off the queue
- *  FALSE, if no event was found
+ *  TRUE, if the queue is empty
+ *  FALSE, if the queue is NOT empty
  *
  *********************************************************************/
-BOOL _SmDequeueEvent( tSmQueueEvt *pEvQ, tStateEvent *pNewEvent )
+BOOL _SmQEmpty( tSmQueueEvt *pEvQ )
 {
-    if ( TRUE == _SmQEmpty( pEvQ ) )
-    {
-        return FALSE;
-    }
-
-    // move head to the next element in the array
-    ++pEvQ->mQHead;
-    --pEvQ->mQCount;
-
-    // valid head: pEvQ->mQSize - 1, so wrap to 0
-    if ( pEvQ->mQHead == pEvQ->mQSize )
-    {
-        pEvQ->mQHead = 0;
-    }
-
-    // copy the event out of the array
-    *pNewEvent = pEvQ->mpQData[ pEvQ->mQHead ];
-
-    return TRUE;
+    return ( 0 == _SmQCount( pEvQ ) ) ? TRUE : FALSE;
 }
 
-BOOL _SmDequeueActiveEvent( tSmInstance *pSM, tStateEvent *pActEvent )
+/*********************************************************************
+ *
+ * Address of the n'th pending event, counting from the oldest one.
+ * Only for a queue that is used by the engine thread alone.
+ *
+ * Parameters:
+ *  pEvQ, pointer to either the active or deferred queue
+ *  n, position of the event, less than the event count
+ *
+ * Returns:
+ *  pointer to the event in the queue array
+ *
+ *********************************************************************/
+tStateEvent *_SmQSlot( tSmQueueEvt *pEvQ, tSmQIndex n )
 {
-    BOOL bGotEvent = _SmDequeueEvent( &pSM->activeEvtQueue, pActEvent );
+    UInt32 idx;
 
-    if ( TRUE == bGotEvent )
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
     {
-        //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "SmDequeue, e: %d, c: %d ", pActEvent->mID, gSmActEvtQueue.mQCount );
-#ifdef RDK
-        XLOGD_DEBUG( "SmDequeue, e: %d, c: %d ", pActEvent->mID, pSM->activeEvtQueue.mQCount );
-#endif
+        return &pEvQ->mpQData[ ( tSmQIndex ) ( pEvQ->mQDeqPos + n ) & ( pEvQ->mQSize - 1 ) ];
     }
 
-    return bGotEvent;
-}
-
-BOOL _SmDequeueDeferredEvent( tSmInstance *pSM, tStateEvent *pDefEvent )
-{
-    BOOL bGotEvent = _SmDequeueEvent( &pSM->deferredEvtQueue, pDefEvent );
-
-    if ( TRUE == bGotEvent )
+    // the head is on the last event read, the oldest event is one further
+    idx = ( UInt32 ) pEvQ->mQHead + 1 + n;
+    if ( idx >= pEvQ->mQSize )
     {
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-        if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-        {
-            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s dq def event: e: %d, c: %d " INST_NAME, pDefEvent->mID, pSM->deferredEvtQueue.mQCount );
-        }
-#elif defined( RDK )
-        XLOGD_DEBUG( "%s dq def event: e: %d, c: %d " INST_NAME, pDefEvent->mID, pSM->deferredEvtQueue.mQCount );
-#endif
+        idx -= pEvQ->mQSize;
     }
 
-    return bGotEvent;
+    return &pEvQ->mpQData[ idx ];
 }
 
 /*********************************************************************
  *
- * This routine processes one event at a time.  This is the heart
- * of the state machine.  Match the new event to the current state's
- * event ids that allow the state to transition to a new state.  If
- * there is a match then call the the potential new states action guard
- * to see if the new state will accept this event.  If it
- * does then call the exit action of the current state and then
- * call the entry action of the new state.
+ * Copy an event into a queue slot.  With XRP_SM_EVENT_PAYLOAD only the
+ * payload bytes in use are copied.
  *
  * Parameters:
- *  pSM - pointer to state machine instance
- *  pNewEvent - process this event
+ *  pSlot, the queue slot
+ *  pEvent, the event
  *
  * Returns:
- *  TRUE, if we transitioned to a new state because of this event
- *  FALSE, event was not used by the current state
+ *  none
  *
  *********************************************************************/
-BOOL _SmProcessEvent( tSmInstance *pSM, tStateEvent *pNewEvent )
+void _SmQSave( tStateEvent *pSlot, const tStateEvent *pEvent )
 {
-    BOOL bEventUsed = FALSE;
-    BOOL bStGuard;
+#if ( XRP_SM_EVENT_PAYLOAD )
+    UInt16 size = ( pEvent->mPayloadSize < XRP_SM_EVENT_PAYLOAD ) ? pEvent->mPayloadSize : XRP_SM_EVENT_PAYLOAD;
 
-    int nextStateCount, nextStateIdx;
-    tStEventID nextStateEventID;
-    tStateEntryPoint nextStateFunction;
-    tStateInfo *pNextStateInfo;
+    memcpy( pSlot, pEvent, offsetof( tStateEvent, mPayload ) + size );
+#else
+    *pSlot = *pEvent;
+#endif
+}
 
-    // from the current state, how many new/next states can we transition to
-    nextStateCount = pSM->pCurrState->mNextStCount;
+/*********************************************************************
+ *
+ * Multi producer enqueue, may be called from any thread.  A producer
+ * claims the next position with a compare and swap on mQEnqPos, fills
+ * the slot and then publishes it by moving the slot's sequence number
+ * to position + 1.  Producers never wait on each other or on the
+ * consumer, a failed compare and swap only means another producer
+ * claimed that position first.
+ *
+ * Parameters:
+ *  pEvQ, pointer to a queue set up with SmSetMultiProducer
+ *  pEvent, event to enqueue onto the queue
+ *
+ * Returns:
+ *  TRUE, if the event was enqueued
+ *  FALSE, if the queue is full
+ *
+ *********************************************************************/
+BOOL _SmEnqueueEventMP( tSmQueueEvt *pEvQ, const tStateEvent *pEvent )
+{
+    tSmQIndex mask = pEvQ->mQSize - 1;
+    tSmQIndex pos = __atomic_load_n( &pEvQ->mQEnqPos, __ATOMIC_RELAXED );
+    tSmQIndex seq;
+    tSmQSIndex diff;
 
-    // walk through each possible next state asking if it will accept this event
-    for ( nextStateIdx = 0 ; nextStateIdx < nextStateCount ; ++nextStateIdx )
+    for ( ;; )
     {
-        // what event does this next state need in order to make the transition
-        nextStateEventID = pSM->pCurrState->mpNextStates[ nextStateIdx ].mID;
-
-        if ( nextStateEventID == pNewEvent->mID )
-        {   // found a next state that will accept this event
-            // get the next state's info
-            pNextStateInfo = ( tStateInfo * ) pSM->pCurrState->mpNextStates[ nextStateIdx ].mStInfo;
-
-            // get the entry point to the possible next state
-            nextStateFunction = pNextStateInfo->mEntry;
+        seq = __atomic_load_n( &pEvQ->mpQSeq[ pos & mask ], __ATOMIC_ACQUIRE );
+        diff = ( tSmQSIndex ) ( seq - pos );
 
-            // an event can be sent to the current state, don't call ACT_GUARD,
-            // or ACT_EVENT, just ACT_INTERNAL
-            if ( pSM->pCurrState == pNextStateInfo )
+        if ( 0 == diff )
+        {   // slot is free for this position, try to claim it
+            if ( __atomic_compare_exchange_n( &pEvQ->mQEnqPos, &pos, ( tSmQIndex ) ( pos + 1 ), TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
             {
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-                if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-                {
-                    DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s internal: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-                }
-#elif defined( RDK )
-                XLOGD_DEBUG( "%s internal: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-#endif
-                nextStateFunction( pNewEvent, ACT_INTERNAL, NULL );
-                bEventUsed = TRUE;
                 break;
             }
-            else
-            {   // normal case, try to send event to next state
-                // the next state must check it's guard to see if the conditions are right for the transition
-                // the state can ignore the newEvent since we aleady did a match on it
-                nextStateFunction( pNewEvent, ACT_GUARD, &bStGuard );
-                if ( TRUE == bStGuard )
-                {   // this next state accepts the event and guard says yes
-                    // tell the current state that we are leaving/exit
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-                    if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-                    {
-                        DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s exit: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-                    }
-#elif defined( RDK )
-                    XLOGD_DEBUG( "%s exit: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-#endif
+            // pos was reloaded by the failed exchange
+        }
+        else if ( diff < 0 )
+        {   // the consumer has not freed this slot yet, so the queue is full
+            return FALSE;
+        }
+        else
+        {   // another producer got here first
+            pos = __atomic_load_n( &pEvQ->mQEnqPos, __ATOMIC_RELAXED );
+        }
+    }
 
-                    pSM->pCurrState->mEntry( pNewEvent, ACT_EXIT, NULL );
+    // save the event and hand the slot to the consumer
+    _SmQSave( &pEvQ->mpQData[ pos & mask ], pEvent );
+    __atomic_store_n( &pEvQ->mpQSeq[ pos & mask ], ( tSmQIndex ) ( pos + 1 ), __ATOMIC_RELEASE );
 
-                    // we have now officially moved states
-                    pSM->pCurrState = pNextStateInfo;
+    return TRUE;
+}
 
-                    // send the enter action to the new state
+/*********************************************************************
+ *
+ * The queue is full, or the event id is coalesced, look for the newest
+ * pending event with the same id and give it the new event data.  The
+ * pending event keeps its place in the queue.
+ *
+ * Parameters:
+ *  pEvQ, pointer to a single threaded queue
+ *  pEvent, event to enqueue onto the queue
+ *
+ * Returns:
+ *  TRUE, if a pending event was updated
+ *  FALSE, if no pending event has this id
+ *
+ *********************************************************************/
+BOOL _SmCoalesceEvent( tSmQueueEvt *pEvQ, const tStateEvent *pEvent )
+{
+    tSmQIndex idx, count;
+    tSmQIndex pos;
 
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-                    if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-                    {
-                        DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s enter: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-                    }
-#elif defined( RDK )
-                    XLOGD_DEBUG( "%s enter: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
-#endif
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+    {   // walk back from the newest position
+        for ( pos = pEvQ->mQEnqPos ; pos != pEvQ->mQDeqPos ; )
+        {
+            --pos;
+            idx = pos & ( pEvQ->mQSize - 1 );
+            if ( pEvQ->mpQData[ idx ].mID == pEvent->mID )
+            {
+                _SmQSave( &pEvQ->mpQData[ idx ], pEvent );
+                return TRUE;
+            }
+        }
 
-                    nextStateFunction( pNewEvent, ACT_ENTER, NULL );
+        return FALSE;
+    }
 
-                    // this event was consumed by this state
-                    bEventUsed = TRUE;
-                    break;
-                }
-                else
-                {   // next state guard rejected the event
-#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
-                    if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
-                    {
-                        DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s event rejected by: %s, e: %d, d: %d" INST_NAME NEXT_ST_NAME, pNewEvent->mID, pNewEvent->mData );                    
-                    }
-#elif defined( RDK )
-                    XLOGD_DEBUG( "%s event rejected by: %s, e: %d, d: %d" INST_NAME NEXT_ST_NAME, pNewEvent->mID, pNewEvent->mData );
-#endif
+    idx = pEvQ->mQTail;
+    for ( count = 0 ; count < pEvQ->mQCount ; ++count )
+    {
+        if ( pEvQ->mpQData[ idx ].mID == pEvent->mID )
+        {
+            _SmQSave( &pEvQ->mpQData[ idx ], pEvent );
+            return TRUE;
+        }
+
+        // head and tail are pre-incremented, so walk back from the tail
+        idx = ( 0 == idx ) ? pEvQ->mQSize - 1 : idx - 1;
+    }
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * The single threaded queue is full, apply its overflow policy.
+ * Lost events are counted in mQDropCount.
+ *
+ * Parameters:
+ *  pEvQ, pointer to a single threaded queue
+ *  pEvent, event to enqueue onto the queue
+ *
+ * Returns:
+ *  SM_ENQ_DROPPED_OLDEST, room was made, the caller enqueues the event
+ *  SM_ENQ_COALESCED, the event data was merged into a pending event
+ *  SM_ENQ_DROPPED, the event was tossed
+ *
+ *********************************************************************/
+eSmEnqueueStatus _SmQOverflow( tSmQueueEvt *pEvQ, const tStateEvent *pEvent )
+{
+    switch ( pEvQ->mQOverflowPolicy )
+    {
+        case SM_OVERFLOW_DROP_OLDEST:
+        {   // move the head past the oldest event
+            if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+            {
+                ++pEvQ->mQDeqPos;
+            }
+            else
+            {
+                ++pEvQ->mQHead;
+                --pEvQ->mQCount;
+                if ( pEvQ->mQHead == pEvQ->mQSize )
+                {
+                    pEvQ->mQHead = 0;
                 }
             }
+            ++pEvQ->mQDropCount;
+            return SM_ENQ_DROPPED_OLDEST;
+        }
+        case SM_OVERFLOW_COALESCE:
+        {
+            if ( TRUE == _SmCoalesceEvent( pEvQ, pEvent ) )
+            {
+                ++pEvQ->mQCoalesceCount;
+                return SM_ENQ_COALESCED;
+            }
+            ++pEvQ->mQDropCount;
+            return SM_ENQ_DROPPED;
+        }
+        default:
+        {
+            ++pEvQ->mQDropCount;
+            return SM_ENQ_DROPPED;
         }
     }
-
-    return bEventUsed;
 }
 
 /*********************************************************************
  *
- * This event was not useable by the current state so now check
- * if the state will allow this event to be deferred.  If the state
- * has it in it's deferred event id list, then enqueue it onto the
- * deferred event queue.
+ * This routine puts the event onto the queue/array.  When the queue
+ * is full the queue's overflow policy decides what happens, lost
+ * events are counted in mQDropCount.
  *
  * Parameters:
- *  pSM - pointer to state machine instance
- *  pNewEvent, event that is trying to be deferred
+ *  pEvQ, pointer to either the active or deferred queue
+ *  pEvent, event to enqueue onto the queue, it is copied
  *
  * Returns:
- *  none
+ *  SM_ENQ_OK, the event is on the queue
+ *  SM_ENQ_DROPPED_OLDEST, the event is on the queue, the oldest one was tossed
+ *  SM_ENQ_COALESCED, the event data was merged into a pending event
+ *  SM_ENQ_DROPPED, the queue was full and the event was tossed
  *
  *********************************************************************/
-void _SmDeferEvent( tSmInstance *pSM, tStateEvent *pNewEvent )
+eSmEnqueueStatus _SmEnqueueEvent( tSmQueueEvt *pEvQ, const tStateEvent *pEvent )
 {
-    BOOL bCanDefer = FALSE;
-    tStateCount idx;
+    eSmEnqueueStatus status = SM_ENQ_OK;
+    tSmQIndex idx;
 
-    // must check current state to see if it will accept the deferral
-    for ( idx = 0 ; idx < pSM->pCurrState->mDeferEvtIDCount ; ++idx )
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
     {
-        if ( pNewEvent->mID == pSM->pCurrState->mpDeferEvtIDs[ idx ] )
+        if ( NULL != pEvQ->mpQSeq )
         {
-            bCanDefer = TRUE;
-            break;
+            if ( FALSE == _SmEnqueueEventMP( pEvQ, pEvent ) )
+            {
+                __atomic_fetch_add( &pEvQ->mQDropCount, 1, __ATOMIC_RELAXED );
+                return SM_ENQ_DROPPED;
+            }
+            return SM_ENQ_OK;
+        }
+
+        if ( ( tSmQIndex ) ( pEvQ->mQEnqPos - pEvQ->mQDeqPos ) == pEvQ->mQSize )
+        {
+            status = _SmQOverflow( pEvQ, pEvent );
+            if ( SM_ENQ_DROPPED_OLDEST != status )
+            {
+                return status;
+            }
         }
+
+        // the count is derived, so only the tail moves
+        idx = pEvQ->mQEnqPos & ( pEvQ->mQSize - 1 );
+        _SmQSave( &pEvQ->mpQData[ idx ], pEvent );
+        ++pEvQ->mQEnqPos;
+
+        return status;
     }
 
-    if ( TRUE == bCanDefer )
+    if ( TRUE == _SmQFull( pEvQ ) )
     {
-        _SmEnqueueDeferredEvent( pSM, pNewEvent->mID, pNewEvent->mData );
+        status = _SmQOverflow( pEvQ, pEvent );
+        if ( SM_ENQ_DROPPED_OLDEST != status )
+        {
+            return status;
+        }
     }
-    else
+
+    // go to the next element in the array
+    ++pEvQ->mQTail;
+    ++pEvQ->mQCount;
+
+    // valid tail: pEvQ->mQSize - 1, so wrap to 0
+    if ( pEvQ->mQTail == pEvQ->mQSize )
     {
+        pEvQ->mQTail = 0;
+    }
+
+    // save the event
+    _SmQSave( &pEvQ->mpQData[ pEvQ->mQTail ], pEvent );
+
+    return status;
+}
+
+/*********************************************************************
+ *
+ * Put a new event onto the active event queue, or one of the priority
+ * lanes, of this instance and let whoever runs the instance know about
+ * it.  A priority without a lane set up goes to the highest lane below
+ * it that has one, or to the active event queue.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pEvent, event to enqueue, it is copied
+ *  priority, SM_PRIORITY_NORMAL up to SM_PRIORITY_HIGHEST
+ *
+ * Returns:
+ *  see _SmEnqueueEvent, or SM_ENQ_NOT_INIT if SmInit was not called or
+ *  the queue storage is not set
+ *
+ *********************************************************************/
+eSmEnqueueStatus _SmEnqueueActiveEvent( tSmInstance *pSM, const tStateEvent *pEvent, UInt8 priority )
+{
+    tSmQueueEvt *pEvQ = &pSM->activeEvtQueue;
+    tStEventID evtID = pEvent->mID;
+    eSmEnqueueStatus status;
+
+    if ( FALSE == pSM->bInitFinished )
+    {   // don't accept events until our init routine is called
 #if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
         if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
         {
-            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s event unused: e: %d, d: %d" INST_NAME, pNewEvent->mID, pNewEvent->mData );
-            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s state: %s" INST_NAME ST_NAME );
+            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s Enqueue: No init, tossing e: %d, c: %d " INST_NAME, evtID, pSM->activeEvtQueue.mQCount );
         }
 #elif defined( RDK )
-        XLOGD_ERROR( "%s event unused: e: %d, d: %d" INST_NAME, pNewEvent->mID, pNewEvent->mData );
-        XLOGD_DEBUG( "%s state: %s" INST_NAME ST_NAME );
+        XLOGD_FATAL( "%s Enqueue: No init, tossing e: %d, c: %d " INST_NAME, evtID, _SmQCount( &pSM->activeEvtQueue ) );
+#endif
+        return SM_ENQ_NOT_INIT;
+    }
+
+    if ( FALSE == _SmQueuesSet( pSM ) )
+    {
+        XLOGD_ERROR( "%s Enqueue: queue storage not set, tossing e: %d " INST_NAME, evtID );
+        return SM_ENQ_NOT_INIT;
+    }
+
+    for ( ; priority > SM_PRIORITY_NORMAL ; --priority )
+    {
+        if ( ( priority <= XRP_SM_PRIORITY_LANES ) && ( NULL != pSM->mPriorityEvtQueue[ priority - 1 ].mpQData ) )
+        {
+            pEvQ = &pSM->mPriorityEvtQueue[ priority - 1 ];
+            break;
+        }
+    }
+
+    if ( ( 0 != pSM->mCoalesceMask ) && ( NULL == pEvQ->mpQSeq ) && ( TRUE == _SmCoalesceID( pSM, evtID ) ) &&
+         ( TRUE == _SmCoalesceEvent( pEvQ, pEvent ) ) )
+    {   // only the latest one matters, it takes the place of the pending one
+        ++pEvQ->mQCoalesceCount;
+        SM_LOG_DEBUG( pSM, "%s Enqueue: coalesced e: %d, c: %d " INST_NAME, evtID, _SmQCount( pEvQ ) );
+#if ( XRP_SM_STATS )
+        _SmStatsEnqueue( pSM, &pSM->mStats.mActiveHighWater, pEvQ, 1, 0 );
+#endif
+        return SM_ENQ_COALESCED;
+    }
+
+    status = _SmEnqueueEvent( pEvQ, pEvent );
+    if ( SM_ENQ_OK != status )
+    {
+        SM_LOG_WARN( pSM, "%s Enqueue: q full, e: %d, p: %d, s: %d, drops: %u " INST_NAME, evtID, priority, status, pEvQ->mQDropCount );
+    }
+#if ( XRP_SM_STATS )
+    _SmStatsEnqueue( pSM, &pSM->mStats.mActiveHighWater, pEvQ, ( SM_ENQ_DROPPED == status ) ? 0 : 1, ( SM_ENQ_OK == status ) ? 0 : 1 );
 #endif
+    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s Enqueue: e: %d, c: %d " INST_NAME, evtID, gSmActEvtQueue.mQCount );
+    SM_LOG_DEBUG( pSM, "%s Enqueue: e: %d, p: %d, c: %d " INST_NAME, evtID, priority, _SmQCount( pEvQ ) );
+
+    if ( ( SM_ENQ_DROPPED != status ) && ( NULL != pSM->mpScheduler ) )
+    {   // let a worker run it
+        _SmSchedulerReady( pSM );
+    }
+
+    if ( ( SM_ENQ_DROPPED != status ) && ( NULL != pSM->mpNotify ) )
+    {
+        _SmNotify( pSM );
     }
+
+    return status;
 }
 
 /*********************************************************************
  *
- * Walk/dequeue all the events off the active event queue and see if
- * the state machine will consume/use the event.  If the event
- * is not used then try to defer it.
+ * Put a new event onto the active event queue of this instance.  The
+ * client then calls SmProcessEvents to run the state machine.
  *
  * Parameters:
  *  pSM - pointer to state machine instance
+ *  evtID, event to enqueue
+ *  evtData, data associated with the event
  *
  * Returns:
- *  TRUE, if the state changed
- *  FALSE, the state has NOT changed
+ *  see _SmEnqueueEvent, or SM_ENQ_NOT_INIT if SmInit was not called or
+ *  the queue storage is not set
  *
  *********************************************************************/
-BOOL _SmProcessActiveEvents( tSmInstance *pSM )
+eSmEnqueueStatus SmEnqueueEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData )
 {
     tStateEvent newEvent;
-    int consumedEventCount = 0;
-    BOOL bFoundEvent, bConsumedEvent;
-
-    do
-    {
-        bFoundEvent = _SmDequeueActiveEvent( pSM, &newEvent );
-
-        if ( bFoundEvent )
-        {
-            bConsumedEvent = _SmProcessEvent( pSM, &newEvent );
 
-            if ( TRUE == bConsumedEvent )
-            {
-                //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s: consumed e: %d, c: %d", INST_NAME newEvent.mID, pSM->activeEvtQueue.mQCount );
-#ifdef RDK
-                XLOGD_DEBUG( "%s: consumed e: %d, c: %d" INST_NAME, newEvent.mID, pSM->activeEvtQueue.mQCount );
+    newEvent.mID = evtID;
+    newEvent.mData = evtData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+    newEvent.mPayloadSize = 0;
 #endif
-                ++consumedEventCount;
-            }
-            else
-            {   // the current state could not use this event
-                // check if the state will defer this event
-                _SmDeferEvent( pSM, &newEvent );
-            }
-        }
-    } while ( TRUE == bFoundEvent );
 
-    return consumedEventCount ? TRUE : FALSE;
+    return _SmEnqueueActiveEvent( pSM, &newEvent, SM_PRIORITY_NORMAL );
 }
 
 /*********************************************************************
  *
- * Walk/dequeue all the events off the deferred event queue and see if
- * the state machine will consume/use the event.  If the event
- * is not used then try to defer it.
- *
- * Must be careful to not get into an endless looped since we might
- * dequeue a deferred event and then the state machine rejects it so
- * we put it back on the deferred queue and try to dequeue it again.
+ * Put a new event with a payload onto the active event queue of this
+ * instance.  The payload is copied into the queue with the event, so
+ * it can live on the producer's stack and nothing has to be allocated
+ * or freed per event.  The state gets the copy in pEvent->mPayload,
+ * it is valid until the state returns from the ACT_ENTER, ACT_INTERNAL
+ * or ACT_GUARD call for this event, a deferred event keeps its payload.
  *
  * Parameters:
  *  pSM - pointer to state machine instance
+ *  evtID, event to enqueue
+ *  evtData, data associated with the event
+ *  pPayload, bytes to copy with the event, may be NULL if payloadSize is 0
+ *  payloadSize, number of bytes, no more than XRP_SM_EVENT_PAYLOAD
  *
  * Returns:
- *  none
+ *  see SmEnqueueEvent
+ *  SM_ENQ_PAYLOAD_SIZE, the payload does not fit, the event was tossed
  *
  *********************************************************************/
-BOOL _SmProcessDeferredEvents( tSmInstance *pSM )
+eSmEnqueueStatus SmEnqueueEventPayload( tSmInstance *pSM, tStEventID evtID, tStEventData evtData, const void *pPayload, UInt16 payloadSize )
 {
     tStateEvent newEvent;
-    BOOL bFoundEvent, bConsumedEvent;
-    int consumedEventCount = 0;
 
-    int maxLoopCount = pSM->deferredEvtQueue.mQCount;
-    int idx = 0;
+    if ( payloadSize > XRP_SM_EVENT_PAYLOAD )
+    {
+        XLOGD_ERROR( "%s Enqueue: payload too big, e: %d, size: %u, max: %u " INST_NAME, evtID, payloadSize, XRP_SM_EVENT_PAYLOAD );
+        return SM_ENQ_PAYLOAD_SIZE;
+    }
 
-    // we are only going through the deferred queue once, otherwise
-    // we could get in a loop of rechecking the same deferred event
-    do
+    newEvent.mID = evtID;
+    newEvent.mData = evtData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+    newEvent.mPayloadSize = payloadSize;
+    if ( 0 != payloadSize )
     {
-        bFoundEvent = _SmDequeueDeferredEvent( pSM, &newEvent );
+        memcpy( newEvent.mPayload, pPayload, payloadSize );
+    }
+#else
+    ( void ) pPayload;
+#endif
 
-        if ( bFoundEvent )
-        {
-            bConsumedEvent = _SmProcessEvent( pSM, &newEvent );
+    return _SmEnqueueActiveEvent( pSM, &newEvent, SM_PRIORITY_NORMAL );
+}
 
-            if ( TRUE == bConsumedEvent )
-            {
-                ++consumedEventCount;
-            }
-            else
-            {   // the current state could not use this event
-                // check if the state will defer this event
-                _SmDeferEvent( pSM, &newEvent );
-            }
+/*********************************************************************
+ *
+ * Put a new event onto a priority lane of this instance.  The engine
+ * takes events from the highest lane that has any before the lower
+ * lanes and the active event queue, so an urgent event does not wait
+ * behind a backlog.  Events of one priority stay in order, an event
+ * the current state defers goes to the deferred queue as usual.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  evtID, event to enqueue
+ *  evtData, data associated with the event
+ *  priority, SM_PRIORITY_NORMAL, same as SmEnqueueEvent, up to
+ *            SM_PRIORITY_HIGHEST, see SmSetPriorityLane
+ *
+ * Returns:
+ *  see SmEnqueueEvent
+ *
+ *********************************************************************/
+eSmEnqueueStatus SmEnqueueEventPriority( tSmInstance *pSM, tStEventID evtID, tStEventData evtData, UInt8 priority )
+{
+    tStateEvent newEvent;
 
-            ++idx;
-        }
-    } while ( ( TRUE == bFoundEvent ) && ( idx < maxLoopCount ) );
+    newEvent.mID = evtID;
+    newEvent.mData = evtData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+    newEvent.mPayloadSize = 0;
+#endif
 
-    return consumedEventCount ? TRUE : FALSE;
+    return _SmEnqueueActiveEvent( pSM, &newEvent, priority );
 }
 
 /*********************************************************************
  *
- * This routine is scheduled every time an event is enqueued.  When it
- * runs it will process all the active events and then try to
- * process any deferred events.
+ * Queue an event on the instance from one of its own state callbacks,
+ * e.g. a chained transition from ACT_ENTER.  The event is processed
+ * in the same engine run, before any event from outside, and nothing
+ * else is told about it since the engine is already running.  It
+ * costs no init check and no logging.  Called from anywhere else it
+ * is the same as SmEnqueueEvent, the self queue is only used on the
+ * thread that is running the engine, another thread that sees
+ * bInEngine set while the instance runs goes through the active queue
+ * and its locking like any other producer.
  *
  * Parameters:
  *  pSM - pointer to state machine instance
+ *  evtID, event to enqueue
+ *  evtData, data associated with the event
+ *
+ * Returns:
+ *  see _SmEnqueueEvent, SM_ENQ_DROPPED once SM_SELF_QUEUE_SIZE events
+ *  are waiting
+ *
+ *********************************************************************/
+eSmEnqueueStatus SmEnqueueSelfEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData )
+{
+    tStateEvent newEvent;
+
+    newEvent.mID = evtID;
+    newEvent.mData = evtData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+    newEvent.mPayloadSize = 0;
+#endif
+
+    if ( ( FALSE == pSM->bInEngine ) || ( 0 == pthread_equal( pSM->mEngineThread, pthread_self() ) ) )
+    {   // not from a state callback, no engine run would pick it up, or
+        // from another thread, the self queue has no locking
+        return _SmEnqueueActiveEvent( pSM, &newEvent, SM_PRIORITY_NORMAL );
+    }
+
+    return _SmEnqueueEvent( &pSM->mSelfEvtQueue, &newEvent );
+}
+
+/*********************************************************************
+ *
+ * Copy events into consecutive slots of the queue array starting at
+ * slot first, wrapping at the end of the array.
+ *
+ * Parameters:
+ *  pEvQ, pointer to either the active or deferred queue
+ *  first, array index of the first slot
+ *  pEvents, events to copy
+ *  eventCount, number of events, no more than mQSize
  *
  * Returns:
  *  none
  *
  *********************************************************************/
-void _SmEngine( void *pParam  )
+void _SmQCopyIn( tSmQueueEvt *pEvQ, tSmQIndex first, const tStateEvent *pEvents, tSmQIndex eventCount )
 {
-    BOOL bChangedStatesUsingActiveEvents;
-    BOOL bChangedStatesUsingDeferredEvents;
-    tSmInstance *pSM = ( tSmInstance * ) pParam;
+    tSmQIndex chunk = pEvQ->mQSize - first;
 
-    do
+    if ( chunk > eventCount )
     {
-        bChangedStatesUsingDeferredEvents = FALSE;
+        chunk = eventCount;
+    }
+
+    memcpy( &pEvQ->mpQData[ first ], pEvents, chunk * sizeof( tStateEvent ) );
+    memcpy( &pEvQ->mpQData[ 0 ], pEvents + chunk, ( eventCount - chunk ) * sizeof( tStateEvent ) );
+}
 
-        // try and process all the active events that are waiting
-        bChangedStatesUsingActiveEvents = _SmProcessActiveEvents( pSM );
+/*********************************************************************
+ *
+ * Put a batch of events onto the queue with one space check.  The
+ * free space is claimed once and the events are copied in a block.
+ * Events that do not fit are tossed and counted in mQDropCount, the
+ * overflow policy is not applied to batches.
+ *
+ * Parameters:
+ *  pEvQ, pointer to either the active or deferred queue
+ *  pEvents, events to enqueue, in order
+ *  eventCount, number of events
+ *  bAllOrNothing, TRUE to toss the whole batch if it does not fit
+ *
+ * Returns:
+ *  the number of events enqueued, from the start of the batch
+ *
+ *********************************************************************/
+tSmQIndex _SmEnqueueEvents( tSmQueueEvt *pEvQ, const tStateEvent *pEvents, tSmQIndex eventCount, BOOL bAllOrNothing )
+{
+    tSmQIndex pos, freeCount, accepted, idx;
+    tSmQIndex mask = pEvQ->mQSize - 1;
+
+    if ( NULL != pEvQ->mpQSeq )
+    {   // multi producer, the consumer frees slots in order, so the read
+        // position gives a safe lower bound of the free space
+        pos = __atomic_load_n( &pEvQ->mQEnqPos, __ATOMIC_RELAXED );
+        do
+        {
+            freeCount = pEvQ->mQSize - ( tSmQIndex ) ( pos - __atomic_load_n( &pEvQ->mQDeqPos, __ATOMIC_ACQUIRE ) );
+            accepted = ( eventCount < freeCount ) ? eventCount : freeCount;
 
-        // if at least one event was consumed which means the state has changed then
-        // try the deferred events on this new state
+            if ( ( 0 == accepted ) || ( ( TRUE == bAllOrNothing ) && ( accepted < eventCount ) ) )
+            {
+                __atomic_fetch_add( &pEvQ->mQDropCount, eventCount, __ATOMIC_RELAXED );
+                return 0;
+            }
+        } while ( !__atomic_compare_exchange_n( &pEvQ->mQEnqPos, &pos, ( tSmQIndex ) ( pos + accepted ), TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) );
 
-        if ( ( TRUE == bChangedStatesUsingActiveEvents ) && ( 0 != pSM->deferredEvtQueue.mQCount ) )
+        // the claimed range is ours, copy it in and publish each slot in order
+        for ( idx = 0 ; idx < accepted ; ++idx )
         {
-            bChangedStatesUsingDeferredEvents = _SmProcessDeferredEvents( pSM );
+            pEvQ->mpQData[ ( pos + idx ) & mask ] = pEvents[ idx ];
+            __atomic_store_n( &pEvQ->mpQSeq[ ( pos + idx ) & mask ], ( tSmQIndex ) ( pos + idx + 1 ), __ATOMIC_RELEASE );
         }
-    } while ( TRUE == bChangedStatesUsingDeferredEvents );
 
-    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s exit: a: %d, d: %d", INST_NAME pSM->activeEvtQueue.mQCount, pSM->deferredEvtQueue.mQCount );
-#ifdef RDK
-    XLOGD_DEBUG( "%s exit: a: %d, d: %d" INST_NAME, pSM->activeEvtQueue.mQCount, pSM->deferredEvtQueue.mQCount );
-#endif
-}
+        if ( accepted < eventCount )
+        {
+            __atomic_fetch_add( &pEvQ->mQDropCount, eventCount - accepted, __ATOMIC_RELAXED );
+        }
 
-void SmProcessEvents( tSmInstance *pSM )
-{
+        return accepted;
+    }
+
+    freeCount = pEvQ->mQSize - _SmQCount( pEvQ );
+    accepted = ( eventCount < freeCount ) ? eventCount : freeCount;
+
+    if ( ( TRUE == bAllOrNothing ) && ( accepted < eventCount ) )
+    {
+        accepted = 0;
+    }
+
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+    {
+        _SmQCopyIn( pEvQ, pEvQ->mQEnqPos & mask, pEvents, accepted );
+        pEvQ->mQEnqPos += accepted;
+    }
+    else if ( 0 != accepted )
+    {   // head and tail are pre-incremented, the first free slot is after the tail
+        idx = ( pEvQ->mQTail + 1 == pEvQ->mQSize ) ? 0 : pEvQ->mQTail + 1;
+        _SmQCopyIn( pEvQ, idx, pEvents, accepted );
+        pEvQ->mQTail = ( tSmQIndex ) ( ( idx + accepted - 1 ) % pEvQ->mQSize );
+        pEvQ->mQCount += accepted;
+    }
+
+    pEvQ->mQDropCount += eventCount - accepted;
+
+    return accepted;
+}
+
+/*********************************************************************
+ *
+ * Put a burst of events onto the active event queue of this instance
+ * with a single init check, space check and log.  Use this instead of
+ * calling SmEnqueueEvent for each event of a burst.  With
+ * XRP_SM_EVENT_PAYLOAD every event must have mPayloadSize set.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pEvents, events to enqueue, in order
+ *  eventCount, number of events
+ *  bAllOrNothing, TRUE to toss the whole batch if it does not fit,
+ *                 FALSE to take as many events as fit
+ *
+ * Returns:
+ *  the number of events enqueued, from the start of the batch
+ *
+ *********************************************************************/
+tSmQIndex SmEnqueueEvents( tSmInstance *pSM, const tStateEvent *pEvents, tSmQIndex eventCount, BOOL bAllOrNothing )
+{
+    tSmQIndex accepted;
+
+    if ( FALSE == pSM->bInitFinished )
+    {   // don't accept events until our init routine is called
+        XLOGD_FATAL( "%s Enqueue: No init, tossing %d events " INST_NAME, eventCount );
+        return 0;
+    }
+
+    if ( FALSE == _SmQueuesSet( pSM ) )
+    {
+        XLOGD_ERROR( "%s Enqueue: queue storage not set, tossing %d events " INST_NAME, eventCount );
+        return 0;
+    }
+
+    accepted = _SmEnqueueEvents( &pSM->activeEvtQueue, pEvents, eventCount, bAllOrNothing );
+    if ( accepted != eventCount )
+    {
+        SM_LOG_WARN( pSM, "%s Enqueue: q full, took %d of %d, drops: %u " INST_NAME, accepted, eventCount, pSM->activeEvtQueue.mQDropCount );
+    }
+#if ( XRP_SM_STATS )
+    _SmStatsEnqueue( pSM, &pSM->mStats.mActiveHighWater, &pSM->activeEvtQueue, accepted, eventCount - accepted );
+#endif
+    SM_LOG_DEBUG( pSM, "%s Enqueue: %d events, c: %d " INST_NAME, accepted, _SmQCount( &pSM->activeEvtQueue ) );
+
+    if ( ( 0 != accepted ) && ( NULL != pSM->mpScheduler ) )
+    {   // let a worker run it
+        _SmSchedulerReady( pSM );
+    }
+
+    if ( ( 0 != accepted ) && ( NULL != pSM->mpNotify ) )
+    {
+        _SmNotify( pSM );
+    }
+
+    return accepted;
+}
+
+/*********************************************************************
+ *
+ * Count an event id going on to, or coming off, the deferred queue in
+ * the instance's index of pending deferred events.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  evtID, the event id
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmDeferIndexAdd( tSmInstance *pSM, tStEventID evtID )
+{
+    int bit = ( evtID < SM_DEFER_INDEX_OTHER ) ? evtID : SM_DEFER_INDEX_OTHER;
+
+    ++pSM->mDeferPendingCount[ bit ];
+    pSM->mDeferPending |= ( uint64_t ) 1 << bit;
+}
+
+void _SmDeferIndexRemove( tSmInstance *pSM, tStEventID evtID )
+{
+    int bit = ( evtID < SM_DEFER_INDEX_OTHER ) ? evtID : SM_DEFER_INDEX_OTHER;
+
+    if ( ( 0 != pSM->mDeferPendingCount[ bit ] ) && ( 0 == --pSM->mDeferPendingCount[ bit ] ) )
+    {
+        pSM->mDeferPending &= ~( ( uint64_t ) 1 << bit );
+    }
+}
+
+void _SmEnqueueDeferredEvent( tSmInstance *pSM, const tStateEvent *pEvent )
+{
+    tStEventID evtID = pEvent->mID;
+    tSmQueueEvt *pEvQ = &pSM->deferredEvtQueue;
+    tStEventID oldestEvtID = 0;
+    eSmEnqueueStatus status;
+
+    if ( ( SM_OVERFLOW_DROP_OLDEST == pEvQ->mQOverflowPolicy ) && ( TRUE == _SmQFull( pEvQ ) ) )
+    {   // the oldest event is about to be tossed
+        oldestEvtID = _SmQSlot( pEvQ, 0 )->mID;
+    }
+
+    status = _SmEnqueueEvent( pEvQ, pEvent );
+
+    switch ( status )
+    {
+        case SM_ENQ_DROPPED_OLDEST:
+            _SmDeferIndexRemove( pSM, oldestEvtID );
+            _SmDeferIndexAdd( pSM, evtID );
+            break;
+        case SM_ENQ_OK:
+            _SmDeferIndexAdd( pSM, evtID );
+            break;
+        default:
+            // coalesced into a pending event with the same id, or tossed
+            break;
+    }
+
+    if ( SM_ENQ_OK != status )
+    {
+        SM_LOG_WARN( pSM, "%s DefQueue: q full, e: %d, s: %d, drops: %u " INST_NAME, evtID, status, pSM->deferredEvtQueue.mQDropCount );
+    }
+#if ( XRP_SM_STATS )
+    if ( SM_ENQ_OK != status )
+    {
+        ++pSM->mStats.mDeferOverflow;
+    }
+    if ( _SmQCount( &pSM->deferredEvtQueue ) > pSM->mStats.mDeferredHighWater )
+    {
+        pSM->mStats.mDeferredHighWater = _SmQCount( &pSM->deferredEvtQueue );
+    }
+#endif
+    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s DefQueue: e: %d, c: %d " INST_NAME, evtID, pSM->deferredEvtQueue.mQCount );
+    SM_LOG_DEBUG( pSM, "%s DefQueue: e: %d, c: %d " INST_NAME, evtID, _SmQCount( &pSM->deferredEvtQueue ) );
+}
+
+/*********************************************************************
+ *
+ * Multi producer dequeue, only the thread running the state machine
+ * may call this.  The slot at the read position holds an event once
+ * its sequence number is position + 1.  After copying the event out,
+ * the slot is released to the producers for the next lap.
+ *
+ * Parameters:
+ *  pEvQ, pointer to a queue set up with SmSetMultiProducer
+ *  pNewEvent, place to put the dequeued event
+ *
+ * Returns:
+ *  TRUE, if event was dequeued off the queue
+ *  FALSE, if no event was found
+ *
+ *********************************************************************/
+BOOL _SmDequeueEventMP( tSmQueueEvt *pEvQ, tStateEvent *pNewEvent )
+{
+    tSmQIndex mask = pEvQ->mQSize - 1;
+    tSmQIndex pos = pEvQ->mQDeqPos;
+    tSmQIndex seq = __atomic_load_n( &pEvQ->mpQSeq[ pos & mask ], __ATOMIC_ACQUIRE );
+
+    if ( seq != ( tSmQIndex ) ( pos + 1 ) )
+    {   // empty, or the producer that claimed this slot is still writing it
+        return FALSE;
+    }
+
+    _SmQSave( pNewEvent, &pEvQ->mpQData[ pos & mask ] );
+    __atomic_store_n( &pEvQ->mpQSeq[ pos & mask ], ( tSmQIndex ) ( pos + pEvQ->mQSize ), __ATOMIC_RELEASE );
+    // batch producers size their claim from the read position
+    __atomic_store_n( &pEvQ->mQDeqPos, ( tSmQIndex ) ( pos + 1 ), __ATOMIC_RELEASE );
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * This routine returns an event if there is one on the queue.
+ *
+ * Parameters:
+ *  pEvQ, pointer to queue data structure
+ *  pNewEvent, place to put the dequeued event
+ *
+ * Returns:
+ *  TRUE, if event was dequeued off the queue
+ *  FALSE, if no event was found
+ *
+ *********************************************************************/
+BOOL _SmDequeueEvent( tSmQueueEvt *pEvQ, tStateEvent *pNewEvent )
+{
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+    {
+        if ( NULL != pEvQ->mpQSeq )
+        {
+            return _SmDequeueEventMP( pEvQ, pNewEvent );
+        }
+
+        if ( pEvQ->mQEnqPos == pEvQ->mQDeqPos )
+        {
+            return FALSE;
+        }
+
+        // copy the event out of the array, only the head moves
+        _SmQSave( pNewEvent, &pEvQ->mpQData[ pEvQ->mQDeqPos & ( pEvQ->mQSize - 1 ) ] );
+        ++pEvQ->mQDeqPos;
+
+        return TRUE;
+    }
+
+    if ( TRUE == _SmQEmpty( pEvQ ) )
+    {
+        return FALSE;
+    }
+
+    // move head to the next element in the array
+    ++pEvQ->mQHead;
+    --pEvQ->mQCount;
+
+    // valid head: pEvQ->mQSize - 1, so wrap to 0
+    if ( pEvQ->mQHead == pEvQ->mQSize )
+    {
+        pEvQ->mQHead = 0;
+    }
+
+    // copy the event out of the array
+    _SmQSave( pNewEvent, &pEvQ->mpQData[ pEvQ->mQHead ] );
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * A coalesced event was taken off a multi producer queue, drop it for
+ * each event with the same id published right behind it, so a flood
+ * of them runs the state machine once.  Only the engine thread frees
+ * slots, so a published slot can be looked at before taking it.
+ *
+ * Parameters:
+ *  pEvQ, pointer to a queue set up with SmSetMultiProducer
+ *  pActEvent, the dequeued event, replaced by the last one of the run
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmCoalesceRunMP( tSmQueueEvt *pEvQ, tStateEvent *pActEvent )
+{
+    tSmQIndex mask = pEvQ->mQSize - 1;
+    tSmQIndex pos;
+
+    for ( ;; )
+    {
+        pos = pEvQ->mQDeqPos;
+        if ( ( __atomic_load_n( &pEvQ->mpQSeq[ pos & mask ], __ATOMIC_ACQUIRE ) != ( tSmQIndex ) ( pos + 1 ) ) ||
+             ( pEvQ->mpQData[ pos & mask ].mID != pActEvent->mID ) )
+        {
+            return;
+        }
+
+        _SmDequeueEventMP( pEvQ, pActEvent );
+        ++pEvQ->mQCoalesceCount;
+    }
+}
+
+BOOL _SmDequeueActiveEvent( tSmInstance *pSM, tStateEvent *pActEvent )
+{
+    tSmQueueEvt *pEvQ = &pSM->activeEvtQueue;
+    BOOL bGotEvent = FALSE;
+    UInt8 lane;
+
+    if ( TRUE == _SmDequeueEvent( &pSM->mSelfEvtQueue, pActEvent ) )
+    {   // the instance's own events run to completion first
+        return TRUE;
+    }
+
+    // the highest priority lane with an event goes first
+    for ( lane = XRP_SM_PRIORITY_LANES ; lane > 0 ; --lane )
+    {
+        if ( ( NULL != pSM->mPriorityEvtQueue[ lane - 1 ].mpQData ) &&
+             ( TRUE == _SmDequeueEvent( &pSM->mPriorityEvtQueue[ lane - 1 ], pActEvent ) ) )
+        {
+            pEvQ = &pSM->mPriorityEvtQueue[ lane - 1 ];
+            bGotEvent = TRUE;
+            break;
+        }
+    }
+
+    if ( FALSE == bGotEvent )
+    {
+        bGotEvent = _SmDequeueEvent( pEvQ, pActEvent );
+    }
+
+    if ( ( TRUE == bGotEvent ) && ( 0 != pSM->mCoalesceMask ) && ( NULL != pEvQ->mpQSeq ) && ( TRUE == _SmCoalesceID( pSM, pActEvent->mID ) ) )
+    {   // producers can not touch published slots, skip to the last one of a run instead
+        _SmCoalesceRunMP( pEvQ, pActEvent );
+    }
+
+    if ( TRUE == bGotEvent )
+    {
+        //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "SmDequeue, e: %d, c: %d ", pActEvent->mID, gSmActEvtQueue.mQCount );
+        SM_LOG_DEBUG( pSM, "SmDequeue, e: %d, p: %d, c: %d ", pActEvent->mID, lane, _SmQCount( pEvQ ) );
+    }
+
+    return bGotEvent;
+}
+
+/*********************************************************************
+ *
+ * Check the self event queue, the active event queue and the priority
+ * lanes for events.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  TRUE, if there is no event to dequeue
+ *  FALSE, if there is
+ *
+ *********************************************************************/
+BOOL _SmActiveEmpty( tSmInstance *pSM )
+{
+    if ( ( FALSE == _SmQEmpty( &pSM->mSelfEvtQueue ) ) || ( FALSE == _SmLanesEmpty( pSM ) ) )
+    {
+        return FALSE;
+    }
+
+    return _SmQEmpty( &pSM->activeEvtQueue );
+}
+
+/*********************************************************************
+ *
+ * Check the priority lanes that are set up for events.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  TRUE, if no lane has an event
+ *  FALSE, if one has
+ *
+ *********************************************************************/
+BOOL _SmLanesEmpty( tSmInstance *pSM )
+{
+    UInt8 lane;
+
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        if ( ( NULL != pSM->mPriorityEvtQueue[ lane ].mpQData ) && ( FALSE == _SmQEmpty( &pSM->mPriorityEvtQueue[ lane ] ) ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+BOOL _SmDequeueDeferredEvent( tSmInstance *pSM, tStateEvent *pDefEvent )
+{
+    BOOL bGotEvent = _SmDequeueEvent( &pSM->deferredEvtQueue, pDefEvent );
+
+    if ( TRUE == bGotEvent )
+    {
+        _SmDeferIndexRemove( pSM, pDefEvent->mID );
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+        if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+        {
+            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s dq def event: e: %d, c: %d " INST_NAME, pDefEvent->mID, pSM->deferredEvtQueue.mQCount );
+        }
+#elif defined( RDK )
+        SM_LOG_DEBUG( pSM, "%s dq def event: e: %d, c: %d " INST_NAME, pDefEvent->mID, _SmQCount( &pSM->deferredEvtQueue ) );
+#endif
+    }
+
+    return bGotEvent;
+}
+
+/*********************************************************************
+ *
+ * Check if a state encloses another one.
+ *
+ * Parameters:
+ *  pParentInfo - the possible parent
+ *  pStateInfo - the state
+ *
+ * Returns:
+ *  TRUE, if pParentInfo is a parent, grandparent, ... of pStateInfo
+ *  FALSE, otherwise, also when they are the same state
+ *
+ *********************************************************************/
+BOOL _SmIsParentOf( const tStateInfo *pParentInfo, const tStateInfo *pStateInfo )
+{
+    for ( pStateInfo = pStateInfo->mpParent ; NULL != pStateInfo ; pStateInfo = pStateInfo->mpParent )
+    {
+        if ( pStateInfo == pParentInfo )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * Send the enter action to a state and to the parents of it that are
+ * below pStopInfo, outermost first.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent - the event that moved the state
+ *  pStateInfo - the innermost state to enter
+ *  pStopInfo - the parent that is not left, or NULL
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmEnterStates( tSmInstance *pSM, tStateEvent *pNewEvent, tStateInfo *pStateInfo, tStateInfo *pStopInfo )
+{
+#if ( XRP_SM_STATS )
+    uint64_t startNs;
+#endif
+
+    if ( pStateInfo->mpParent != pStopInfo )
+    {
+        _SmEnterStates( pSM, pNewEvent, pStateInfo->mpParent, pStopInfo );
+    }
+
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+    if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+    {
+        DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s enter: %s, e: %d, d: %d" INST_NAME INFO_ST_NAME( pStateInfo ), pNewEvent->mID, pNewEvent->mData );
+    }
+#elif defined( RDK )
+    SM_LOG_DEBUG( pSM, "%s enter: %s, e: %d, d: %d" INST_NAME INFO_ST_NAME( pStateInfo ), pNewEvent->mID, pNewEvent->mData );
+#endif
+
+    if ( NULL != pSM->mpTrace )
+    {
+        _SmTrace( pSM, pStateInfo, pNewEvent->mID, ACT_ENTER, FALSE );
+    }
+
+#if ( XRP_SM_STATS )
+    startNs = _SmStatsNow();
+#endif
+    pStateInfo->mEntry( pNewEvent, ACT_ENTER, NULL );
+#if ( XRP_SM_STATS )
+    _SmStatsTime( &pSM->mStats.mEnterTime, startNs );
+#endif
+
+    if ( ( 0 != pStateInfo->mTimeoutMs ) && ( NULL != pSM->mpTimerWheel ) )
+    {
+        _SmTimerStart( pSM, pStateInfo );
+    }
+}
+
+/*********************************************************************
+ *
+ * The new event matched a next state row of the current state.  If
+ * the row points back to the current state then send it the internal
+ * action.  Otherwise call the next state's action guard to see if it
+ * will accept this event.  If it does then call the exit action of the
+ * current state and then call the entry action of the new state.
+ * With nested states the exit action goes to the current state and its
+ * parents, innermost first, up to the first parent that also encloses
+ * the new state.  The entry action then goes to the parents of the new
+ * state below that one, outermost first, and to the new state.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent - process this event
+ *  pNextStateInfo - the state info of the matched row
+ *  nextStateFunction - the entry point of that state
+ *
+ * Returns:
+ *  TRUE, if the event was used, either internally or by moving states
+ *  FALSE, the next state's guard rejected the event
+ *
+ *********************************************************************/
+BOOL _SmTryNextState( tSmInstance *pSM, tStateEvent *pNewEvent, tStateInfo *pNextStateInfo, tStateEntryPoint nextStateFunction )
+{
+    BOOL bEventUsed = FALSE;
+    BOOL bStGuard;
+    tStateInfo *pExitInfo;
+    tSmGuardCacheEntry *pCached = NULL;
+#if ( XRP_SM_STATS )
+    uint64_t startNs;
+    tSmStateStats *pStStats;
+#endif
+
+    // an event can be sent to the current state, don't call ACT_GUARD,
+    // or ACT_EVENT, just ACT_INTERNAL
+    if ( pSM->pCurrState == pNextStateInfo )
+    {
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+        if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+        {
+            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s internal: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
+        }
+#elif defined( RDK )
+        SM_LOG_DEBUG( pSM, "%s internal: %s, e: %d, d: %d" INST_NAME ST_NAME, pNewEvent->mID, pNewEvent->mData );
+#endif
+        if ( NULL != pSM->mpTrace )
+        {
+            _SmTrace( pSM, pNextStateInfo, pNewEvent->mID, ACT_INTERNAL, FALSE );
+        }
+#if ( XRP_SM_STATS )
+        startNs = _SmStatsNow();
+#endif
+        nextStateFunction( pNewEvent, ACT_INTERNAL, NULL );
+#if ( XRP_SM_STATS )
+        _SmStatsTime( &pSM->mStats.mInternalTime, startNs );
+#endif
+        bEventUsed = TRUE;
+    }
+    else
+    {   // normal case, try to send event to next state
+        // the next state must check it's guard to see if the conditions are right for the transition
+        // the state can ignore the newEvent since we aleady did a match on it
+        if ( pNextStateInfo->mFlags & SM_STATE_PURE_GUARD )
+        {
+            pCached = _SmGuardCacheSlot( pSM, pNextStateInfo, pNewEvent->mID );
+        }
+
+        if ( ( NULL != pCached ) && ( pCached->mpState == pNextStateInfo ) && ( pCached->mEvtID == pNewEvent->mID ) )
+        {   // asked before in this context, e.g. while replaying deferred events
+            bStGuard = pCached->bResult;
+#if ( XRP_SM_STATS )
+            ++pSM->mStats.mGuardCacheHits;
+#endif
+        }
+        else
+        {
+#if ( XRP_SM_STATS )
+            startNs = _SmStatsNow();
+#endif
+            nextStateFunction( pNewEvent, ACT_GUARD, &bStGuard );
+#if ( XRP_SM_STATS )
+            _SmStatsTime( &pSM->mStats.mGuardTime, startNs );
+#endif
+            if ( NULL != pCached )
+            {
+                pCached->mpState = pNextStateInfo;
+                pCached->mEvtID = pNewEvent->mID;
+                pCached->bResult = bStGuard;
+            }
+        }
+
+        if ( NULL != pSM->mpTrace )
+        {   // cached or not, a replay has to see the same guard answers
+            _SmTrace( pSM, pNextStateInfo, pNewEvent->mID, ACT_GUARD, ( UInt8 ) bStGuard );
+        }
+        if ( TRUE == bStGuard )
+        {   // this next state accepts the event and guard says yes
+            // tell the current state, and the parents we are leaving, that we exit
+            for ( pExitInfo = pSM->pCurrState ; ( NULL != pExitInfo ) && ( FALSE == _SmIsParentOf( pExitInfo, pNextStateInfo ) ) ; pExitInfo = pExitInfo->mpParent )
+            {
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+                if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+                {
+                    DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s exit: %s, e: %d, d: %d" INST_NAME INFO_ST_NAME( pExitInfo ), pNewEvent->mID, pNewEvent->mData );
+                }
+#elif defined( RDK )
+                SM_LOG_DEBUG( pSM, "%s exit: %s, e: %d, d: %d" INST_NAME INFO_ST_NAME( pExitInfo ), pNewEvent->mID, pNewEvent->mData );
+#endif
+
+                if ( NULL != pSM->mpTrace )
+                {
+                    _SmTrace( pSM, pExitInfo, pNewEvent->mID, ACT_EXIT, FALSE );
+                }
+#if ( XRP_SM_STATS )
+                startNs = _SmStatsNow();
+#endif
+                pExitInfo->mEntry( pNewEvent, ACT_EXIT, NULL );
+#if ( XRP_SM_STATS )
+                _SmStatsTime( &pSM->mStats.mExitTime, startNs );
+#endif
+
+                if ( ( 0 != pExitInfo->mTimeoutMs ) && ( NULL != pSM->mpTimerWheel ) )
+                {
+                    _SmTimerStop( pSM, pExitInfo );
+                }
+            }
+
+            // we have now officially moved states
+            pSM->pCurrState = pNextStateInfo;
+
+            // send the enter action to the new state, and the parents we are entering
+            _SmEnterStates( pSM, pNewEvent, pNextStateInfo, pExitInfo );
+
+#if ( XRP_SM_STATS )
+            ++pSM->mStats.mTransitions;
+            pStStats = _SmStatsSlot( &pSM->mStats, pNextStateInfo, TRUE );
+            if ( NULL != pStStats )
+            {
+                ++pStStats->mEntered;
+            }
+#endif
+
+            // this event was consumed by this state
+            bEventUsed = TRUE;
+        }
+        else
+        {   // next state guard rejected the event
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+            if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+            {
+                DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s event rejected by: %s, e: %d, d: %d" INST_NAME NEXT_ST_NAME, pNewEvent->mID, pNewEvent->mData );                    
+            }
+#elif defined( RDK )
+            SM_LOG_DEBUG( pSM, "%s event rejected by: %s, e: %d, d: %d" INST_NAME NEXT_ST_NAME, pNewEvent->mID, pNewEvent->mData );
+#endif
+#if ( XRP_SM_STATS )
+            pStStats = _SmStatsSlot( &pSM->mStats, pNextStateInfo, TRUE );
+            if ( NULL != pStStats )
+            {
+                ++pStStats->mGuardRejects;
+            }
+#endif
+        }
+    }
+
+    return bEventUsed;
+}
+
+/*********************************************************************
+ *
+ * Find the next entry of an event id list that holds evtID.  Long
+ * lists are compared 8 ids at a time with SSE2 or NEON, the lowest
+ * matching lane is the first match so the entries are found in list
+ * order, one call per match.
+ *
+ * Parameters:
+ *  pIDs - the list
+ *  first - index to start at
+ *  count - number of entries in the list
+ *  evtID - event id to look for
+ *
+ * Returns:
+ *  the index of the match, count if there is none
+ *
+ *********************************************************************/
+UInt32 _SmMatchID( const tStEventID *pIDs, UInt32 first, UInt32 count, tStEventID evtID )
+{
+    UInt32 idx = first;
+#if defined( SM_SIMD_SSE2 )
+    __m128i key;
+    UInt32 mask;
+
+    if ( count - first >= SM_SIMD_MIN_IDS )
+    {
+        key = _mm_set1_epi16( ( short ) evtID );
+        for ( ; idx + 8 <= count ; idx += 8 )
+        {   // two mask bits per lane
+            mask = ( UInt32 ) _mm_movemask_epi8( _mm_cmpeq_epi16( _mm_loadu_si128( ( const __m128i * ) &pIDs[ idx ] ), key ) );
+            if ( 0 != mask )
+            {
+                return idx + ( __builtin_ctz( mask ) >> 1 );
+            }
+        }
+    }
+#elif defined( SM_SIMD_NEON )
+    uint16x8_t key;
+    uint64_t mask;
+
+    if ( count - first >= SM_SIMD_MIN_IDS )
+    {
+        key = vdupq_n_u16( evtID );
+        for ( ; idx + 8 <= count ; idx += 8 )
+        {   // narrowing the compare to bytes leaves eight mask bits per lane
+            mask = vget_lane_u64( vreinterpret_u64_u8( vmovn_u16( vceqq_u16( vld1q_u16( &pIDs[ idx ] ), key ) ) ), 0 );
+            if ( 0 != mask )
+            {
+                return idx + ( __builtin_ctzll( mask ) >> 3 );
+            }
+        }
+    }
+#endif
+
+    for ( ; idx < count ; ++idx )
+    {
+        if ( pIDs[ idx ] == evtID )
+        {
+            return idx;
+        }
+    }
+
+    return count;
+}
+
+/*********************************************************************
+ *
+ * _SmProcessEvent for an instance with a packed table.  The same rows
+ * are tried in the same order as on the tStateInfo lists, the event
+ * ids of a state are next to each other so the scan stays in a cache
+ * line or two.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent - process this event
+ *
+ * Returns:
+ *  TRUE, if the event was used
+ *  FALSE, event was not used by the current state or its parents
+ *
+ *********************************************************************/
+BOOL _SmProcessPackedEvent( tSmInstance *pSM, tStateEvent *pNewEvent )
+{
+    const tSmPackedTable *pPacked = pSM->mpPacked;
+    UInt16 stateIdx, nextIdx;
+    UInt32 rowIdx, rowEnd;
+
+    for ( stateIdx = pSM->mPackedIdx ; SM_PACKED_NONE != stateIdx ; stateIdx = pPacked->mpParents[ stateIdx ] )
+    {
+        rowEnd = pPacked->mpRowStart[ stateIdx + 1 ];
+        for ( rowIdx = _SmMatchID( pPacked->mpRowIDs, pPacked->mpRowStart[ stateIdx ], rowEnd, pNewEvent->mID ) ; rowIdx < rowEnd ;
+              rowIdx = _SmMatchID( pPacked->mpRowIDs, rowIdx + 1, rowEnd, pNewEvent->mID ) )
+        {
+            nextIdx = pPacked->mpRowNext[ rowIdx ];
+            if ( TRUE == _SmTryNextState( pSM, pNewEvent, pPacked->mppStates[ nextIdx ], pPacked->mpEntries[ nextIdx ] ) )
+            {   // a callback may have used SmSetThisState
+                pSM->mPackedIdx = ( pSM->pCurrState == pPacked->mppStates[ nextIdx ] ) ? nextIdx : _SmPackedIndex( pPacked, pSM->pCurrState );
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * This routine processes one event at a time.  This is the heart
+ * of the state machine.  Match the new event to the current state's
+ * event ids that allow the state to transition to a new state.  If
+ * there is a match then call the the potential new states action guard
+ * to see if the new state will accept this event.  If it
+ * does then call the exit action of the current state and then
+ * call the entry action of the new state.
+ *
+ * When the current state was compiled by SmCompileStateTable only the
+ * rows for this event id are visited, in the order they are declared.
+ * If no row of the current state takes the event, the rows of its
+ * parent are tried next, and so on up to the outermost state.
+ * An instance with a packed table scans the rows of that instead.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent - process this event
+ *
+ * Returns:
+ *  TRUE, if we transitioned to a new state because of this event
+ *  FALSE, event was not used by the current state
+ *
+ *********************************************************************/
+BOOL _SmProcessEvent( tSmInstance *pSM, tStateEvent *pNewEvent )
+{
+    BOOL bEventUsed = FALSE;
+
+    int nextStateCount, nextStateIdx;
+    tStEventID nextStateEventID;
+    tStateInfo *pStateInfo, *pNextStateInfo;
+    tStateGuard *pNextStates;
+    const tStateDispatch *pDispatch;
+#if ( XRP_SM_STATS )
+    tSmStateStats *pStStats = _SmStatsSlot( &pSM->mStats, pSM->pCurrState, TRUE );
+#endif
+
+    if ( SM_PACKED_NONE != pSM->mPackedIdx )
+    {
+        bEventUsed = _SmProcessPackedEvent( pSM, pNewEvent );
+        pStateInfo = NULL;
+    }
+    else
+    {
+        pStateInfo = pSM->pCurrState;
+    }
+
+    // the current state first, then bubble up through the parents
+    for ( ; ( FALSE == bEventUsed ) && ( NULL != pStateInfo ) ; pStateInfo = pStateInfo->mpParent )
+    {
+        pNextStates = pStateInfo->mpNextStates;
+        pDispatch = pStateInfo->mpDispatch;
+
+        if ( NULL != pDispatch )
+        {   // only the rows that match this event id
+            if ( pNewEvent->mID <= pDispatch->mMaxEvtID )
+            {
+                nextStateIdx = pDispatch->mpRangeStart[ pNewEvent->mID ];
+                nextStateCount = pDispatch->mpRangeStart[ pNewEvent->mID + 1 ];
+
+                for ( ; ( FALSE == bEventUsed ) && ( nextStateIdx < nextStateCount ) ; ++nextStateIdx )
+                {
+                    pNextStateInfo = ( tStateInfo * ) pNextStates[ pDispatch->mpGuardIdx[ nextStateIdx ] ].mStInfo;
+                    bEventUsed = _SmTryNextState( pSM, pNewEvent, pNextStateInfo, pNextStateInfo->mEntry );
+                }
+            }
+        }
+        else
+        {
+            // from the current state, how many new/next states can we transition to
+            nextStateCount = pStateInfo->mNextStCount;
+
+            // walk through each possible next state asking if it will accept this event
+            for ( nextStateIdx = 0 ; nextStateIdx < nextStateCount ; ++nextStateIdx )
+            {
+                // what event does this next state need in order to make the transition
+                nextStateEventID = pNextStates[ nextStateIdx ].mID;
+
+                if ( nextStateEventID == pNewEvent->mID )
+                {   // found a next state that will accept this event
+                    pNextStateInfo = ( tStateInfo * ) pNextStates[ nextStateIdx ].mStInfo;
+                    bEventUsed = _SmTryNextState( pSM, pNewEvent, pNextStateInfo, pNextStateInfo->mEntry );
+
+                    if ( TRUE == bEventUsed )
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+#if ( XRP_SM_STATS )
+    ++pSM->mStats.mProcessed;
+    if ( TRUE == bEventUsed )
+    {
+        ++pSM->mStats.mConsumed;
+        if ( NULL != pStStats )
+        {
+            ++pStStats->mConsumed;
+        }
+    }
+#endif
+
+    return bEventUsed;
+}
+
+/*********************************************************************
+ *
+ * SM_DEFER_INDEX_BIT masks of the next state row event ids of one
+ * state and of the event ids it allows to be deferred, from its lists.
+ *
+ * Parameters:
+ *  pStateInfo - the state
+ *  pRowMask - the row event id bits are added here
+ *  pDeferMask - the deferred event id bits are added here
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmListIdMasks( const tStateInfo *pStateInfo, uint64_t *pRowMask, uint64_t *pDeferMask )
+{
+    tStateCount idx;
+
+    for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+    {
+        *pRowMask |= SM_DEFER_INDEX_BIT( pStateInfo->mpNextStates[ idx ].mID );
+    }
+
+    // the shared bit can not tell which of the higher ids are deferred
+    for ( idx = 0 ; idx < pStateInfo->mDeferEvtIDCount ; ++idx )
+    {
+        if ( pStateInfo->mpDeferEvtIDs[ idx ] < SM_DEFER_INDEX_OTHER )
+        {
+            *pDeferMask |= SM_DEFER_INDEX_BIT( pStateInfo->mpDeferEvtIDs[ idx ] );
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * SM_DEFER_INDEX_BIT masks of a state's next state row event ids and
+ * of the event ids it allows to be deferred, including the ones of its
+ * parents.  An event whose bit is not in the row mask can not move the
+ * state, an event whose bit is in the defer mask is always deferred by
+ * it.  Compiled states have them ready, otherwise the lists are scanned.
+ *
+ * Parameters:
+ *  pStateInfo - the state
+ *  pRowMask - place to put the row event id mask
+ *  pDeferMask - place to put the deferred event id mask
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmStateIdMasks( const tStateInfo *pStateInfo, uint64_t *pRowMask, uint64_t *pDeferMask )
+{
+    *pRowMask = 0;
+    *pDeferMask = 0;
+
+    for ( ; NULL != pStateInfo ; pStateInfo = pStateInfo->mpParent )
+    {
+        if ( NULL != pStateInfo->mpDispatch )
+        {
+            *pRowMask |= pStateInfo->mpDispatch->mRowIdMask;
+            *pDeferMask |= pStateInfo->mpDispatch->mDeferIdMask;
+        }
+        else
+        {
+            _SmListIdMasks( pStateInfo, pRowMask, pDeferMask );
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * This event was not useable by the current state so now check
+ * if the state will allow this event to be deferred, the state must
+ * have it in it's deferred event id list.  An event that can not be
+ * deferred is tossed here.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent, event that is trying to be deferred
+ *
+ * Returns:
+ *  TRUE, if the event may go on the deferred event queue
+ *  FALSE, the event was tossed
+ *
+ *********************************************************************/
+BOOL _SmDeferCheck( tSmInstance *pSM, tStateEvent *pNewEvent )
+{
+    BOOL bCanDefer = FALSE;
+    tStateInfo *pStateInfo;
+    const tStateDispatch *pDispatch;
+
+    // the current state or any of its parents may defer it
+    for ( pStateInfo = pSM->pCurrState ; ( FALSE == bCanDefer ) && ( NULL != pStateInfo ) ; pStateInfo = pStateInfo->mpParent )
+    {
+        pDispatch = pStateInfo->mpDispatch;
+
+        if ( NULL != pDispatch )
+        {   // compiled state, one bit per deferrable event id
+            if ( pNewEvent->mID <= pDispatch->mMaxEvtID )
+            {
+                bCanDefer = ( pDispatch->mpDeferBits[ pNewEvent->mID >> 5 ] >> ( pNewEvent->mID & 31 ) ) & 1;
+            }
+        }
+        else
+        {
+            // must check current state to see if it will accept the deferral
+            if ( _SmMatchID( pStateInfo->mpDeferEvtIDs, 0, pStateInfo->mDeferEvtIDCount, pNewEvent->mID ) < pStateInfo->mDeferEvtIDCount )
+            {
+                bCanDefer = TRUE;
+            }
+        }
+    }
+
+    if ( FALSE == bCanDefer )
+    {
+#if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
+        if ( DGB_ENABLED_SM_PRINT & pSM->debugFlags )
+        {
+            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s event unused: e: %d, d: %d" INST_NAME, pNewEvent->mID, pNewEvent->mData );
+            DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_NOISE, "%s state: %s" INST_NAME ST_NAME );
+        }
+#elif defined( RDK )
+        XLOGD_ERROR( "%s event unused: e: %d, d: %d" INST_NAME, pNewEvent->mID, pNewEvent->mData );
+        SM_LOG_DEBUG( pSM, "%s state: %s" INST_NAME ST_NAME );
+#endif
+    }
+
+    return bCanDefer;
+}
+
+#if ( XRP_SM_STATS )
+/*********************************************************************
+ *
+ * Count an event that was deferred or tossed, for the instance and
+ * the current state.  Only called once per way an event goes, the
+ * passes over the deferred queue do not count the events they keep.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  bDeferred - TRUE if the event went on the deferred queue, FALSE if
+ *              it was tossed
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmDeferStats( tSmInstance *pSM, BOOL bDeferred )
+{
+    tSmStateStats *pStStats = _SmStatsSlot( &pSM->mStats, pSM->pCurrState, TRUE );
+
+    if ( TRUE == bDeferred )
+    {
+        ++pSM->mStats.mDeferred;
+    }
+    else
+    {
+        ++pSM->mStats.mUnused;
+    }
+    if ( NULL != pStStats )
+    {
+        if ( TRUE == bDeferred )
+        {
+            ++pStStats->mDeferred;
+        }
+        else
+        {
+            ++pStStats->mUnused;
+        }
+    }
+}
+#endif
+
+/*********************************************************************
+ *
+ * This event was not useable by the current state, if the state
+ * allows it then enqueue it onto the deferred event queue.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNewEvent, event that is trying to be deferred
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmDeferEvent( tSmInstance *pSM, tStateEvent *pNewEvent )
+{
+    BOOL bCanDefer = _SmDeferCheck( pSM, pNewEvent );
+
+#if ( XRP_SM_STATS )
+    _SmDeferStats( pSM, bCanDefer );
+#endif
+    if ( TRUE == bCanDefer )
+    {
+        _SmEnqueueDeferredEvent( pSM, pNewEvent );
+    }
+}
+
+/*********************************************************************
+ *
+ * Check if the caller's budget allows processing one more event.
+ *
+ * Parameters:
+ *  pBudget - the budget of this engine run
+ *
+ * Returns:
+ *  TRUE, if another event can be processed
+ *  FALSE, the budget is used up
+ *
+ *********************************************************************/
+BOOL _SmBudgetLeft( tSmBudget *pBudget )
+{
+    struct timespec now;
+
+    if ( ( TRUE == pBudget->bCounted ) && ( 0 == pBudget->mEventsLeft ) )
+    {
+        return FALSE;
+    }
+
+    if ( TRUE == pBudget->bTimed )
+    {
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        if ( ( now.tv_sec > pBudget->mDeadline.tv_sec ) ||
+             ( ( now.tv_sec == pBudget->mDeadline.tv_sec ) && ( now.tv_nsec >= pBudget->mDeadline.tv_nsec ) ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Fast path of _SmProcessActiveEvents.  Takes the events that are on a
+ * single producer active queue when it is called, up to the event
+ * budget, and runs them in a tight loop: the queue position is moved
+ * in place, without the self queue and lane checks of
+ * _SmDequeueActiveEvent, and the row range of the next event is
+ * prefetched while this one runs, the dispatch data for that is only
+ * looked up again when the state changes.  The loop stops as soon as
+ * a self event or an event on a priority lane is waiting, they go
+ * first.  Other events that arrive during the batch are taken by the
+ * next one.  A multi producer queue keeps to _SmDequeueActiveEvent.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pBudget - the budget of this engine run
+ *
+ * Returns:
+ *  the number of events taken, 0 if the fast path does not apply or
+ *  the queue is empty
+ *
+ *********************************************************************/
+UInt32 _SmDrainActiveBatch( tSmInstance *pSM, tSmBudget *pBudget )
+{
+    tSmQueueEvt *pEvQ = &pSM->activeEvtQueue;
+    tStateEvent *pQData = pEvQ->mpQData;
+    const tStateInfo *pStateInfo = NULL;
+    const tStateDispatch *pDispatch = NULL;
+    tStateEvent newEvent;
+    tStEventID nextID;
+    UInt32 batch, done;
+    tSmQIndex pos, nextPos;
+
+    if ( ( NULL != pEvQ->mpQSeq ) || ( FALSE == _SmQEmpty( &pSM->mSelfEvtQueue ) ) || ( FALSE == _SmLanesEmpty( pSM ) ) )
+    {
+        return 0;
+    }
+
+    batch = _SmQCount( pEvQ );
+    if ( ( TRUE == pBudget->bCounted ) && ( batch > pBudget->mEventsLeft ) )
+    {
+        batch = pBudget->mEventsLeft;
+    }
+
+    for ( done = 0 ; done < batch ; )
+    {
+        // a callback can drop the oldest event of a full queue, the queue
+        // fields are the truth, the batch is only an upper bound
+        if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+        {
+            pos = pEvQ->mQDeqPos;
+            if ( pos == pEvQ->mQEnqPos )
+            {
+                break;
+            }
+            _SmQSave( &newEvent, &pQData[ pos & ( pEvQ->mQSize - 1 ) ] );
+            pEvQ->mQDeqPos = ( tSmQIndex ) ( pos + 1 );
+            nextPos = ( tSmQIndex ) ( pos + 1 ) & ( pEvQ->mQSize - 1 );
+        }
+        else
+        {
+            if ( 0 == pEvQ->mQCount )
+            {
+                break;
+            }
+            pos = ( tSmQIndex ) ( ( pEvQ->mQHead + 1 == pEvQ->mQSize ) ? 0 : pEvQ->mQHead + 1 );
+            _SmQSave( &newEvent, &pQData[ pos ] );
+            pEvQ->mQHead = pos;
+            --pEvQ->mQCount;
+            nextPos = ( tSmQIndex ) ( ( pos + 1 == pEvQ->mQSize ) ? 0 : pos + 1 );
+        }
+        ++done;
+        --pBudget->mEventsLeft;
+        SM_LOG_DEBUG( pSM, "SmDequeue, e: %d, p: %d, c: %d ", newEvent.mID, SM_PRIORITY_NORMAL, _SmQCount( pEvQ ) );
+
+        if ( pSM->pCurrState != pStateInfo )
+        {
+            pStateInfo = pSM->pCurrState;
+            pDispatch = pStateInfo->mpDispatch;
+        }
+
+        if ( ( done < batch ) && ( NULL != pDispatch ) )
+        {   // the rows of the next event, if the state does not change
+            nextID = pQData[ nextPos ].mID;
+            if ( nextID <= pDispatch->mMaxEvtID )
+            {
+                __builtin_prefetch( &pDispatch->mpRangeStart[ nextID ] );
+            }
+        }
+
+        if ( TRUE == _SmProcessEvent( pSM, &newEvent ) )
+        {
+            pSM->bActiveConsumed = TRUE;
+        }
+        else
+        {
+            _SmDeferEvent( pSM, &newEvent );
+        }
+
+        if ( ( FALSE == _SmQEmpty( &pSM->mSelfEvtQueue ) ) || ( FALSE == _SmLanesEmpty( pSM ) ) ||
+             ( ( TRUE == pBudget->bTimed ) && ( FALSE == _SmBudgetLeft( pBudget ) ) ) )
+        {
+            break;
+        }
+    }
+
+    return done;
+}
+
+/*********************************************************************
+ *
+ * Walk/dequeue all the events off the active event queue and see if
+ * the state machine will consume/use the event.  If the event
+ * is not used then try to defer it.  Stops early when the budget is
+ * used up, pSM->bActiveConsumed remembers if an event was consumed
+ * so the next run can carry on.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pBudget - the budget of this engine run
+ *
+ * Returns:
+ *  TRUE, if the active queue is empty
+ *  FALSE, the budget ran out with events still on the queue
+ *
+ *********************************************************************/
+BOOL _SmProcessActiveEvents( tSmInstance *pSM, tSmBudget *pBudget )
+{
+    tStateEvent newEvent;
+    BOOL bConsumedEvent;
+
+    for ( ;; )
+    {
+        if ( FALSE == _SmBudgetLeft( pBudget ) )
+        {
+            return _SmActiveEmpty( pSM );
+        }
+
+        if ( ( TRUE == pSM->bBatchDrain ) && ( 0 != _SmDrainActiveBatch( pSM, pBudget ) ) )
+        {   // a self or priority event may be waiting now
+            continue;
+        }
+
+        if ( FALSE == _SmDequeueActiveEvent( pSM, &newEvent ) )
+        {
+            return TRUE;
+        }
+        --pBudget->mEventsLeft;
+
+        bConsumedEvent = _SmProcessEvent( pSM, &newEvent );
+
+        if ( TRUE == bConsumedEvent )
+        {
+            //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s: consumed e: %d, c: %d", INST_NAME newEvent.mID, pSM->activeEvtQueue.mQCount );
+            SM_LOG_DEBUG( pSM, "%s: consumed e: %d, c: %d" INST_NAME, newEvent.mID, _SmQCount( &pSM->activeEvtQueue ) );
+            pSM->bActiveConsumed = TRUE;
+        }
+        else
+        {   // the current state could not use this event
+            // check if the state will defer this event
+            _SmDeferEvent( pSM, &newEvent );
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * Close the gap left by events removed from the middle of the queue.
+ * The events from position from onwards are moved down to position
+ * to, keeping their order, and the queue ends after them.  Only for
+ * a queue that is used by the engine thread alone.
+ *
+ * Parameters:
+ *  pEvQ, pointer to the deferred queue
+ *  to, position the kept events end at
+ *  from, first event position that was not looked at yet
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmQCompact( tSmQueueEvt *pEvQ, tSmQIndex to, tSmQIndex from )
+{
+    tSmQIndex count = _SmQCount( pEvQ );
+
+    if ( to != from )
+    {
+        for ( ; from < count ; ++from, ++to )
+        {
+            *_SmQSlot( pEvQ, to ) = *_SmQSlot( pEvQ, from );
+        }
+    }
+    else
+    {
+        to = count;
+    }
+
+    // only the tail moves back, the head stays on the oldest event
+    if ( pEvQ->mQFlags & SM_QUEUE_POW2 )
+    {
+        pEvQ->mQEnqPos = pEvQ->mQDeqPos + to;
+    }
+    else
+    {
+        pEvQ->mQCount = to;
+        pEvQ->mQTail = ( tSmQIndex ) ( ( ( UInt32 ) pEvQ->mQHead + to ) % pEvQ->mQSize );
+    }
+}
+
+/*********************************************************************
+ *
+ * Walk all the events on the deferred event queue and see if the
+ * state machine will consume/use the event.  The queue is scanned in
+ * place: an event that is consumed, or that the current state no
+ * longer allows to be deferred, is removed and the remaining events
+ * are packed together in the same order.  Events that stay deferred
+ * are not copied off and back on the queue.
+ *
+ * Must be careful to not get into an endless loop, each event is only
+ * looked at once per pass.  pSM->mDeferredDone events at the front of
+ * the queue were already looked at and pSM->mDeferredLeft behind them
+ * are left, so a pass cut short by the budget resumes on the next run.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pBudget - the budget of this engine run
+ *
+ * Returns:
+ *  TRUE, if the pass over the deferred queue is done
+ *  FALSE, the budget ran out during the pass
+ *
+ *********************************************************************/
+BOOL _SmProcessDeferredEvents( tSmInstance *pSM, tSmBudget *pBudget )
+{
+    tSmQueueEvt *pEvQ = &pSM->deferredEvtQueue;
+    tStateEvent newEvent;
+    tSmQIndex readIdx = pSM->mDeferredDone;
+    tSmQIndex keepIdx = pSM->mDeferredDone;
+    BOOL bPassDone = TRUE;
+    uint64_t rowMask, deferMask, evtBit;
+
+    _SmStateIdMasks( pSM->pCurrState, &rowMask, &deferMask );
+
+    while ( 0 != pSM->mDeferredLeft )
+    {
+        if ( FALSE == _SmBudgetLeft( pBudget ) )
+        {
+            bPassDone = FALSE;
+            break;
+        }
+
+        newEvent = *_SmQSlot( pEvQ, readIdx );
+        ++readIdx;
+        --pBudget->mEventsLeft;
+        --pSM->mDeferredLeft;
+
+        evtBit = SM_DEFER_INDEX_BIT( newEvent.mID );
+
+        if ( 0 != ( evtBit & rowMask ) )
+        {   // the current state may take it
+            if ( TRUE == _SmProcessEvent( pSM, &newEvent ) )
+            {
+                pSM->bDeferredConsumed = TRUE;
+                _SmDeferIndexRemove( pSM, newEvent.mID );
+                _SmStateIdMasks( pSM->pCurrState, &rowMask, &deferMask );
+                continue;
+            }
+        }
+
+        if ( ( 0 != ( evtBit & deferMask ) ) || ( TRUE == _SmDeferCheck( pSM, &newEvent ) ) )
+        {   // still deferred, keep it in order
+            if ( keepIdx != ( readIdx - 1 ) )
+            {
+                *_SmQSlot( pEvQ, keepIdx ) = newEvent;
+            }
+            ++keepIdx;
+        }
+        else
+        {
+#if ( XRP_SM_STATS )
+            _SmDeferStats( pSM, FALSE );
+#endif
+            _SmDeferIndexRemove( pSM, newEvent.mID );
+        }
+    }
+
+    _SmQCompact( pEvQ, keepIdx, readIdx );
+
+    pSM->mDeferredDone = ( TRUE == bPassDone ) ? 0 : keepIdx;
+
+    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_INFO, "%s def pass: c: %d " INST_NAME, pSM->deferredEvtQueue.mQCount );
+    SM_LOG_DEBUG( pSM, "%s def pass: left: %d, c: %d " INST_NAME, pSM->mDeferredLeft, _SmQCount( pEvQ ) );
+
+    return bPassDone;
+}
+
+/*********************************************************************
+ *
+ * Check the index of pending deferred events against the current
+ * state.  When no pending event id has a next state row and all of
+ * them are deferred by the state, a pass over the deferred queue
+ * would not call any state and keep every event, so it can be skipped.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  TRUE, if a pass may consume or toss a deferred event
+ *  FALSE, the pass can be skipped
+ *
+ *********************************************************************/
+BOOL _SmDeferredMayChange( tSmInstance *pSM )
+{
+    uint64_t rowMask, deferMask;
+
+    _SmStateIdMasks( pSM->pCurrState, &rowMask, &deferMask );
+
+    if ( ( 0 != ( pSM->mDeferPending & rowMask ) ) || ( 0 != ( pSM->mDeferPending & ~deferMask ) ) )
+    {
+        return TRUE;
+    }
+
+    SM_LOG_DEBUG( pSM, "%s def pass skipped: %s, c: %d " INST_NAME ST_NAME, _SmQCount( &pSM->deferredEvtQueue ) );
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * Run the engine within a budget.  Process all the active events and
+ * if at least one was consumed, which means the state has changed,
+ * try the deferred events once on the new state.  If a deferred event
+ * was consumed then the state changed again so start over with the
+ * active events.  When the budget runs out the progress is kept in
+ * the instance and the next run continues at the same event, so the
+ * events are processed in the same order as one unlimited run.
+ * A run started from a state callback of the same instance would
+ * change pCurrState under the running one, it only asks the running
+ * one to look at the active events again before it returns.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pBudget - the budget of this engine run
+ *
+ * Returns:
+ *  TRUE, if the budget ran out and there is work left
+ *  FALSE, the engine is idle, or the run was nested
+ *
+ *********************************************************************/
+BOOL _SmEngineRun( tSmInstance *pSM, tSmBudget *pBudget )
+{
+    BOOL bWorkLeft = FALSE;
+
+    if ( TRUE == pSM->bInEngine )
+    {   // the running engine picks the events up
+        SM_LOG_DEBUG( pSM, "%s nested run: %s" INST_NAME ST_NAME );
+        pSM->bEngineRerun = TRUE;
+        return FALSE;
+    }
+    pSM->mEngineThread = pthread_self();
+    pSM->bInEngine = TRUE;
+
+    for ( ;; )
+    {
+        if ( SM_PHASE_ACTIVE == pSM->mEnginePhase )
+        {
+            // try and process all the active events that are waiting
+            if ( FALSE == _SmProcessActiveEvents( pSM, pBudget ) )
+            {
+                bWorkLeft = TRUE;
+                break;
+            }
+
+            // if at least one event was consumed which means the state has changed then
+            // try the deferred events on this new state, unless the index tells the
+            // pass would leave every one of them where it is
+            if ( ( FALSE == pSM->bActiveConsumed ) || ( 0 == _SmQCount( &pSM->deferredEvtQueue ) ) ||
+                 ( FALSE == _SmDeferredMayChange( pSM ) ) )
+            {
+                pSM->bActiveConsumed = FALSE;
+                break;
+            }
+
+            pSM->bActiveConsumed = FALSE;
+            pSM->bDeferredConsumed = FALSE;
+            pSM->mDeferredLeft = _SmQCount( &pSM->deferredEvtQueue );
+            pSM->mDeferredDone = 0;
+            pSM->mEnginePhase = SM_PHASE_DEFERRED;
+        }
+
+        if ( FALSE == _SmProcessDeferredEvents( pSM, pBudget ) )
+        {
+            bWorkLeft = TRUE;
+            break;
+        }
+
+        pSM->mEnginePhase = SM_PHASE_ACTIVE;
+
+        if ( FALSE == pSM->bDeferredConsumed )
+        {   // nothing changed, events enqueued meanwhile wait for the next run,
+            // unless they are self events or a nested run asked for them
+            if ( ( FALSE == _SmQEmpty( &pSM->mSelfEvtQueue ) ) ||
+                 ( ( TRUE == pSM->bEngineRerun ) && ( FALSE == _SmActiveEmpty( pSM ) ) ) )
+            {
+                pSM->bEngineRerun = FALSE;
+                continue;
+            }
+
+            bWorkLeft = ( FALSE == _SmActiveEmpty( pSM ) ) ? TRUE : FALSE;
+            break;
+        }
+    }
+
+    pSM->bEngineRerun = FALSE;
+    pSM->bInEngine = FALSE;
+
+    if ( ( FALSE == bWorkLeft ) && ( NULL != pSM->mpNotify ) )
+    {   // idle, the next enqueue wakes the client again
+        bWorkLeft = _SmNotifyRearm( pSM );
+    }
+
+    //DbgLog( DBG_MODULE_SM_ENGINE, DBG_LEVEL_FATAL, "%s exit: a: %d, d: %d", INST_NAME pSM->activeEvtQueue.mQCount, pSM->deferredEvtQueue.mQCount );
+    SM_LOG_DEBUG( pSM, "%s exit: a: %d, d: %d" INST_NAME, _SmQCount( &pSM->activeEvtQueue ), _SmQCount( &pSM->deferredEvtQueue ) );
+
+    return bWorkLeft;
+}
+
+/*********************************************************************
+ *
+ * This routine is scheduled every time an event is enqueued.  When it
+ * runs it will process all the active events and then try to
+ * process any deferred events.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmEngine( void *pParam  )
+{
+    tSmInstance *pSM = ( tSmInstance * ) pParam;
+    tSmBudget budget = { FALSE, 0, FALSE, { 0, 0 } };
+
+    // with a notifier nothing wakes the client for work that is left, the
+    // notifier is only armed once the engine is idle
+    while ( ( TRUE == _SmEngineRun( pSM, &budget ) ) && ( NULL != pSM->mpNotify ) )
+    {
+    }
+}
+
+void SmProcessEvents( tSmInstance *pSM )
+{
     _SmEngine( pSM );
 }
+
+/*********************************************************************
+ *
+ * Run the state machine for a limited amount of work, for callers
+ * that must not be blocked by a storm of events, like a single
+ * threaded main loop.  The events are processed in the same order as
+ * SmProcessEvents would, only split across calls.  A callback that
+ * is running when the budget runs out always finishes first.
+ * Called from a state callback of the same instance it returns at
+ * once and the running engine also takes the events enqueued so far.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  maxEvents - events to process at most, 0 for no limit
+ *  maxMicros - microseconds to run at most, 0 for no limit
+ *
+ * Returns:
+ *  TRUE, if work is left and the caller should run it again
+ *  FALSE, the state machine is idle
+ *
+ *********************************************************************/
+BOOL SmProcessEventsBudget( tSmInstance *pSM, UInt32 maxEvents, UInt32 maxMicros )
+{
+    tSmBudget budget = { FALSE, 0, FALSE, { 0, 0 } };
+
+    if ( 0 != maxEvents )
+    {
+        budget.bCounted = TRUE;
+        budget.mEventsLeft = maxEvents;
+    }
+
+    if ( 0 != maxMicros )
+    {
+        budget.bTimed = TRUE;
+        clock_gettime( CLOCK_MONOTONIC, &budget.mDeadline );
+        budget.mDeadline.tv_sec += maxMicros / 1000000;
+        budget.mDeadline.tv_nsec += ( maxMicros % 1000000 ) * 1000;
+        if ( budget.mDeadline.tv_nsec >= 1000000000 )
+        {
+            ++budget.mDeadline.tv_sec;
+            budget.mDeadline.tv_nsec -= 1000000000;
+        }
+    }
+
+    return _SmEngineRun( pSM, &budget );
+}
+
+/*********************************************************************
+ *
+ * Find the counters of a state in the per state table, an open
+ * addressed hash on the tStateInfo address.  When bInsert is TRUE a
+ * free slot is claimed for a state that is not in the table yet.
+ *
+ * Parameters:
+ *  pStats - statistics of an instance
+ *  pStateInfo - the state to look up
+ *  bInsert - claim a slot if the state is not found
+ *
+ * Returns:
+ *  the state's counters, or NULL if not found or the table is full
+ *
+ *********************************************************************/
+tSmStateStats *_SmStatsSlot( tSmStats *pStats, const tStateInfo *pStateInfo, BOOL bInsert )
+{
+    UInt32 slot = ( UInt32 ) ( ( uintptr_t ) pStateInfo >> 3 );
+    UInt32 probe;
+    tSmStateStats *pStStats;
+
+    for ( probe = 0 ; probe < SM_STATS_MAX_STATES ; ++probe )
+    {
+        pStStats = &pStats->mStates[ ( slot + probe ) & ( SM_STATS_MAX_STATES - 1 ) ];
+
+        if ( pStStats->mpState == pStateInfo )
+        {
+            return pStStats;
+        }
+
+        if ( NULL == pStStats->mpState )
+        {
+            if ( FALSE == bInsert )
+            {
+                return NULL;
+            }
+            pStStats->mpState = pStateInfo;
+            return pStStats;
+        }
+    }
+
+    if ( TRUE == bInsert )
+    {
+        ++pStats->mStatesOverflow;
+    }
+
+    return NULL;
+}
+
+#if ( XRP_SM_STATS )
+uint64_t _SmStatsNow( void )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( ( uint64_t ) now.tv_sec * 1000000000 ) + now.tv_nsec;
+}
+
+void _SmStatsTime( tSmCallbackStats *pCbStats, uint64_t startNs )
+{
+    uint64_t elapsedNs = _SmStatsNow() - startNs;
+
+    ++pCbStats->mCalls;
+    pCbStats->mTotalNs += elapsedNs;
+    if ( elapsedNs > pCbStats->mMaxNs )
+    {
+        pCbStats->mMaxNs = ( elapsedNs > 0xFFFFFFFF ) ? 0xFFFFFFFF : ( UInt32 ) elapsedNs;
+    }
+}
+
+/*********************************************************************
+ *
+ * Count events put on a queue by the client.  Several producers may
+ * be enqueuing at once, see SmSetMultiProducer, so the counters are
+ * updated atomically.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pHighWater - high water mark of the queue
+ *  pEvQ - the queue the events went to
+ *  accepted - events that went on the queue
+ *  failed - events or calls that did not get SM_ENQ_OK
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmStatsEnqueue( tSmInstance *pSM, tSmQIndex *pHighWater, tSmQueueEvt *pEvQ, UInt32 accepted, UInt32 failed )
+{
+    tSmQIndex count = _SmQCount( pEvQ );
+    tSmQIndex mark = __atomic_load_n( pHighWater, __ATOMIC_RELAXED );
+
+    __atomic_fetch_add( &pSM->mStats.mEnqueued, accepted, __ATOMIC_RELAXED );
+    if ( 0 != failed )
+    {
+        __atomic_fetch_add( &pSM->mStats.mEnqueueFailed, failed, __ATOMIC_RELAXED );
+    }
+
+    while ( ( count > mark ) &&
+            ( FALSE == __atomic_compare_exchange_n( pHighWater, &mark, count, TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) ) )
+    {
+        // mark was reloaded, try again while we are still higher
+    }
+}
+#endif
+
+/*********************************************************************
+ *
+ * Copy the statistics of an instance.  Counters updated by producers
+ * on other threads may be a little behind.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pStats - place to put the statistics
+ *
+ * Returns:
+ *  TRUE, pStats was filled in
+ *  FALSE, the engine was built without XRP_SM_STATS
+ *
+ *********************************************************************/
+BOOL SmGetStats( tSmInstance *pSM, tSmStats *pStats )
+{
+#if ( XRP_SM_STATS )
+    memcpy( pStats, &pSM->mStats, sizeof( *pStats ) );
+
+    return TRUE;
+#else
+    ( void ) pSM;
+    ( void ) pStats;
+
+    return FALSE;
+#endif
+}
+
+/*********************************************************************
+ *
+ * Clear all the statistics of an instance, including the high water
+ * marks and the per state counters.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmResetStats( tSmInstance *pSM )
+{
+#if ( XRP_SM_STATS )
+    memset( &pSM->mStats, 0, sizeof( pSM->mStats ) );
+#else
+    ( void ) pSM;
+#endif
+}
+
+/*********************************************************************
+ *
+ * Find the counters of one state in statistics from SmGetStats.
+ *
+ * Parameters:
+ *  pStats - statistics from SmGetStats
+ *  pStateInfo - the state to look up
+ *
+ * Returns:
+ *  the state's counters, NULL if the state has not been seen since the
+ *  last reset or did not fit in the table
+ *
+ *********************************************************************/
+const tSmStateStats *SmGetStateStats( const tSmStats *pStats, const tStateInfo *pStateInfo )
+{
+    return _SmStatsSlot( ( tSmStats * ) pStats, pStateInfo, FALSE );
+}
+
+/*********************************************************************
+ *
+ * Set the runtime verbosity of this instance.  Only the levels that
+ * were compiled in (XRP_SM_LOG_LEVEL) can be turned on, errors are
+ * always logged.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  logMask - SM_LOG_MASK_xxx bits
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetLogMask( tSmInstance *pSM, UInt8 logMask )
+{
+    pSM->logMask = logMask;
+}
+
+/*********************************************************************
+ *
+ * Turn the batched drain of the active event queue on or off.  It is
+ * on after SmInit, the events are processed in the same order either
+ * way, off takes them one at a time through the general dequeue, e.g.
+ * to compare the two.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  bBatchDrain - TRUE to drain in batches
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetBatchDrain( tSmInstance *pSM, BOOL bBatchDrain )
+{
+    pSM->bBatchDrain = bBatchDrain;
+}
+
+/*********************************************************************
+ *
+ * Switch both event queues to the power of two layout, see tSmQueueEvt.
+ * Call after SmInit, no events may be enqueued while this runs.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  TRUE, if both queues now use the power of two layout
+ *  FALSE, if a queue size is not a power of two
+ *
+ *********************************************************************/
+BOOL SmSetQueuePow2( tSmInstance *pSM )
+{
+    if ( ( FALSE == _SmQPow2Size( pSM->activeEvtQueue.mQSize ) ) ||
+         ( FALSE == _SmQPow2Size( pSM->deferredEvtQueue.mQSize ) ) )
+    {   // the mask would not cover the queue
+        XLOGD_ERROR( "%s QueuePow2: q sizes %d and %d must be powers of 2" INST_NAME,
+                     pSM->activeEvtQueue.mQSize, pSM->deferredEvtQueue.mQSize );
+        return FALSE;
+    }
+
+    pSM->activeEvtQueue.mQFlags |= SM_QUEUE_POW2;
+    pSM->deferredEvtQueue.mQFlags |= SM_QUEUE_POW2;
+    _SmQReset( &pSM->activeEvtQueue );
+    _SmQReset( &pSM->deferredEvtQueue );
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Switch the active event queue to multi producer mode.  SmEnqueueEvent
+ * can then be called on this instance from any number of threads
+ * without a lock, while SmProcessEvents must still only be called from
+ * one thread at a time.  The active queue must already have its
+ * mpQData and a power of two mQSize, and no events may be enqueued
+ * while this runs.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pSeqStorage - activeEvtQueue.mQSize entries owned by the caller
+ *
+ * Returns:
+ *  TRUE, if the queue is now multi producer
+ *  FALSE, if the queue size is not a power of two
+ *
+ *********************************************************************/
+BOOL SmSetMultiProducer( tSmInstance *pSM, tSmQIndex *pSeqStorage )
+{
+    tSmQueueEvt *pEvQ = &pSM->activeEvtQueue;
+
+    if ( FALSE == _SmQPow2Size( pEvQ->mQSize ) )
+    {
+        XLOGD_ERROR( "%s MultiProducer: q size %d is not a power of 2" INST_NAME, pEvQ->mQSize );
+        return FALSE;
+    }
+
+    // multi producer queues use the power of two layout
+    pEvQ->mQFlags |= SM_QUEUE_POW2;
+    pEvQ->mpQSeq = pSeqStorage;
+    _SmQReset( pEvQ );
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Give a priority lane its storage, see SmEnqueueEventPriority.  With
+ * pSeqStorage the lane is multi producer like SmSetMultiProducer, it
+ * should be when the active event queue is.  Call after SmInit, no
+ * events may be enqueued while this runs.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  priority - 1 up to SM_PRIORITY_HIGHEST
+ *  pQData - qSize events owned by the caller, NULL to remove the lane
+ *  qSize - number of events the lane holds
+ *  pSeqStorage - qSize entries owned by the caller, NULL for a single
+ *                producer lane
+ *
+ * Returns:
+ *  TRUE, if the lane is set up
+ *  FALSE, if the priority is out of range or the size does not fit
+ *
+ *********************************************************************/
+BOOL SmSetPriorityLane( tSmInstance *pSM, UInt8 priority, tStateEvent *pQData, tSmQIndex qSize, tSmQIndex *pSeqStorage )
+{
+    tSmQueueEvt *pEvQ;
+
+    if ( ( SM_PRIORITY_NORMAL == priority ) || ( priority > SM_PRIORITY_HIGHEST ) )
+    {
+        XLOGD_ERROR( "%s PriorityLane: no lane for priority %d" INST_NAME, priority );
+        return FALSE;
+    }
+
+    if ( ( NULL != pQData ) && ( ( 0 == qSize ) || ( ( NULL != pSeqStorage ) && ( FALSE == _SmQPow2Size( qSize ) ) ) ) )
+    {
+        XLOGD_ERROR( "%s PriorityLane: bad q size %d" INST_NAME, qSize );
+        return FALSE;
+    }
+
+    pEvQ = &pSM->mPriorityEvtQueue[ priority - 1 ];
+    memset( pEvQ, 0, sizeof( *pEvQ ) );
+
+    if ( NULL != pQData )
+    {
+        pEvQ->mpQData = pQData;
+        pEvQ->mQSize = qSize;
+        pEvQ->mpQSeq = pSeqStorage;
+        if ( TRUE == _SmQPow2Size( qSize ) )
+        {
+            pEvQ->mQFlags |= SM_QUEUE_POW2;
+        }
+        _SmQReset( pEvQ );
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Declare the event ids of a machine where only the latest pending
+ * event matters, like accelerometer movement or key repeats.
+ * SmEnqueueEvent and SmEnqueueEventPriority then give a pending event
+ * with the same id on the same queue the new event data, in its place,
+ * and return SM_ENQ_COALESCED instead of adding another event, so the
+ * queue depth stays bounded under a flood.  On a multi producer queue
+ * the pending events can not be changed, there a run of them right
+ * behind each other is handed to the state machine as its last event.
+ * SmEnqueueEvents and the deferred queue do not coalesce.  Call after
+ * SmInit, with no events being enqueued.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pEvtIDs - the event ids, must stay valid, NULL to turn it off
+ *  evtIDCount - number of event ids
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetCoalesceEvents( tSmInstance *pSM, const tStEventID *pEvtIDs, UInt8 evtIDCount )
+{
+    UInt8 idx;
+
+    pSM->mCoalesceMask = 0;
+    pSM->mpCoalesceIDs = pEvtIDs;
+    pSM->mCoalesceIDCount = ( NULL == pEvtIDs ) ? 0 : evtIDCount;
+
+    for ( idx = 0 ; idx < pSM->mCoalesceIDCount ; ++idx )
+    {
+        pSM->mCoalesceMask |= SM_DEFER_INDEX_BIT( pEvtIDs[ idx ] );
+    }
+}
+
+/*********************************************************************
+ *
+ * Tell the engine that the context the SM_STATE_PURE_GUARD guards look
+ * at has changed, the guard results it remembered are no longer used.
+ * May be called from any thread, also from a state callback.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmGuardContextChanged( tSmInstance *pSM )
+{
+    __atomic_fetch_add( &pSM->mGuardGeneration, 1, __ATOMIC_RELEASE );
+}
+
+/*********************************************************************
+ *
+ * Find the guard cache entry for a state and event id.  The cache is
+ * emptied first when the context generation moved on.  The entry may
+ * hold another state or event id, the caller checks and replaces it.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pStateInfo - the state whose guard is asked
+ *  evtID - the event id
+ *
+ * Returns:
+ *  the entry
+ *
+ *********************************************************************/
+tSmGuardCacheEntry *_SmGuardCacheSlot( tSmInstance *pSM, const tStateInfo *pStateInfo, tStEventID evtID )
+{
+    UInt32 generation = __atomic_load_n( &pSM->mGuardGeneration, __ATOMIC_ACQUIRE );
+
+    if ( generation != pSM->mGuardCacheGen )
+    {
+        memset( pSM->mGuardCache, 0, sizeof( pSM->mGuardCache ) );
+        pSM->mGuardCacheGen = generation;
+    }
+
+    return &pSM->mGuardCache[ ( ( ( uintptr_t ) pStateInfo >> 4 ) ^ evtID ) & ( SM_GUARD_CACHE_SIZE - 1 ) ];
+}
+
+/*********************************************************************
+ *
+ * Check if an event id was declared with SmSetCoalesceEvents.  The
+ * mask answers for the low ids, the higher ids share the last bit and
+ * are looked up on the list.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  evtID - the event id
+ *
+ * Returns:
+ *  TRUE, if events with this id are coalesced
+ *  FALSE, if not
+ *
+ *********************************************************************/
+BOOL _SmCoalesceID( tSmInstance *pSM, tStEventID evtID )
+{
+    if ( 0 == ( pSM->mCoalesceMask & SM_DEFER_INDEX_BIT( evtID ) ) )
+    {
+        return FALSE;
+    }
+
+    if ( evtID < SM_DEFER_INDEX_OTHER )
+    {
+        return TRUE;
+    }
+
+    return ( _SmMatchID( pSM->mpCoalesceIDs, 0, pSM->mCoalesceIDCount, evtID ) < pSM->mCoalesceIDCount ) ? TRUE : FALSE;
+}
+
+/*********************************************************************
+ *
+ * Fire the notifier if it is armed.  Only the first enqueue after the
+ * engine went idle finds it armed, so a burst of events costs one
+ * wakeup.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmNotify( tSmInstance *pSM )
+{
+    // pairs with the fence in _SmNotifyRearm, the event is in the queue
+    // before the armed flag is looked at
+    if ( TRUE == __atomic_exchange_n( &pSM->bNotifyArmed, FALSE, __ATOMIC_SEQ_CST ) )
+    {
+        pSM->mpNotify( pSM, pSM->mpNotifyContext );
+    }
+}
+
+/*********************************************************************
+ *
+ * Arm the notifier when the engine goes idle.  An event that was
+ * enqueued after the engine saw the queue empty but before the
+ * notifier was armed did not notify, so look at the queue once more
+ * and take that event over unless its producer got to fire.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  TRUE, if events came in and the caller has to run again
+ *  FALSE, the notifier is armed
+ *
+ *********************************************************************/
+BOOL _SmNotifyRearm( tSmInstance *pSM )
+{
+    __atomic_store_n( &pSM->bNotifyArmed, TRUE, __ATOMIC_SEQ_CST );
+    __atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+    if ( TRUE == _SmActiveEmpty( pSM ) )
+    {
+        return FALSE;
+    }
+
+    return __atomic_exchange_n( &pSM->bNotifyArmed, FALSE, __ATOMIC_SEQ_CST );
+}
+
+/*********************************************************************
+ *
+ * Tell the client when there is work for the engine, so an event loop
+ * can sleep until then instead of polling SmProcessEvents.  pNotify
+ * runs in the thread that enqueued, once each time the active event
+ * queue goes from empty to not empty, and must not process events
+ * itself.  The client then runs SmProcessEvents, or SmProcessEventsBudget
+ * until it returns FALSE; while work is left no more notifications
+ * come.  Call after SmInit, with no SmProcessEvents running.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pNotify - the notifier, e.g. SmNotifyFd, NULL to turn it off
+ *  pContext - passed to pNotify
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetNotify( tSmInstance *pSM, tSmNotify pNotify, void *pContext )
+{
+    __atomic_store_n( &pSM->bNotifyArmed, FALSE, __ATOMIC_SEQ_CST );
+    pSM->mpNotifyContext = pContext;
+    __atomic_store_n( &pSM->mpNotify, pNotify, __ATOMIC_SEQ_CST );
+
+    if ( ( NULL != pNotify ) && ( TRUE == _SmNotifyRearm( pSM ) ) )
+    {   // events are already waiting
+        pNotify( pSM, pContext );
+    }
+}
+
+/*********************************************************************
+ *
+ * Notifier for SmSetNotify that writes a 64 bit 1 to a file
+ * descriptor, an eventfd or the write end of a pipe, that a poll()
+ * or epoll loop watches.  The loop reads it back before it runs
+ * SmProcessEvents.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pContext - the file descriptor, cast with ( void * ) ( intptr_t ) fd
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmNotifyFd( tSmInstance *pSM, void *pContext )
+{
+    uint64_t one = 1;
+
+    if ( ( ssize_t ) sizeof( one ) != write( ( int ) ( intptr_t ) pContext, &one, sizeof( one ) ) )
+    {
+        XLOGD_ERROR( "%s Notify: write to fd %d failed" INST_NAME, ( int ) ( intptr_t ) pContext );
+    }
+}
+
+/*********************************************************************
+ *
+ * Walk the state graph starting at the initial state and return every
+ * state that can be reached through the next state lists and the
+ * parent links.  The states are returned in breadth first order, the
+ * initial state first, so the index of a state in the list is stable
+ * for a given set of tables.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *  pppStates - returns the allocated list, caller must free() it
+ *  pStateCount - returns the number of states in the list
+ *
+ * Returns:
+ *  TRUE, if the list was built
+ *  FALSE, out of memory
+ *
+ *********************************************************************/
+BOOL _SmCollectStates( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, int *pStateCount )
+{
+    tStateInfo **pStates, **pGrown;
+    tStateInfo *pNextStateInfo;
+    int stateCount = 0, stateSize = 16;
+    int stateIdx, nextStateIdx, idx;
+
+    pStates = ( tStateInfo ** ) malloc( stateSize * sizeof( tStateInfo * ) );
+    if ( NULL == pStates )
+    {
+        return FALSE;
+    }
+
+    pStates[ stateCount++ ] = pInitialStateInfo;
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        // the parent comes after the rows
+        for ( nextStateIdx = 0 ; nextStateIdx <= pStates[ stateIdx ]->mNextStCount ; ++nextStateIdx )
+        {
+            if ( nextStateIdx < pStates[ stateIdx ]->mNextStCount )
+            {
+                pNextStateInfo = ( tStateInfo * ) pStates[ stateIdx ]->mpNextStates[ nextStateIdx ].mStInfo;
+            }
+            else if ( NULL != pStates[ stateIdx ]->mpParent )
+            {
+                pNextStateInfo = pStates[ stateIdx ]->mpParent;
+            }
+            else
+            {
+                break;
+            }
+
+            // state machines are small, a linear search is fine here
+            for ( idx = 0 ; idx < stateCount ; ++idx )
+            {
+                if ( pStates[ idx ] == pNextStateInfo )
+                {
+                    break;
+                }
+            }
+
+            if ( idx < stateCount )
+            {   // already have this one
+                continue;
+            }
+
+            if ( stateCount == stateSize )
+            {
+                stateSize *= 2;
+                pGrown = ( tStateInfo ** ) realloc( pStates, stateSize * sizeof( tStateInfo * ) );
+                if ( NULL == pGrown )
+                {
+                    free( pStates );
+                    return FALSE;
+                }
+                pStates = pGrown;
+            }
+
+            pStates[ stateCount++ ] = pNextStateInfo;
+        }
+    }
+
+    *pppStates = pStates;
+    *pStateCount = stateCount;
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Build the dispatch data for one state.  The next state rows are
+ * bucketed by event id with a stable counting sort, so the rows of one
+ * event id keep their declared order, and the deferred event ids are
+ * turned into a bitmap.  Everything is put in a single allocation.
+ *
+ * Parameters:
+ *  pStateInfo - the state to compile
+ *
+ * Returns:
+ *  TRUE, if the state was compiled or is left to the linear scans
+ *  FALSE, out of memory
+ *
+ *********************************************************************/
+BOOL _SmCompileState( tStateInfo *pStateInfo )
+{
+    tStateDispatch *pDispatch;
+    tStateCount *pRangeStart, *pGuardIdx;
+    UInt32 *pDeferBits;
+    tStEventID maxEvtID = 0, evtID;
+    size_t deferWords;
+    int idx;
+
+    for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+    {
+        if ( pStateInfo->mpNextStates[ idx ].mID > maxEvtID )
+        {
+            maxEvtID = pStateInfo->mpNextStates[ idx ].mID;
+        }
+    }
+    for ( idx = 0 ; idx < pStateInfo->mDeferEvtIDCount ; ++idx )
+    {
+        if ( pStateInfo->mpDeferEvtIDs[ idx ] > maxEvtID )
+        {
+            maxEvtID = pStateInfo->mpDeferEvtIDs[ idx ];
+        }
+    }
+
+    if ( maxEvtID > SM_DISPATCH_MAX_EVT_ID )
+    {   // a direct index would be too big, keep scanning this state
+        XLOGD_WARN( "Compile: %s uses e: %d, not compiled" INFO_ST_NAME( pStateInfo ), maxEvtID );
+        return TRUE;
+    }
+
+    deferWords = ( maxEvtID >> 5 ) + 1;
+
+    // the bitmap goes first to keep it aligned
+    pDispatch = ( tStateDispatch * ) calloc( 1, sizeof( tStateDispatch ) + ( deferWords * sizeof( UInt32 ) ) +
+                                                ( ( maxEvtID + 2 ) * sizeof( tStateCount ) ) + ( pStateInfo->mNextStCount * sizeof( tStateCount ) ) );
+    if ( NULL == pDispatch )
+    {
+        return FALSE;
+    }
+
+    pDeferBits = ( UInt32 * ) ( pDispatch + 1 );
+    pRangeStart = ( tStateCount * ) ( pDeferBits + deferWords );
+    pGuardIdx = pRangeStart + maxEvtID + 2;
+
+    // count the rows of each event id, then turn the counts into start offsets
+    for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+    {
+        ++pRangeStart[ pStateInfo->mpNextStates[ idx ].mID + 1 ];
+    }
+    for ( evtID = 1 ; evtID <= maxEvtID + 1 ; ++evtID )
+    {
+        pRangeStart[ evtID ] += pRangeStart[ evtID - 1 ];
+    }
+
+    // place the rows in declared order, this moves every start to the next start
+    for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+    {
+        pGuardIdx[ pRangeStart[ pStateInfo->mpNextStates[ idx ].mID ]++ ] = ( tStateCount ) idx;
+    }
+    for ( evtID = maxEvtID + 1 ; evtID > 0 ; --evtID )
+    {
+        pRangeStart[ evtID ] = pRangeStart[ evtID - 1 ];
+    }
+    pRangeStart[ 0 ] = 0;
+
+    for ( idx = 0 ; idx < pStateInfo->mDeferEvtIDCount ; ++idx )
+    {
+        evtID = pStateInfo->mpDeferEvtIDs[ idx ];
+        pDeferBits[ evtID >> 5 ] |= ( UInt32 ) 1 << ( evtID & 31 );
+    }
+
+    // the index masks of this state alone, parents are added by _SmStateIdMasks
+    _SmListIdMasks( pStateInfo, &pDispatch->mRowIdMask, &pDispatch->mDeferIdMask );
+
+    pDispatch->mMaxEvtID = maxEvtID;
+    pDispatch->bEngineOwned = TRUE;
+    pDispatch->mpRangeStart = pRangeStart;
+    pDispatch->mpGuardIdx = pGuardIdx;
+    pDispatch->mpDeferBits = pDeferBits;
+
+    pStateInfo->mpDispatch = pDispatch;
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Optional step to speed up the engine.  Build the dispatch data
+ * for every state that can be reached from the initial state, so that
+ * an event only visits the next state rows with its event id and the
+ * deferral check is a single bit test.  The rows are still tried in
+ * the order they are declared.  The tables are shared by every
+ * instance using these states, so compile once before the instances
+ * start processing events.  States that are already compiled are
+ * left alone.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *
+ * Returns:
+ *  TRUE, if the state tables were compiled
+ *  FALSE, out of memory, the states that were not compiled still work
+ *
+ *********************************************************************/
+BOOL SmCompileStateTable( tStateInfo *pInitialStateInfo )
+{
+    tStateInfo **pStates;
+    int stateCount, idx;
+    BOOL bCompiled = TRUE;
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "Compile: out of memory" );
+        return FALSE;
+    }
+
+    for ( idx = 0 ; ( TRUE == bCompiled ) && ( idx < stateCount ) ; ++idx )
+    {
+        if ( NULL == pStates[ idx ]->mpDispatch )
+        {
+            bCompiled = _SmCompileState( pStates[ idx ] );
+        }
+    }
+
+    free( pStates );
+
+    if ( FALSE == bCompiled )
+    {
+        XLOGD_ERROR( "Compile: out of memory" );
+    }
+
+    return bCompiled;
+}
+
+/*********************************************************************
+ *
+ * Release the dispatch data built by SmCompileStateTable.  No instance
+ * may be processing events on these states while this runs.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmFreeStateTable( tStateInfo *pInitialStateInfo )
+{
+    tStateInfo **pStates;
+    int stateCount, idx;
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "Free: out of memory" );
+        return;
+    }
+
+    for ( idx = 0 ; idx < stateCount ; ++idx )
+    {
+        if ( ( NULL != pStates[ idx ]->mpDispatch ) && ( TRUE == pStates[ idx ]->mpDispatch->bEngineOwned ) )
+        {
+            free( ( void * ) pStates[ idx ]->mpDispatch );
+            pStates[ idx ]->mpDispatch = NULL;
+        }
+    }
+
+    free( pStates );
+}
+
+/*********************************************************************
+ *
+ * Number of a state in a packed table.
+ *
+ * Parameters:
+ *  pPacked - the table
+ *  pStateInfo - the state
+ *
+ * Returns:
+ *  the state number, SM_PACKED_NONE if the state is not in the table
+ *
+ *********************************************************************/
+UInt16 _SmPackedIndex( const tSmPackedTable *pPacked, const tStateInfo *pStateInfo )
+{
+    UInt16 stateIdx;
+
+    for ( stateIdx = 0 ; stateIdx < pPacked->mStateCount ; ++stateIdx )
+    {
+        if ( pPacked->mppStates[ stateIdx ] == pStateInfo )
+        {
+            return stateIdx;
+        }
+    }
+
+    return SM_PACKED_NONE;
+}
+
+/*********************************************************************
+ *
+ * Optional step to speed up the engine, like SmCompileStateTable but
+ * for the whole machine.  Build the packed table of every state that
+ * can be reached from the initial state: the event ids of the rows in
+ * one array, the next states as numbers, and the entry points and
+ * parents in arrays of their own, all in one block.  The table can be
+ * shared by any number of instances, see SmSetPackedTable.  The state
+ * tables must not change while it is used.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *
+ * Returns:
+ *  the table, free it with SmFreePackedTable
+ *  NULL, out of memory or too many states or rows
+ *
+ *********************************************************************/
+tSmPackedTable *SmPackStateTable( tStateInfo *pInitialStateInfo )
+{
+    tSmPackedTable *pPacked;
+    tStateInfo **pStates;
+    tStateEntryPoint *pEntries;
+    tStateInfo **ppPackedStates;
+    tStEventID *pRowIDs;
+    UInt16 *pRowNext, *pRowStart, *pParents;
+    int stateCount, rowCount = 0, stateIdx, idx;
+    UInt8 *pBlock;
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "Pack: out of memory" );
+        return NULL;
+    }
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        rowCount += pStates[ stateIdx ]->mNextStCount;
+    }
+
+    if ( ( stateCount >= SM_PACKED_NONE ) || ( rowCount > 0xFFFF ) )
+    {
+        XLOGD_ERROR( "Pack: %d states, %d rows do not fit", stateCount, rowCount );
+        free( pStates );
+        return NULL;
+    }
+
+    // the pointers first to keep them aligned, the cold state list last
+    pBlock = ( UInt8 * ) malloc( sizeof( tSmPackedTable ) + ( stateCount * sizeof( tStateEntryPoint ) ) +
+                                 ( rowCount * ( sizeof( tStEventID ) + sizeof( UInt16 ) ) ) +
+                                 ( ( ( 2 * stateCount ) + 1 ) * sizeof( UInt16 ) ) + SM_CACHE_LINE_SIZE + ( stateCount * sizeof( tStateInfo * ) ) );
+    if ( NULL == pBlock )
+    {
+        XLOGD_ERROR( "Pack: out of memory" );
+        free( pStates );
+        return NULL;
+    }
+
+    pPacked = ( tSmPackedTable * ) pBlock;
+    pEntries = ( tStateEntryPoint * ) ( pPacked + 1 );
+    pRowIDs = ( tStEventID * ) ( pEntries + stateCount );
+    pRowNext = ( UInt16 * ) ( pRowIDs + rowCount );
+    pRowStart = pRowNext + rowCount;
+    pParents = pRowStart + stateCount + 1;
+    ppPackedStates = ( tStateInfo ** ) SM_ROUND_UP_LINE( ( uintptr_t ) ( pParents + stateCount ) );
+
+    rowCount = 0;
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        ppPackedStates[ stateIdx ] = pStates[ stateIdx ];
+    }
+    pPacked->mStateCount = ( UInt16 ) stateCount;
+    pPacked->mppStates = ppPackedStates;
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        pEntries[ stateIdx ] = pStates[ stateIdx ]->mEntry;
+        pParents[ stateIdx ] = ( NULL == pStates[ stateIdx ]->mpParent ) ? SM_PACKED_NONE : _SmPackedIndex( pPacked, pStates[ stateIdx ]->mpParent );
+        pRowStart[ stateIdx ] = ( UInt16 ) rowCount;
+        for ( idx = 0 ; idx < pStates[ stateIdx ]->mNextStCount ; ++idx )
+        {   // every next state was collected
+            pRowIDs[ rowCount ] = pStates[ stateIdx ]->mpNextStates[ idx ].mID;
+            pRowNext[ rowCount ] = _SmPackedIndex( pPacked, ( tStateInfo * ) pStates[ stateIdx ]->mpNextStates[ idx ].mStInfo );
+            ++rowCount;
+        }
+    }
+    pRowStart[ stateCount ] = ( UInt16 ) rowCount;
+
+    pPacked->mRowCount = ( UInt16 ) rowCount;
+    pPacked->mpEntries = pEntries;
+    pPacked->mpRowIDs = pRowIDs;
+    pPacked->mpRowNext = pRowNext;
+    pPacked->mpRowStart = pRowStart;
+    pPacked->mpParents = pParents;
+
+    free( pStates );
+
+    return pPacked;
+}
+
+/*********************************************************************
+ *
+ * Release a table built by SmPackStateTable.  No instance may still
+ * be using it.
+ *
+ * Parameters:
+ *  pPacked - the table
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmFreePackedTable( tSmPackedTable *pPacked )
+{
+    free( pPacked );
+}
+
+/*********************************************************************
+ *
+ * Run an instance on a packed table from SmPackStateTable.  The
+ * instance behaves the same, only the next state rows are looked up
+ * in the table.  Call after SmInit, with no SmProcessEvents running.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pPacked - the table, NULL to go back to the tStateInfo lists
+ *
+ * Returns:
+ *  TRUE, if the instance uses the table
+ *  FALSE, the current state is not in the table
+ *
+ *********************************************************************/
+BOOL SmSetPackedTable( tSmInstance *pSM, const tSmPackedTable *pPacked )
+{
+    pSM->mpPacked = pPacked;
+    pSM->mPackedIdx = SM_PACKED_NONE;
+
+    if ( NULL == pPacked )
+    {
+        return TRUE;
+    }
+
+    pSM->mPackedIdx = _SmPackedIndex( pPacked, pSM->pCurrState );
+    if ( SM_PACKED_NONE == pSM->mPackedIdx )
+    {
+        XLOGD_ERROR( "%s Packed: %s is not in the table" INST_NAME ST_NAME );
+        pSM->mpPacked = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
@@ -52,6 +52,8 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <pthread.h>
+#include "xrpSMEngineConfig.h"
 #define RDK
 #define BOOL                             bool
 #define TRUE                             true
@@ -60,6 +62,8 @@
 #define ui8                              UInt8
 #define UInt16                           uint16_t
 #define ui16                             UInt16
+#define UInt32                           uint32_t
+#define ui32                             UInt32
 #define ARRAY_COUNT( a )                 ( sizeof( a ) / sizeof( (a)[0] ) )
 
 
@@ -73,6 +77,44 @@
 #define XLOGD_ERROR(...)  printf( LOG_PREFIX "ERROR: "  __VA_ARGS__ )
 #define XLOGD_FATAL(...)  printf( LOG_PREFIX "FATAL: "  __VA_ARGS__ )
 #endif
+
+// Engine log levels.  Everything above XRP_SM_LOG_LEVEL is compiled out of
+// the engine, ERROR and FATAL logs are always compiled in.
+#define SM_LOG_LEVEL_ERROR               1
+#define SM_LOG_LEVEL_WARN                2
+#define SM_LOG_LEVEL_INFO                3
+#define SM_LOG_LEVEL_DEBUG               4
+
+#ifndef XRP_SM_LOG_LEVEL
+#define XRP_SM_LOG_LEVEL                 SM_LOG_LEVEL_DEBUG
+#endif
+
+#ifndef XRP_SM_QINDEX_BITS
+#define XRP_SM_QINDEX_BITS               16
+#endif
+
+#ifndef XRP_SM_STATS
+#define XRP_SM_STATS                     0
+#endif
+
+#ifndef XRP_SM_SIMD
+#define XRP_SM_SIMD                      1
+#endif
+
+#ifndef XRP_SM_EVENT_PAYLOAD
+#define XRP_SM_EVENT_PAYLOAD             0
+#endif
+
+#ifndef XRP_SM_PRIORITY_LANES
+#define XRP_SM_PRIORITY_LANES            1
+#endif
+
+// Per instance runtime verbosity, bits for tSmInstance.logMask.  Only
+// the levels that are compiled in can be turned on at runtime.
+#define SM_LOG_MASK_WARN                 0x01
+#define SM_LOG_MASK_INFO                 0x02
+#define SM_LOG_MASK_DEBUG                0x04
+#define SM_LOG_MASK_ALL                  ( SM_LOG_MASK_WARN | SM_LOG_MASK_INFO | SM_LOG_MASK_DEBUG )
  
 //-------------------------------------------------------------------------------
 // Macros
@@ -87,11 +129,13 @@
 #define SHOW_ST_NAME( sName )           sName,
 #define ST_NAME                         ,pSM->pCurrState->mStateName   
 #define NEXT_ST_NAME                    ,pNextStateInfo->mStateName
+#define INFO_ST_NAME( pInfo )           ,( pInfo )->mStateName
 #else
 #define STATE_NAME 
 #define SHOW_ST_NAME( sName )                          
 #define ST_NAME                                        
 #define NEXT_ST_NAME                                        
+#define INFO_ST_NAME( pInfo )
 #endif    
 
 #if ( ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) ) || defined( RDK ) )
@@ -127,13 +171,26 @@ typedef ui16 tStEventID;
 //typedef ui16 tStEventData;
 typedef void * tStEventData; // Changed for the RDK
 typedef ui8 tStateCount;
+// most next state rows or deferred event ids a tStateInfo can hold
+#define SM_MAX_STATE_COUNT               ( ( tStateCount ) ~0 )
 
 
 // this is the thing that is pushed to the state machine to make it move states
 typedef struct _StateEvent
 {
     tStEventID          mID;
+#if ( XRP_SM_EVENT_PAYLOAD )
+        // bytes of mPayload in use, set by SmEnqueueEventPayload
+    UInt16              mPayloadSize;
+#endif
     tStEventData        mData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+        // copy of the producer's payload, it travels with the event through
+        // the active and deferred queues, so the producer does not have to
+        // allocate it.  Only valid while a state handles the event, copy out
+        // anything that has to live longer.
+    UInt8               mPayload[ XRP_SM_EVENT_PAYLOAD ];
+#endif
 } tStateEvent;
 
 
@@ -148,6 +205,38 @@ typedef struct _StateGuard
     void                *mStInfo;
 } tStateGuard;
 
+// Index of the event ids pending on the deferred queue, one bit per event
+// id below SM_DEFER_INDEX_OTHER, all the higher event ids share the last bit
+#define SM_DEFER_INDEX_BITS              64
+#define SM_DEFER_INDEX_OTHER             ( SM_DEFER_INDEX_BITS - 1 )
+#define SM_DEFER_INDEX_BIT( id )         ( ( uint64_t ) 1 << ( ( ( id ) < SM_DEFER_INDEX_OTHER ) ? ( id ) : SM_DEFER_INDEX_OTHER ) )
+
+// States using event ids above this get no dispatch data and are left to
+// the linear scans
+#define SM_DISPATCH_MAX_EVT_ID           ( 1023 )
+
+// Compiled dispatch data for one state, built by SmCompileStateTable().
+// The candidate rows for event id are
+//   mpNextStates[ mpGuardIdx[ mpRangeStart[ id ] ] ] .. mpNextStates[ mpGuardIdx[ mpRangeStart[ id + 1 ] - 1 ] ]
+// listed in the same order as they are declared in mpNextStates.
+typedef struct _StateDispatch
+{
+        // no event id above this one is accepted or deferred by the state
+    tStEventID          mMaxEvtID;
+        // TRUE when allocated by SmCompileStateTable and released by SmFreeStateTable
+    BOOL                bEngineOwned;
+        // mMaxEvtID + 2 entries
+    const tStateCount   *mpRangeStart;
+        // mNextStCount entries, indexes into mpNextStates sorted by event id
+    const tStateCount   *mpGuardIdx;
+        // one bit per event id that the state allows to be deferred
+    const UInt32        *mpDeferBits;
+        // SM_DEFER_INDEX_BIT of every next state row event id
+    uint64_t            mRowIdMask;
+        // SM_DEFER_INDEX_BIT of the deferred event ids below SM_DEFER_INDEX_OTHER
+    uint64_t            mDeferIdMask;
+} tStateDispatch;
+
 typedef struct _StateInfo
 {
         // allows state name to be printed during debug
@@ -163,17 +252,239 @@ typedef struct _StateInfo
     tStateCount         mDeferEvtIDCount;
         // points to an array of possible deferred event ids that this state allows
     tStEventID          *mpDeferEvtIDs;
+        // COMPILED DISPATCH INFO
+        // set by SmCompileStateTable, when NULL the lists above are scanned
+    const tStateDispatch *mpDispatch;
+        // NESTED STATES
+        // the enclosing state or NULL.  An event the state can not use is
+        // tried on the rows of the parent, then the grandparent, and an
+        // event the state does not defer may be deferred by a parent.
+        // Moving states exits from the current state up to the first
+        // common parent of the next state and enters down to the next state.
+    struct _StateInfo   *mpParent;
+        // STATE TIMEOUT
+        // when not 0 and the instance has a timer wheel, entering the state
+        // arms a timer that enqueues mTimeoutEvent after mTimeoutMs with the
+        // tStateInfo as the event data, and leaving the state cancels it
+    UInt32              mTimeoutMs;
+    tStEventID          mTimeoutEvent;
+        // SM_STATE_xxx
+    UInt8               mFlags;
 } tStateInfo;
 
+// tStateInfo.mFlags
+    // the guard only looks at the application context, not at the event
+    // data, so its answer for an event id holds until SmGuardContextChanged
+#define SM_STATE_PURE_GUARD              0x01
+
+// no state, for tSmPackedTable.mpParents and tSmInstance.mPackedIdx
+#define SM_PACKED_NONE                   0xFFFF
+
+// Packed form of a whole machine, built by SmPackStateTable() and used by
+// the instances given it with SmSetPackedTable().  The states are numbered,
+// the initial state is 0, and the hot data is kept in a few small arrays,
+// the rows of state n are
+//   mpRowIDs[ mpRowStart[ n ] ] .. mpRowIDs[ mpRowStart[ n + 1 ] - 1 ]
+// in the order they are declared, mpRowNext holds the next state of each
+// row.  The tStateInfo of every state, with the names and the defer lists,
+// is only looked at when the state changes or an event is not used.
+typedef struct _SmPackedTable
+{
+    UInt16              mStateCount;
+    UInt16              mRowCount;
+        // HOT, mStateCount entries
+    const tStateEntryPoint *mpEntries;
+        // mRowCount entries
+    const tStEventID    *mpRowIDs;
+    const UInt16        *mpRowNext;
+        // mStateCount + 1 entries
+    const UInt16        *mpRowStart;
+        // mStateCount entries, SM_PACKED_NONE for an outermost state
+    const UInt16        *mpParents;
+        // COLD, mStateCount entries
+    tStateInfo          **mppStates;
+} tSmPackedTable;
+
+// What a full queue does with a new event, see tSmQueueEvt.mQOverflowPolicy
+typedef enum
+{
+        // toss the new event
+    SM_OVERFLOW_DROP_NEWEST = 0,
+        // toss the oldest pending event to make room for the new one
+    SM_OVERFLOW_DROP_OLDEST,
+        // replace the data of the newest pending event with the same id,
+        // toss the new event if there is none
+    SM_OVERFLOW_COALESCE
+
+} eSmOverflowPolicy;
+
+// Result of enqueueing an event
+typedef enum
+{
+        // the event is on the queue
+    SM_ENQ_OK = 0,
+        // the event is on the queue, the oldest pending event was tossed
+    SM_ENQ_DROPPED_OLDEST,
+        // the event data replaced a pending event with the same id
+    SM_ENQ_COALESCED,
+        // the queue was full and the event was tossed
+    SM_ENQ_DROPPED,
+        // SmInit has not been called or the queue storage is not set, the
+        // event was tossed
+    SM_ENQ_NOT_INIT,
+        // the payload is larger than XRP_SM_EVENT_PAYLOAD, the event was tossed
+    SM_ENQ_PAYLOAD_SIZE
+
+} eSmEnqueueStatus;
+
+// Queue indexes and sizes, XRP_SM_QINDEX_BITS wide
+#if ( XRP_SM_QINDEX_BITS == 32 )
+typedef UInt32 tSmQIndex;
+#else
+typedef UInt16 tSmQIndex;
+#endif
+
+// largest queue size for the power of two layout
+#define SM_QUEUE_MAX_POW2_SIZE           ( ( tSmQIndex ) 1 << ( XRP_SM_QINDEX_BITS - 1 ) )
+
+// tSmQueueEvt.mQFlags
+    // power of two layout, set by SmSetQueuePow2 after SmInit
+#define SM_QUEUE_POW2                    0x01
+
+// Event ring buffer.  The client provides mpQData and mQSize for the
+// active and the deferred queue, before SmInit or after it but before the
+// first event is enqueued, events enqueued without them are tossed.
+// By default the queue uses head, tail and count and can be any size.
+// With SM_QUEUE_POW2 the size must be a power of two, the queue then only
+// keeps the free running positions mQEnqPos and mQDeqPos, wraps them with
+// a mask and derives the count from their difference.
+// SmSetMultiProducer switches the active queue to multi producer mode on
+// top of the power of two layout, any thread can then enqueue while one
+// thread dequeues, using a sequence number per slot.  A multi producer
+// queue always uses SM_OVERFLOW_DROP_NEWEST.
 typedef struct _SmQueueEvt
 {
-    UInt16          mQHead;
-    UInt16          mQTail;
-    UInt16          mQCount;
-    UInt16          mQSize;
+    tSmQIndex       mQHead;
+    tSmQIndex       mQTail;
+    tSmQIndex       mQCount;
+    tSmQIndex       mQSize;
     tStateEvent     *mpQData;
+        // SM_QUEUE_xxx
+    UInt8           mQFlags;
+        // MULTI PRODUCER MODE, mQSize entries, NULL for a single threaded queue
+    tSmQIndex       *mpQSeq;
+        // POWER OF TWO LAYOUT, next position to be written
+    tSmQIndex       mQEnqPos;
+        // next position to be read
+    tSmQIndex       mQDeqPos;
+        // OVERFLOW HANDLING, eSmOverflowPolicy, set by the client
+    UInt8           mQOverflowPolicy;
+        // events lost because the queue was full
+    UInt32          mQDropCount;
+        // events merged into a pending event because the queue was full
+    UInt32          mQCoalesceCount;
 } tSmQueueEvt;
 
+// events a state callback can queue on its own instance with
+// SmEnqueueSelfEvent before they are processed
+#define SM_SELF_QUEUE_SIZE               8
+
+
+// STATISTICS, kept when XRP_SM_STATS is 1
+
+// time spent in one kind of state callback
+typedef struct _SmCallbackStats
+{
+    UInt32          mCalls;
+    UInt32          mMaxNs;
+    uint64_t        mTotalNs;
+} tSmCallbackStats;
+
+// counters of one state, mpState is NULL for an unused slot
+typedef struct _SmStateStats
+{
+    const tStateInfo *mpState;
+        // events that moved the machine out of, or were internal to, this state
+    UInt32          mConsumed;
+        // events put on the deferred queue while in this state
+    UInt32          mDeferred;
+        // events this state could neither use nor defer
+    UInt32          mUnused;
+        // times a guard of this state said no
+    UInt32          mGuardRejects;
+    UInt32          mEntered;
+} tSmStateStats;
+
+// slots for per state counters, a power of 2
+#define SM_STATS_MAX_STATES              32
+
+typedef struct _SmStats
+{
+        // EVENT QUEUES
+    UInt32          mEnqueued;
+        // SmEnqueueEvent(s) calls that did not return SM_ENQ_OK, or lost events
+    UInt32          mEnqueueFailed;
+    UInt32          mDeferOverflow;
+    tSmQIndex       mActiveHighWater;
+    tSmQIndex       mDeferredHighWater;
+        // ENGINE
+    UInt32          mProcessed;
+    UInt32          mConsumed;
+    UInt32          mDeferred;
+    UInt32          mUnused;
+    UInt32          mTransitions;
+        // SM_STATE_PURE_GUARD guards answered from the cache
+    UInt32          mGuardCacheHits;
+        // CALLBACK LATENCY
+    tSmCallbackStats mGuardTime;
+    tSmCallbackStats mExitTime;
+    tSmCallbackStats mEnterTime;
+    tSmCallbackStats mInternalTime;
+        // PER STATE, open addressed on the tStateInfo address
+    tSmStateStats   mStates[ SM_STATS_MAX_STATES ];
+        // events of states that did not fit in mStates
+    UInt32          mStatesOverflow;
+} tSmStats;
+
+
+// GUARD CACHE, see SmGuardContextChanged
+
+// SM_STATE_PURE_GUARD results an instance remembers, a power of 2
+#define SM_GUARD_CACHE_SIZE              8
+
+// one remembered guard result, mpState is NULL for an unused entry
+typedef struct _SmGuardCacheEntry
+{
+    const tStateInfo    *mpState;
+    tStEventID          mEvtID;
+    BOOL                bResult;
+} tSmGuardCacheEntry;
+
+
+// STATE TIMERS, see xrpSMTimer.h
+
+// states nested deeper than this get no timeout
+#define SM_TIMER_MAX_DEPTH               4
+
+// the timeout of one state, kept in the instance and linked into a slot
+// of the timer wheel while armed
+typedef struct _SmTimer
+{
+    struct _SmTimer     *mpNext;
+    struct _SmTimer     *mpPrev;
+        // the slot list head, NULL when not armed
+    struct _SmTimer     **mppSlot;
+        // wheel tick the timer fires at
+    UInt32              mExpiry;
+    struct _SMInstance  *mpSM;
+    tStateInfo          *mpStateInfo;
+} tSmTimer;
+
+// called by the thread that enqueued an event when the active event queue
+// of an instance goes from empty to not empty, see SmSetNotify
+struct _SMInstance;
+typedef void ( *tSmNotify )( struct _SMInstance *pSM, void *pContext );
+
 
 typedef struct _SMInstance
 {
@@ -182,13 +493,107 @@ typedef struct _SMInstance
     tStateInfo      *pCurrState;
     tSmQueueEvt     activeEvtQueue;
     tSmQueueEvt     deferredEvtQueue;
+    // PRIORITY LANES, set by SmSetPriorityLane, lane n - 1 holds the events
+    // of priority n, a lane without mpQData is not used
+    tSmQueueEvt     mPriorityEvtQueue[ XRP_SM_PRIORITY_LANES ];
+    // SELF EVENTS, queued by SmEnqueueSelfEvent, they go before the
+    // priority lanes and the active event queue
+    tSmQueueEvt     mSelfEvtQueue;
+    tStateEvent     mSelfEvtData[ SM_SELF_QUEUE_SIZE ];
     BOOL            bInitFinished;
+    // SM_LOG_MASK_xxx bits, set to SM_LOG_MASK_ALL by SmInit
+    UInt8           logMask;
+    // TRUE when SmInitEx allocated this instance from the heap
+    BOOL            bEngineOwned;
+    // ENGINE PROGRESS, lets SmProcessEventsBudget continue where it stopped
+    UInt8           mEnginePhase;
+    BOOL            bActiveConsumed;
+    BOOL            bDeferredConsumed;
+    tSmQIndex       mDeferredLeft;
+    tSmQIndex       mDeferredDone;
+        // TRUE while the engine runs, a nested run only sets bEngineRerun,
+        // mEngineThread is the thread running it
+    BOOL            bInEngine;
+    pthread_t       mEngineThread;
+    BOOL            bEngineRerun;
+        // TRUE, set by SmInit, to drain the active queue in batches, see
+        // SmSetBatchDrain
+    BOOL            bBatchDrain;
+    // DEFERRED QUEUE INDEX, events pending per SM_DEFER_INDEX_BIT
+    uint64_t        mDeferPending;
+    tSmQIndex       mDeferPendingCount[ SM_DEFER_INDEX_BITS ];
+    // SCHEDULER, set by SmSchedulerAdd, see xrpSMScheduler.h
+    struct _SmScheduler *mpScheduler;
+    UInt8           mSchedFlags;
+    UInt8           mSchedHome;
+    // NOTIFIER, set by SmSetNotify
+    tSmNotify       mpNotify;
+    void            *mpNotifyContext;
+        // TRUE when the next enqueue fires mpNotify
+    BOOL            bNotifyArmed;
+    // STATE TIMERS, set by SmSetTimerWheel, one per nesting depth
+    struct _SmTimerWheel *mpTimerWheel;
+    tSmTimer        mStateTimers[ SM_TIMER_MAX_DEPTH ];
+        // the list of instances attached to mpTimerWheel
+    struct _SMInstance *mpWheelNext;
+    struct _SMInstance *mpWheelPrev;
+    // PACKED TABLE, set by SmSetPackedTable, mPackedIdx is pCurrState
+    const tSmPackedTable *mpPacked;
+    UInt16          mPackedIdx;
+    // COALESCED EVENTS, set by SmSetCoalesceEvents, SM_DEFER_INDEX_BIT per id
+    uint64_t        mCoalesceMask;
+    const tStEventID *mpCoalesceIDs;
+    UInt8           mCoalesceIDCount;
+    // TRACE, set by SmSetTrace, see xrpSMTrace.h
+    struct _SmTrace *mpTrace;
+    // GUARD CACHE, mGuardCache holds results for generation mGuardCacheGen
+    UInt32          mGuardGeneration;
+    UInt32          mGuardCacheGen;
+    tSmGuardCacheEntry mGuardCache[ SM_GUARD_CACHE_SIZE ];
+#if ( XRP_SM_STATS )
+    tSmStats        mStats;
+#endif
 #if ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) )
     UInt8           debugFlags;
 #endif
 } tSmInstance;
 
 
+// tSmInstance.mEnginePhase
+    // processing the active event queue
+#define SM_PHASE_ACTIVE                  0
+    // one pass over the deferred event queue
+#define SM_PHASE_DEFERRED                1
+
+// Caller supplied memory for SmInitEx, instances are carved from
+// mpBase + mUsed and the arena is never freed by the engine
+typedef struct _SmArena
+{
+    UInt8           *mpBase;
+    size_t          mSize;
+    size_t          mUsed;
+} tSmArena;
+
+// SmInitEx flags
+    // the active event queue is set up for SmSetMultiProducer
+#define SM_INIT_MULTI_PRODUCER           0x01
+    // both queues use SM_QUEUE_POW2
+#define SM_INIT_POW2_QUEUES              0x02
+    // every priority lane gets SM_PRIORITY_LANE_SIZE events, multi producer
+    // too when SM_INIT_MULTI_PRODUCER is set
+#define SM_INIT_PRIORITY_LANES           0x04
+
+// priority lane size used by SmInitEx, these events are meant to be rare
+#define SM_PRIORITY_LANE_SIZE            16
+
+// SmEnqueueEventPriority priorities, 0 is the active event queue
+#define SM_PRIORITY_NORMAL               0
+#define SM_PRIORITY_HIGHEST              XRP_SM_PRIORITY_LANES
+
+// instance and queue storage from SmInitEx is aligned to this
+#define SM_CACHE_LINE_SIZE               64
+
+
 //-------------------------------------------------------------------------------
 // Prototypes
 //-------------------------------------------------------------------------------
@@ -196,10 +601,35 @@ typedef struct _SMInstance
 extern "C" {
 #endif
 void SmInit( tSmInstance *pSM, tStateInfo *pInitialStateInfo );
-void SmEnqueueEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData );
+size_t SmInstanceSize( tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags );
+tSmInstance *SmInitEx( tStateInfo *pInitialStateInfo, char *pInstanceName, tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags, tSmArena *pArena );
+void SmFreeInstance( tSmInstance *pSM );
+eSmEnqueueStatus SmEnqueueEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData );
+eSmEnqueueStatus SmEnqueueEventPayload( tSmInstance *pSM, tStEventID evtID, tStEventData evtData, const void *pPayload, UInt16 payloadSize );
+eSmEnqueueStatus SmEnqueueEventPriority( tSmInstance *pSM, tStEventID evtID, tStEventData evtData, UInt8 priority );
+eSmEnqueueStatus SmEnqueueSelfEvent( tSmInstance *pSM, tStEventID evtID, tStEventData evtData );
+tSmQIndex SmEnqueueEvents( tSmInstance *pSM, const tStateEvent *pEvents, tSmQIndex eventCount, BOOL bAllOrNothing );
 BOOL SmInThisState( tSmInstance *pSM, tStateInfo *pInitialStateInfo );
 void SmSetThisState( tSmInstance *pSM, tStateInfo *pInitialStateInfo );
 void SmProcessEvents( tSmInstance *pSM );
+BOOL SmProcessEventsBudget( tSmInstance *pSM, UInt32 maxEvents, UInt32 maxMicros );
+void SmSetLogMask( tSmInstance *pSM, UInt8 logMask );
+void SmSetBatchDrain( tSmInstance *pSM, BOOL bBatchDrain );
+BOOL SmCompileStateTable( tStateInfo *pInitialStateInfo );
+void SmFreeStateTable( tStateInfo *pInitialStateInfo );
+BOOL SmSetQueuePow2( tSmInstance *pSM );
+BOOL SmSetMultiProducer( tSmInstance *pSM, tSmQIndex *pSeqStorage );
+BOOL SmSetPriorityLane( tSmInstance *pSM, UInt8 priority, tStateEvent *pQData, tSmQIndex qSize, tSmQIndex *pSeqStorage );
+void SmSetCoalesceEvents( tSmInstance *pSM, const tStEventID *pEvtIDs, UInt8 evtIDCount );
+void SmGuardContextChanged( tSmInstance *pSM );
+BOOL SmGetStats( tSmInstance *pSM, tSmStats *pStats );
+void SmResetStats( tSmInstance *pSM );
+const tSmStateStats *SmGetStateStats( const tSmStats *pStats, const tStateInfo *pStateInfo );
+void SmSetNotify( tSmInstance *pSM, tSmNotify pNotify, void *pContext );
+void SmNotifyFd( tSmInstance *pSM, void *pContext );
+tSmPackedTable *SmPackStateTable( tStateInfo *pInitialStateInfo );
+void SmFreePackedTable( tSmPackedTable *pPacked );
+BOOL SmSetPackedTable( tSmInstance *pSM, const tSmPackedTable *pPacked );
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,872 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+   File: xrpSMScheduler.c
+   Descripton:
+   This file contains the multi instance scheduler, see xrpSMScheduler.h.
+   Every instance has a scheduling flag word, mSchedFlags:
+    SM_SCHED_QUEUED, the instance is on a ready list or being run.  Only the
+    thread that sets it puts the instance on a ready list, so an instance is
+    on at most one list and run by at most one worker.
+    SM_SCHED_PENDING, events were enqueued while the instance was queued.
+    The worker that runs the instance checks it before clearing
+    SM_SCHED_QUEUED, so no wakeup is lost.
+   A ready list can hold every instance, so pushing never fails.
+   An instance keeps its home worker, so its queues and state tables stay
+   in the caches of one core.  An idle worker only takes an instance from
+   a worker that has SM_SCHED_STEAL_MIN of them waiting, and the instance
+   then moves home to the thief instead of going back and forth.
+   */
+
+// pthread_attr_setaffinity_np and pthread_setaffinity_np
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include "xrpSMScheduler.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+// tSmInstance.mSchedFlags
+#define SM_SCHED_QUEUED                  0x01
+#define SM_SCHED_PENDING                 0x02
+    // taken off a ready list by a worker, cleared when it goes back on one
+    // or is dropped
+#define SM_SCHED_RUNNING                 0x04
+    // SmSchedulerRemove waits on mDropped for the worker to let it go
+#define SM_SCHED_REMOVING                0x08
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+// one worker thread and its ready list, a ring of instances
+typedef struct _SmSchedWorker
+{
+    tSmScheduler    *mpSched;
+    pthread_t       mThread;
+    BOOL            bStarted;
+    pthread_mutex_t mLock;
+    tSmInstance     **mpReady;
+    UInt32          mHead;
+    UInt32          mCount;
+        // AFFINITY, the core the worker is pinned to or -1, and the number
+        // of instances that have this worker as their home
+    int             mCpu;
+    UInt32          mHomeCount;
+} tSmSchedWorker;
+
+struct _SmScheduler
+{
+    pthread_mutex_t mLock;
+    pthread_cond_t  mWake;
+        // signalled with mLock when a worker drops or re-queues an instance
+        // that has SM_SCHED_REMOVING
+    pthread_cond_t  mDropped;
+        // workers waiting on mWake
+    UInt32          mSleepers;
+        // instances on all of the ready lists
+    UInt32          mReadyCount;
+    BOOL            bStop;
+    UInt8           mWorkerCount;
+    tSmSchedWorker  *mpWorkers;
+        // INSTANCES, protected by mLock
+    UInt32          mMaxInstances;
+    UInt32          mInstanceCount;
+    tSmInstance     **mpInstances;
+    UInt32          mNextHome;
+};
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+void _SmSchedulerReady( tSmInstance *pSM );
+void _SmSchedPush( tSmScheduler *pSched, tSmInstance *pSM );
+void _SmSchedRun( tSmScheduler *pSched, tSmInstance *pSM );
+void _SmSchedDrop( tSmScheduler *pSched, tSmInstance *pSM );
+void _SmSchedRemoved( tSmScheduler *pSched );
+BOOL _SmSchedUnlink( tSmSchedWorker *pWorker, tSmInstance *pSM );
+tSmInstance *_SmSchedTake( tSmSchedWorker *pWorker, BOOL bSteal );
+void _SmSchedMigrate( tSmScheduler *pSched, tSmInstance *pSM, UInt8 worker );
+BOOL _SmSchedHasWork( tSmScheduler *pSched, UInt8 self );
+void *_SmSchedWorker( void *pParam );
+
+/*********************************************************************
+ *
+ * Put a ready instance on its home worker's ready list and wake a
+ * sleeping worker.  An instance a worker was running is no longer
+ * SM_SCHED_RUNNING once it is on the list.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance that just got SM_SCHED_QUEUED
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedPush( tSmScheduler *pSched, tSmInstance *pSM )
+{
+    tSmSchedWorker *pWorker = &pSched->mpWorkers[ __atomic_load_n( &pSM->mSchedHome, __ATOMIC_RELAXED ) ];
+
+    pthread_mutex_lock( &pWorker->mLock );
+    pWorker->mpReady[ ( pWorker->mHead + pWorker->mCount ) % pSched->mMaxInstances ] = pSM;
+    // read without the lock by _SmSchedHasWork
+    __atomic_store_n( &pWorker->mCount, pWorker->mCount + 1, __ATOMIC_SEQ_CST );
+    // on the list again, SmSchedulerRemove can unlink it
+    __atomic_fetch_and( &pSM->mSchedFlags, ( UInt8 ) ~SM_SCHED_RUNNING, __ATOMIC_SEQ_CST );
+    pthread_mutex_unlock( &pWorker->mLock );
+
+    if ( __atomic_load_n( &pSM->mSchedFlags, __ATOMIC_SEQ_CST ) & SM_SCHED_REMOVING )
+    {
+        _SmSchedRemoved( pSched );
+    }
+
+    // pairs with the sleeper count and _SmSchedHasWork in _SmSchedWorker.
+    // Everybody is woken, the one sleeper that may take the instance could
+    // be any of them.
+    __atomic_fetch_add( &pSched->mReadyCount, 1, __ATOMIC_SEQ_CST );
+    if ( 0 != __atomic_load_n( &pSched->mSleepers, __ATOMIC_SEQ_CST ) )
+    {
+        pthread_mutex_lock( &pSched->mLock );
+        pthread_cond_broadcast( &pSched->mWake );
+        pthread_mutex_unlock( &pSched->mLock );
+    }
+}
+
+/*********************************************************************
+ *
+ * Called by the engine after events were put on an instance that
+ * belongs to a scheduler.  Queues the instance unless it is queued
+ * already, then the worker running it is told to look again.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedulerReady( tSmInstance *pSM )
+{
+    tSmScheduler *pSched = __atomic_load_n( &pSM->mpScheduler, __ATOMIC_ACQUIRE );
+    UInt8 oldFlags;
+
+    if ( NULL == pSched )
+    {
+        return;
+    }
+
+    oldFlags = __atomic_fetch_or( &pSM->mSchedFlags, SM_SCHED_QUEUED | SM_SCHED_PENDING, __ATOMIC_ACQ_REL );
+    if ( 0 == ( oldFlags & SM_SCHED_QUEUED ) )
+    {
+        _SmSchedPush( pSched, pSM );
+    }
+}
+
+/*********************************************************************
+ *
+ * Take the next ready instance off a worker's ready list.  The owner
+ * takes the oldest one, a thief takes the newest one so the two ends
+ * are worked from.  A thief only gets one when SM_SCHED_STEAL_MIN are
+ * waiting, a short list is soon run by its owner.  The instance is
+ * SM_SCHED_RUNNING from here on.
+ *
+ * Parameters:
+ *  pWorker - the worker owning the list
+ *  bSteal - TRUE if called by another worker
+ *
+ * Returns:
+ *  the instance, NULL if the list is empty
+ *
+ *********************************************************************/
+tSmInstance *_SmSchedTake( tSmSchedWorker *pWorker, BOOL bSteal )
+{
+    tSmScheduler *pSched = pWorker->mpSched;
+    tSmInstance *pSM = NULL;
+
+    pthread_mutex_lock( &pWorker->mLock );
+    if ( ( 0 != pWorker->mCount ) && ( ( FALSE == bSteal ) || ( pWorker->mCount >= SM_SCHED_STEAL_MIN ) ) )
+    {
+        if ( TRUE == bSteal )
+        {
+            pSM = pWorker->mpReady[ ( pWorker->mHead + pWorker->mCount - 1 ) % pSched->mMaxInstances ];
+        }
+        else
+        {
+            pSM = pWorker->mpReady[ pWorker->mHead ];
+            pWorker->mHead = ( pWorker->mHead + 1 ) % pSched->mMaxInstances;
+        }
+        __atomic_store_n( &pWorker->mCount, pWorker->mCount - 1, __ATOMIC_SEQ_CST );
+        // off the list, SmSchedulerRemove has to wait for the worker now
+        __atomic_fetch_or( &pSM->mSchedFlags, SM_SCHED_RUNNING, __ATOMIC_SEQ_CST );
+    }
+    pthread_mutex_unlock( &pWorker->mLock );
+
+    if ( NULL != pSM )
+    {
+        __atomic_fetch_sub( &pSched->mReadyCount, 1, __ATOMIC_SEQ_CST );
+    }
+
+    return pSM;
+}
+
+/*********************************************************************
+ *
+ * Move the home of an instance to another worker.  Only the worker
+ * that runs the instance calls this, while SM_SCHED_QUEUED keeps
+ * everybody else from pushing it.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - the stolen instance
+ *  worker - its new home
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedMigrate( tSmScheduler *pSched, tSmInstance *pSM, UInt8 worker )
+{
+    UInt8 oldHome = __atomic_load_n( &pSM->mSchedHome, __ATOMIC_RELAXED );
+
+    __atomic_fetch_sub( &pSched->mpWorkers[ oldHome ].mHomeCount, 1, __ATOMIC_RELAXED );
+    __atomic_fetch_add( &pSched->mpWorkers[ worker ].mHomeCount, 1, __ATOMIC_RELAXED );
+    __atomic_store_n( &pSM->mSchedHome, worker, __ATOMIC_RELAXED );
+}
+
+/*********************************************************************
+ *
+ * Check if a worker would get an instance from _SmSchedTake, its own
+ * one or one it may steal.  A worker only sleeps when it would not,
+ * the instances that are waiting for their busy home worker don't keep
+ * the others spinning.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  self - index of the asking worker
+ *
+ * Returns:
+ *  TRUE, if there is an instance the worker may take
+ *
+ *********************************************************************/
+BOOL _SmSchedHasWork( tSmScheduler *pSched, UInt8 self )
+{
+    UInt8 idx;
+
+    if ( 0 == __atomic_load_n( &pSched->mReadyCount, __ATOMIC_SEQ_CST ) )
+    {
+        return FALSE;
+    }
+
+    for ( idx = 0 ; idx < pSched->mWorkerCount ; ++idx )
+    {
+        if ( __atomic_load_n( &pSched->mpWorkers[ idx ].mCount, __ATOMIC_SEQ_CST ) >= ( ( idx == self ) ? 1 : SM_SCHED_STEAL_MIN ) )
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * Run one queued instance for a batch of events.  If events are left
+ * the instance goes to the back of the ready list, otherwise it is
+ * un-queued unless new events arrived while it ran.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance taken off a ready list
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedRun( tSmScheduler *pSched, tSmInstance *pSM )
+{
+    UInt8 flags;
+
+    for ( ;; )
+    {
+        __atomic_fetch_and( &pSM->mSchedFlags, ( UInt8 ) ~SM_SCHED_PENDING, __ATOMIC_ACQ_REL );
+
+        if ( NULL == __atomic_load_n( &pSM->mpScheduler, __ATOMIC_ACQUIRE ) )
+        {   // being removed, don't touch it again
+            _SmSchedDrop( pSched, pSM );
+            return;
+        }
+
+        if ( TRUE == SmProcessEventsBudget( pSM, SM_SCHED_BATCH_EVENTS, 0 ) )
+        {   // let the other ready instances run first
+            _SmSchedPush( pSched, pSM );
+            return;
+        }
+
+        flags = __atomic_load_n( &pSM->mSchedFlags, __ATOMIC_ACQUIRE );
+        while ( ( 0 == ( flags & SM_SCHED_PENDING ) ) &&
+                ( FALSE == __atomic_compare_exchange_n( &pSM->mSchedFlags, &flags, 0, FALSE, __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE ) ) )
+        {
+        }
+        if ( 0 == ( flags & SM_SCHED_PENDING ) )
+        {
+            if ( flags & SM_SCHED_REMOVING )
+            {
+                _SmSchedRemoved( pSched );
+            }
+            return;
+        }
+        // SM_SCHED_PENDING was set while running, go again
+    }
+}
+
+/*********************************************************************
+ *
+ * Let go of an instance that is being removed, the worker does not
+ * touch it again.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance the worker was running
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedDrop( tSmScheduler *pSched, tSmInstance *pSM )
+{
+    if ( __atomic_exchange_n( &pSM->mSchedFlags, 0, __ATOMIC_SEQ_CST ) & SM_SCHED_REMOVING )
+    {
+        _SmSchedRemoved( pSched );
+    }
+}
+
+/*********************************************************************
+ *
+ * Wake SmSchedulerRemove, an instance it waits for was dropped or is
+ * back on a ready list.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmSchedRemoved( tSmScheduler *pSched )
+{
+    pthread_mutex_lock( &pSched->mLock );
+    pthread_cond_broadcast( &pSched->mDropped );
+    pthread_mutex_unlock( &pSched->mLock );
+}
+
+/*********************************************************************
+ *
+ * Take a queued instance out of the middle of a worker's ready list,
+ * the entries behind it move up.
+ *
+ * Parameters:
+ *  pWorker - the worker the instance has as its home
+ *  pSM - the instance
+ *
+ * Returns:
+ *  TRUE, if it was on the list, it is no longer SM_SCHED_QUEUED
+ *  FALSE, it is not, a worker is running it or a producer is about to
+ *         push it
+ *
+ *********************************************************************/
+BOOL _SmSchedUnlink( tSmSchedWorker *pWorker, tSmInstance *pSM )
+{
+    tSmScheduler *pSched = pWorker->mpSched;
+    BOOL bFound = FALSE;
+    UInt32 idx;
+
+    pthread_mutex_lock( &pWorker->mLock );
+    for ( idx = 0 ; idx < pWorker->mCount ; ++idx )
+    {
+        if ( pWorker->mpReady[ ( pWorker->mHead + idx ) % pSched->mMaxInstances ] == pSM )
+        {
+            bFound = TRUE;
+            break;
+        }
+    }
+    if ( TRUE == bFound )
+    {
+        for ( ++idx ; idx < pWorker->mCount ; ++idx )
+        {
+            pWorker->mpReady[ ( pWorker->mHead + idx - 1 ) % pSched->mMaxInstances ] = pWorker->mpReady[ ( pWorker->mHead + idx ) % pSched->mMaxInstances ];
+        }
+        __atomic_store_n( &pWorker->mCount, pWorker->mCount - 1, __ATOMIC_SEQ_CST );
+        __atomic_store_n( &pSM->mSchedFlags, 0, __ATOMIC_SEQ_CST );
+    }
+    pthread_mutex_unlock( &pWorker->mLock );
+
+    if ( TRUE == bFound )
+    {
+        __atomic_fetch_sub( &pSched->mReadyCount, 1, __ATOMIC_SEQ_CST );
+    }
+
+    return bFound;
+}
+
+/*********************************************************************
+ *
+ * Worker thread.  Run the instances on our own ready list, then steal
+ * from the other workers, then sleep until an instance is ready.  A
+ * stolen instance stays with us.
+ *
+ * Parameters:
+ *  pParam - the worker
+ *
+ * Returns:
+ *  NULL
+ *
+ *********************************************************************/
+void *_SmSchedWorker( void *pParam )
+{
+    tSmSchedWorker *pWorker = ( tSmSchedWorker * ) pParam;
+    tSmScheduler *pSched = pWorker->mpSched;
+    tSmInstance *pSM;
+    UInt8 self = ( UInt8 ) ( pWorker - pSched->mpWorkers );
+    UInt8 idx, victim;
+
+    for ( ;; )
+    {
+        pSM = _SmSchedTake( pWorker, FALSE );
+
+        for ( idx = 1 ; ( NULL == pSM ) && ( idx < pSched->mWorkerCount ) ; ++idx )
+        {
+            victim = ( UInt8 ) ( ( self + idx ) % pSched->mWorkerCount );
+            pSM = _SmSchedTake( &pSched->mpWorkers[ victim ], TRUE );
+            if ( NULL != pSM )
+            {   // the victim has more than it can run, move the instance over
+                _SmSchedMigrate( pSched, pSM, self );
+            }
+        }
+
+        if ( NULL != pSM )
+        {
+            _SmSchedRun( pSched, pSM );
+            continue;
+        }
+
+        pthread_mutex_lock( &pSched->mLock );
+        __atomic_fetch_add( &pSched->mSleepers, 1, __ATOMIC_SEQ_CST );
+        if ( ( FALSE == pSched->bStop ) && ( FALSE == _SmSchedHasWork( pSched, self ) ) )
+        {
+            pthread_cond_wait( &pSched->mWake, &pSched->mLock );
+        }
+        __atomic_fetch_sub( &pSched->mSleepers, 1, __ATOMIC_SEQ_CST );
+        if ( TRUE == pSched->bStop )
+        {
+            pthread_mutex_unlock( &pSched->mLock );
+            break;
+        }
+        pthread_mutex_unlock( &pSched->mLock );
+    }
+
+    return NULL;
+}
+
+/*********************************************************************
+ *
+ * Create a scheduler and start its workers.
+ *
+ * Parameters:
+ *  workerCount - number of worker threads, usually the number of cores
+ *  maxInstances - most instances that will be added at one time
+ *
+ * Returns:
+ *  the scheduler, NULL if out of memory or a thread could not start
+ *
+ *********************************************************************/
+tSmScheduler *SmSchedulerCreate( UInt8 workerCount, UInt32 maxInstances )
+{
+    return SmSchedulerCreateEx( workerCount, maxInstances, NULL );
+}
+
+/*********************************************************************
+ *
+ * Create a scheduler with every worker pinned to a core, so the home
+ * worker of an instance always runs on the same core.
+ *
+ * Parameters:
+ *  workerCount - number of worker threads
+ *  maxInstances - most instances that will be added at one time
+ *  pCpus - workerCount core numbers, -1 for a worker that is not
+ *          pinned, or NULL for none
+ *
+ * Returns:
+ *  the scheduler, NULL if out of memory, a core does not exist or a
+ *  thread could not start
+ *
+ *********************************************************************/
+tSmScheduler *SmSchedulerCreateEx( UInt8 workerCount, UInt32 maxInstances, const int *pCpus )
+{
+    tSmScheduler *pSched;
+    pthread_attr_t attr;
+    cpu_set_t cpus;
+    int result;
+    UInt8 idx;
+
+    if ( ( 0 == workerCount ) || ( workerCount >= SM_SCHED_ANY_WORKER ) || ( 0 == maxInstances ) )
+    {
+        XLOGD_ERROR( "Scheduler: needs workers and instances, w: %d, i: %u", workerCount, maxInstances );
+        return NULL;
+    }
+
+    pSched = ( tSmScheduler * ) calloc( 1, sizeof( tSmScheduler ) );
+    if ( NULL == pSched )
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init( &pSched->mLock, NULL );
+    pthread_cond_init( &pSched->mWake, NULL );
+    pthread_cond_init( &pSched->mDropped, NULL );
+    pSched->mWorkerCount = workerCount;
+    pSched->mMaxInstances = maxInstances;
+    pSched->mpInstances = ( tSmInstance ** ) calloc( maxInstances, sizeof( tSmInstance * ) );
+    pSched->mpWorkers = ( tSmSchedWorker * ) calloc( workerCount, sizeof( tSmSchedWorker ) );
+    if ( ( NULL == pSched->mpInstances ) || ( NULL == pSched->mpWorkers ) )
+    {
+        SmSchedulerDestroy( pSched );
+        return NULL;
+    }
+
+    for ( idx = 0 ; idx < workerCount ; ++idx )
+    {
+        pSched->mpWorkers[ idx ].mpSched = pSched;
+        pSched->mpWorkers[ idx ].mCpu = ( NULL != pCpus ) ? pCpus[ idx ] : -1;
+        pthread_mutex_init( &pSched->mpWorkers[ idx ].mLock, NULL );
+        pSched->mpWorkers[ idx ].mpReady = ( tSmInstance ** ) calloc( maxInstances, sizeof( tSmInstance * ) );
+        if ( NULL == pSched->mpWorkers[ idx ].mpReady )
+        {
+            SmSchedulerDestroy( pSched );
+            return NULL;
+        }
+    }
+
+    for ( idx = 0 ; idx < workerCount ; ++idx )
+    {
+        pthread_attr_init( &attr );
+        result = 0;
+        if ( pSched->mpWorkers[ idx ].mCpu >= 0 )
+        {   // the worker starts on its core, everything it touches is local
+            CPU_ZERO( &cpus );
+            CPU_SET( pSched->mpWorkers[ idx ].mCpu, &cpus );
+            result = pthread_attr_setaffinity_np( &attr, sizeof( cpus ), &cpus );
+        }
+        if ( 0 == result )
+        {
+            result = pthread_create( &pSched->mpWorkers[ idx ].mThread, &attr, _SmSchedWorker, &pSched->mpWorkers[ idx ] );
+        }
+        pthread_attr_destroy( &attr );
+
+        if ( 0 != result )
+        {
+            XLOGD_ERROR( "Scheduler: worker %d did not start, cpu: %d, err: %d", idx, pSched->mpWorkers[ idx ].mCpu, result );
+            SmSchedulerDestroy( pSched );
+            return NULL;
+        }
+        pSched->mpWorkers[ idx ].bStarted = TRUE;
+    }
+
+    XLOGD_INFO( "Scheduler: %d workers, %u instances, pinned: %s", workerCount, maxInstances, ( NULL != pCpus ) ? "yes" : "no" );
+
+    return pSched;
+}
+
+/*********************************************************************
+ *
+ * Hand an instance to the scheduler.  From now on the workers run it,
+ * the client must not call SmProcessEvents on it.  Events that are
+ * already on the queue are run right away.  The instance gets the
+ * worker with the fewest instances as its home.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance set up with SmInit/SmInitEx and SmSetMultiProducer
+ *
+ * Returns:
+ *  TRUE, if the instance was added
+ *  FALSE, the scheduler is full or the instance is not multi producer
+ *
+ *********************************************************************/
+BOOL SmSchedulerAdd( tSmScheduler *pSched, tSmInstance *pSM )
+{
+    return SmSchedulerAddTo( pSched, pSM, SM_SCHED_ANY_WORKER );
+}
+
+/*********************************************************************
+ *
+ * Same as SmSchedulerAdd, with the home worker chosen by the client,
+ * e.g. the one the instance was allocated for with SmSchedulerInitEx.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance set up with SmInit/SmInitEx and SmSetMultiProducer
+ *  worker - the home worker, or SM_SCHED_ANY_WORKER
+ *
+ * Returns:
+ *  TRUE, if the instance was added
+ *  FALSE, the scheduler is full, the worker does not exist or the
+ *         instance is not multi producer
+ *
+ *********************************************************************/
+BOOL SmSchedulerAddTo( tSmScheduler *pSched, tSmInstance *pSM, UInt8 worker )
+{
+    UInt32 homeCount, leastCount = 0xFFFFFFFF;
+    UInt8 lane, idx, candidate;
+
+    if ( ( SM_SCHED_ANY_WORKER != worker ) && ( worker >= pSched->mWorkerCount ) )
+    {
+        XLOGD_ERROR( "%s Scheduler: no worker %d" INST_NAME, worker );
+        return FALSE;
+    }
+
+    if ( NULL == pSM->activeEvtQueue.mpQSeq )
+    {   // producers and workers would race on a single producer queue
+        XLOGD_ERROR( "%s Scheduler: instance is not multi producer" INST_NAME );
+        return FALSE;
+    }
+
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        if ( ( NULL != pSM->mPriorityEvtQueue[ lane ].mpQData ) && ( NULL == pSM->mPriorityEvtQueue[ lane ].mpQSeq ) )
+        {
+            XLOGD_ERROR( "%s Scheduler: priority lane %d is not multi producer" INST_NAME, lane + 1 );
+            return FALSE;
+        }
+    }
+
+    pthread_mutex_lock( &pSched->mLock );
+    if ( pSched->mInstanceCount == pSched->mMaxInstances )
+    {
+        pthread_mutex_unlock( &pSched->mLock );
+        XLOGD_ERROR( "%s Scheduler: full, %u instances" INST_NAME, pSched->mMaxInstances );
+        return FALSE;
+    }
+
+    pSched->mpInstances[ pSched->mInstanceCount++ ] = pSM;
+
+    if ( SM_SCHED_ANY_WORKER == worker )
+    {   // spread the instances over the workers, the first one of a tie
+        // rotates so equal loads still fill the workers in turn
+        for ( idx = 0 ; idx < pSched->mWorkerCount ; ++idx )
+        {
+            candidate = ( UInt8 ) ( ( pSched->mNextHome + idx ) % pSched->mWorkerCount );
+            homeCount = __atomic_load_n( &pSched->mpWorkers[ candidate ].mHomeCount, __ATOMIC_RELAXED );
+            if ( homeCount < leastCount )
+            {
+                leastCount = homeCount;
+                worker = candidate;
+            }
+        }
+        ++pSched->mNextHome;
+    }
+
+    __atomic_fetch_add( &pSched->mpWorkers[ worker ].mHomeCount, 1, __ATOMIC_RELAXED );
+    pSM->mSchedHome = worker;
+    pSM->mSchedFlags = 0;
+    __atomic_store_n( &pSM->mpScheduler, pSched, __ATOMIC_RELEASE );
+    pthread_mutex_unlock( &pSched->mLock );
+
+    if ( pSM->logMask & SM_LOG_MASK_INFO )
+    {
+        XLOGD_INFO( "%s Scheduler: added, w: %d" INST_NAME, pSM->mSchedHome );
+    }
+
+    // pick up the events enqueued before we were added
+    _SmSchedulerReady( pSM );
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Take an instance back from the scheduler.  A queued instance is
+ * unlinked from its ready list, one a worker is running is waited for
+ * until the worker lets it go.  The producers of the instance must be
+ * stopped first.  Events still on the queue stay there for
+ * SmProcessEvents.  May be called from a worker, e.g. a state callback
+ * of another instance, but not from a callback of this instance, the
+ * worker would wait for itself.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  pSM - instance that was added with SmSchedulerAdd
+ *
+ * Returns:
+ *  TRUE, if the instance is no longer on the scheduler
+ *  FALSE, called from a callback of the instance, nothing was changed
+ *
+ *********************************************************************/
+BOOL SmSchedulerRemove( tSmScheduler *pSched, tSmInstance *pSM )
+{
+    BOOL bFound = FALSE;
+    UInt8 flags;
+    UInt32 idx;
+
+    if ( ( TRUE == pSM->bInEngine ) && ( 0 != pthread_equal( pSM->mEngineThread, pthread_self() ) ) )
+    {
+        XLOGD_ERROR( "%s Scheduler: remove from the instance's own callback" INST_NAME );
+        return FALSE;
+    }
+
+    pthread_mutex_lock( &pSched->mLock );
+    for ( idx = 0 ; idx < pSched->mInstanceCount ; ++idx )
+    {
+        if ( pSched->mpInstances[ idx ] == pSM )
+        {
+            pSched->mpInstances[ idx ] = pSched->mpInstances[ --pSched->mInstanceCount ];
+            bFound = TRUE;
+            break;
+        }
+    }
+
+    __atomic_store_n( &pSM->mpScheduler, NULL, __ATOMIC_SEQ_CST );
+    flags = __atomic_or_fetch( &pSM->mSchedFlags, SM_SCHED_REMOVING, __ATOMIC_SEQ_CST );
+
+    // the worker running it, or a push of it, signals mDropped
+    while ( flags & SM_SCHED_QUEUED )
+    {
+        if ( ( 0 == ( flags & SM_SCHED_RUNNING ) ) &&
+             ( TRUE == _SmSchedUnlink( &pSched->mpWorkers[ __atomic_load_n( &pSM->mSchedHome, __ATOMIC_RELAXED ) ], pSM ) ) )
+        {
+            break;
+        }
+        // running, or a producer is between queueing and pushing it
+        pthread_cond_wait( &pSched->mDropped, &pSched->mLock );
+        flags = __atomic_load_n( &pSM->mSchedFlags, __ATOMIC_SEQ_CST );
+    }
+    __atomic_store_n( &pSM->mSchedFlags, 0, __ATOMIC_SEQ_CST );
+    pthread_mutex_unlock( &pSched->mLock );
+
+    if ( TRUE == bFound )
+    {   // no worker moves it any more
+        __atomic_fetch_sub( &pSched->mpWorkers[ pSM->mSchedHome ].mHomeCount, 1, __ATOMIC_RELAXED );
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * SmInitEx for an instance that will have worker as its home.  When
+ * the worker is pinned, the calling thread moves to the worker's core
+ * while the instance and its queues are allocated and cleared, so the
+ * kernel places the pages on that core's memory node.  Add it with
+ * SmSchedulerAddTo( pSched, pSM, worker ).
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *  worker - the home worker
+ *  the rest - see SmInitEx, the instance always comes from the heap
+ *
+ * Returns:
+ *  the instance, see SmInitEx, NULL if the worker does not exist
+ *
+ *********************************************************************/
+tSmInstance *SmSchedulerInitEx( tSmScheduler *pSched, UInt8 worker, tStateInfo *pInitialStateInfo, char *pInstanceName,
+                                tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags )
+{
+    tSmInstance *pSM;
+    cpu_set_t saved, cpus;
+    BOOL bMoved = FALSE;
+
+    if ( worker >= pSched->mWorkerCount )
+    {
+        XLOGD_ERROR( "Scheduler: no worker %d", worker );
+        return NULL;
+    }
+
+    if ( ( pSched->mpWorkers[ worker ].mCpu >= 0 ) && ( 0 == pthread_getaffinity_np( pthread_self(), sizeof( saved ), &saved ) ) )
+    {
+        CPU_ZERO( &cpus );
+        CPU_SET( pSched->mpWorkers[ worker ].mCpu, &cpus );
+        bMoved = ( 0 == pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus ) ) ? TRUE : FALSE;
+    }
+
+    // SmInitEx clears the whole block, that first touch places the pages
+    pSM = SmInitEx( pInitialStateInfo, pInstanceName, activeQSize, deferredQSize, initFlags, NULL );
+
+    if ( TRUE == bMoved )
+    {
+        pthread_setaffinity_np( pthread_self(), sizeof( saved ), &saved );
+    }
+
+    return pSM;
+}
+
+/*********************************************************************
+ *
+ * Stop the workers and free the scheduler.  The instances that are
+ * still added are removed, the events on their queues stay there.
+ *
+ * Parameters:
+ *  pSched - the scheduler
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSchedulerDestroy( tSmScheduler *pSched )
+{
+    UInt32 idx;
+
+    pthread_mutex_lock( &pSched->mLock );
+    pSched->bStop = TRUE;
+    pthread_cond_broadcast( &pSched->mWake );
+    pthread_mutex_unlock( &pSched->mLock );
+
+    for ( idx = 0 ; ( NULL != pSched->mpWorkers ) && ( idx < pSched->mWorkerCount ) ; ++idx )
+    {
+        if ( TRUE == pSched->mpWorkers[ idx ].bStarted )
+        {
+            pthread_join( pSched->mpWorkers[ idx ].mThread, NULL );
+        }
+    }
+
+    // no worker is left to take the queued instances
+    for ( idx = 0 ; ( NULL != pSched->mpInstances ) && ( idx < pSched->mInstanceCount ) ; ++idx )
+    {
+        __atomic_store_n( &pSched->mpInstances[ idx ]->mpScheduler, NULL, __ATOMIC_RELEASE );
+        __atomic_store_n( &pSched->mpInstances[ idx ]->mSchedFlags, 0, __ATOMIC_RELEASE );
+    }
+
+    for ( idx = 0 ; ( NULL != pSched->mpWorkers ) && ( idx < pSched->mWorkerCount ) ; ++idx )
+    {
+        pthread_mutex_destroy( &pSched->mpWorkers[ idx ].mLock );
+        free( pSched->mpWorkers[ idx ].mpReady );
+    }
+
+    free( pSched->mpWorkers );
+    free( pSched->mpInstances );
+    pthread_cond_destroy( &pSched->mWake );
+    pthread_cond_destroy( &pSched->mDropped );
+    pthread_mutex_destroy( &pSched->mLock );
+    free( pSched );
+}
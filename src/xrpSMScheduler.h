@@ -0,0 +1,83 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMScheduler.h
+ Descripton:
+ A scheduler that runs many state machine instances on a small pool of
+ worker threads.  An instance added to the scheduler no longer needs
+ SmProcessEvents calls, a successful SmEnqueueEvent marks it ready and a
+ worker runs it.  One instance only ever runs on one worker at a time, so
+ the states of one instance are never called concurrently.  Each worker
+ has its own ready list, an instance goes to the list of its home worker
+ and workers that run out of ready instances take them from the others
+ when those have a backlog, the instance then stays with its new home.
+ SmSchedulerCreateEx pins the workers to cores and SmSchedulerInitEx
+ allocates an instance on the memory of its home worker's core.
+ Instances with no events cost nothing, the workers sleep when nothing
+ is ready.
+ Events can be enqueued from any thread, so the instances must be set
+ up for SmSetMultiProducer, e.g. SmInitEx with SM_INIT_MULTI_PRODUCER.
+ */
+
+#ifndef XRP_SMSCHEDULER_H_
+#define XRP_SMSCHEDULER_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Defines
+//-------------------------------------------------------------------------------
+
+// events a worker processes on an instance before it lets the next ready
+// instance run, so a busy instance can not starve the others
+#define SM_SCHED_BATCH_EVENTS            32
+
+// ready instances a worker must have waiting before an idle worker takes
+// one, below this the instances stay where their caches are
+#define SM_SCHED_STEAL_MIN               2
+
+// SmSchedulerAddTo worker that picks the worker with the fewest instances
+#define SM_SCHED_ANY_WORKER              0xFF
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmScheduler tSmScheduler;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+tSmScheduler *SmSchedulerCreate( UInt8 workerCount, UInt32 maxInstances );
+tSmScheduler *SmSchedulerCreateEx( UInt8 workerCount, UInt32 maxInstances, const int *pCpus );
+tSmInstance *SmSchedulerInitEx( tSmScheduler *pSched, UInt8 worker, tStateInfo *pInitialStateInfo, char *pInstanceName,
+                                tSmQIndex activeQSize, tSmQIndex deferredQSize, UInt8 initFlags );
+BOOL SmSchedulerAdd( tSmScheduler *pSched, tSmInstance *pSM );
+BOOL SmSchedulerAddTo( tSmScheduler *pSched, tSmInstance *pSM, UInt8 worker );
+BOOL SmSchedulerRemove( tSmScheduler *pSched, tSmInstance *pSM );
+void SmSchedulerDestroy( tSmScheduler *pSched );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
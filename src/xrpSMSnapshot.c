@@ -0,0 +1,542 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+
+   File: xrpSMSnapshot.c
+   Descripton:
+   This file contains the snapshot and restore of an instance, see
+   xrpSMSnapshot.h.  The queues are read in place, oldest event first,
+   and refilled through the same enqueue paths the engine uses, so the
+   deferred queue index is rebuilt as the events go back in.  A blob is
+   checked completely before the instance is touched.
+   */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrpSMSnapshot.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+#define SM_SNAPSHOT_ALIGN( size )        ( ( ( size ) + 7 ) & ~( ( size_t ) 7 ) )
+
+// one FNV-1a step of _SmSnapshotTableHash
+#define SM_SNAPSHOT_HASH( hash, v )      do { ( hash ) ^= ( UInt32 ) ( v ); ( hash ) *= 16777619u; } while ( 0 )
+
+// index of the deferred and the self queue in the per queue counts of
+// SmRestore
+#define SM_SNAPSHOT_COUNT_DEFERRED       ( XRP_SM_PRIORITY_LANES + 1 )
+#define SM_SNAPSHOT_COUNT_SELF           ( XRP_SM_PRIORITY_LANES + 2 )
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+BOOL _SmCollectStates( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, int *pStateCount );
+tSmQIndex _SmQCount( tSmQueueEvt *pEvQ );
+void _SmQReset( tSmQueueEvt *pEvQ );
+BOOL _SmQueuesSet( tSmInstance *pSM );
+tStateEvent *_SmQSlot( tSmQueueEvt *pEvQ, tSmQIndex n );
+eSmEnqueueStatus _SmEnqueueEvent( tSmQueueEvt *pEvQ, const tStateEvent *pEvent );
+void _SmEnqueueDeferredEvent( tSmInstance *pSM, const tStateEvent *pEvent );
+BOOL _SmActiveEmpty( tSmInstance *pSM );
+void _SmSchedulerReady( tSmInstance *pSM );
+void _SmNotify( tSmInstance *pSM );
+int _SmSnapshotStateIdx( tStateInfo **pStates, int stateCount, const tStateInfo *pStateInfo );
+UInt32 _SmSnapshotTableHash( tStateInfo **pStates, int stateCount );
+size_t _SmSnapshotQueue( tSmQueueEvt *pEvQ, UInt8 queue, UInt8 *pOut );
+UInt8 _SmSnapshotLane( tSmInstance *pSM, UInt8 queue );
+
+/*********************************************************************
+ *
+ * Index of a state in the breadth first list of _SmCollectStates.
+ *
+ * Parameters:
+ *  pStates - the list
+ *  stateCount - states in the list
+ *  pStateInfo - the state
+ *
+ * Returns:
+ *  the index, or -1 if the state is not in the list
+ *
+ *********************************************************************/
+int _SmSnapshotStateIdx( tStateInfo **pStates, int stateCount, const tStateInfo *pStateInfo )
+{
+    int idx;
+
+    // state machines are small, a linear search is fine here
+    for ( idx = 0 ; idx < stateCount ; ++idx )
+    {
+        if ( pStates[ idx ] == pStateInfo )
+        {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+/*********************************************************************
+ *
+ * FNV-1a hash of the table layout: per state the next state rows with
+ * their event ids and target indexes, the deferred event ids and the
+ * parent index.  Names and functions are left out, they may move
+ * between builds without changing what a state index means.
+ *
+ * Parameters:
+ *  pStates - the states in index order
+ *  stateCount - states in the list
+ *
+ * Returns:
+ *  the hash
+ *
+ *********************************************************************/
+UInt32 _SmSnapshotTableHash( tStateInfo **pStates, int stateCount )
+{
+    UInt32 hash = 2166136261u;
+    UInt32 values[ 2 ];
+    int stateIdx, idx, value;
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        SM_SNAPSHOT_HASH( hash, pStates[ stateIdx ]->mNextStCount );
+        for ( idx = 0 ; idx < pStates[ stateIdx ]->mNextStCount ; ++idx )
+        {
+            values[ 0 ] = pStates[ stateIdx ]->mpNextStates[ idx ].mID;
+            values[ 1 ] = ( UInt32 ) _SmSnapshotStateIdx( pStates, stateCount, ( tStateInfo * ) pStates[ stateIdx ]->mpNextStates[ idx ].mStInfo );
+            SM_SNAPSHOT_HASH( hash, values[ 0 ] );
+            SM_SNAPSHOT_HASH( hash, values[ 1 ] );
+        }
+
+        SM_SNAPSHOT_HASH( hash, pStates[ stateIdx ]->mDeferEvtIDCount );
+        for ( idx = 0 ; idx < pStates[ stateIdx ]->mDeferEvtIDCount ; ++idx )
+        {
+            SM_SNAPSHOT_HASH( hash, pStates[ stateIdx ]->mpDeferEvtIDs[ idx ] );
+        }
+
+        value = ( NULL != pStates[ stateIdx ]->mpParent ) ? _SmSnapshotStateIdx( pStates, stateCount, pStates[ stateIdx ]->mpParent ) : -1;
+        SM_SNAPSHOT_HASH( hash, value );
+    }
+
+    return hash;
+}
+
+/*********************************************************************
+ *
+ * Write the pending events of one queue, oldest first, or only count
+ * the bytes when pOut is NULL.
+ *
+ * Parameters:
+ *  pEvQ - the queue
+ *  queue - SM_SNAPSHOT_Q_xxx or the lane priority, for the records
+ *  pOut - where to write, or NULL
+ *
+ * Returns:
+ *  the number of bytes
+ *
+ *********************************************************************/
+size_t _SmSnapshotQueue( tSmQueueEvt *pEvQ, UInt8 queue, UInt8 *pOut )
+{
+    tSmSnapshotEvent out;
+    const tStateEvent *pEvent;
+    tSmQIndex count, idx;
+    size_t size = 0;
+
+    if ( NULL == pEvQ->mpQData )
+    {   // a lane that is not set up
+        return 0;
+    }
+
+    memset( &out, 0, sizeof( out ) );
+    count = _SmQCount( pEvQ );
+    for ( idx = 0 ; idx < count ; ++idx )
+    {
+        pEvent = _SmQSlot( pEvQ, idx );
+#if ( XRP_SM_EVENT_PAYLOAD )
+        out.mPayloadSize = pEvent->mPayloadSize;
+#endif
+        if ( NULL != pOut )
+        {
+            out.mData = ( uint64_t ) ( uintptr_t ) pEvent->mData;
+            out.mEvtID = pEvent->mID;
+            out.mQueue = queue;
+            memcpy( pOut + size, &out, sizeof( out ) );
+#if ( XRP_SM_EVENT_PAYLOAD )
+            memset( pOut + size + sizeof( out ), 0, SM_SNAPSHOT_ALIGN( out.mPayloadSize ) );
+            memcpy( pOut + size + sizeof( out ), pEvent->mPayload, out.mPayloadSize );
+#endif
+        }
+        size += sizeof( out ) + SM_SNAPSHOT_ALIGN( out.mPayloadSize );
+    }
+
+    return size;
+}
+
+/*********************************************************************
+ *
+ * Number of bytes SmSnapshot writes for the instance as it is now.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *
+ * Returns:
+ *  the size in bytes
+ *
+ *********************************************************************/
+size_t SmSnapshotSize( tSmInstance *pSM )
+{
+    size_t size = sizeof( tSmSnapshotHeader );
+    UInt8 lane;
+
+    size += _SmSnapshotQueue( &pSM->deferredEvtQueue, SM_SNAPSHOT_Q_DEFERRED, NULL );
+    size += _SmSnapshotQueue( &pSM->mSelfEvtQueue, SM_SNAPSHOT_Q_SELF, NULL );
+    size += _SmSnapshotQueue( &pSM->activeEvtQueue, SM_SNAPSHOT_Q_ACTIVE, NULL );
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        size += _SmSnapshotQueue( &pSM->mPriorityEvtQueue[ lane ], lane + 1, NULL );
+    }
+
+    return size;
+}
+
+/*********************************************************************
+ *
+ * Write the state and the pending events of an instance to a blob.
+ * Take it while the instance is not running and no producer enqueues,
+ * e.g. when the process is shutting down.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pInitialStateInfo - the start state of the machine, the states
+ *                      reachable from it are the ones that get an index
+ *  pBuffer - where to write the blob, 8 byte aligned
+ *  bufferSize - bytes at pBuffer, see SmSnapshotSize
+ *
+ * Returns:
+ *  the number of bytes written, 0 if the buffer is too small, the
+ *  instance is running or its state is not in the machine
+ *
+ *********************************************************************/
+size_t SmSnapshot( tSmInstance *pSM, tStateInfo *pInitialStateInfo, void *pBuffer, size_t bufferSize )
+{
+    UInt8 *pOut = ( UInt8 * ) pBuffer;
+    tSmSnapshotHeader header;
+    tStateInfo **pStates;
+    int stateCount, stateIdx;
+    size_t size = SmSnapshotSize( pSM );
+    UInt8 lane;
+
+    if ( ( FALSE == pSM->bInitFinished ) || ( TRUE == pSM->bInEngine ) )
+    {
+        XLOGD_ERROR( "%s Snapshot: instance not idle" INST_NAME );
+        return 0;
+    }
+
+    if ( ( bufferSize < size ) || ( size > 0xFFFFFFFF ) )
+    {
+        XLOGD_ERROR( "%s Snapshot: buffer too small, %zu < %zu" INST_NAME, bufferSize, size );
+        return 0;
+    }
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "%s Snapshot: out of memory" INST_NAME );
+        return 0;
+    }
+
+    stateIdx = _SmSnapshotStateIdx( pStates, stateCount, pSM->pCurrState );
+    if ( ( -1 == stateIdx ) || ( stateCount > 0xFFFF ) )
+    {
+        XLOGD_ERROR( "%s Snapshot: %s is not in the machine" INST_NAME ST_NAME );
+        free( pStates );
+        return 0;
+    }
+
+    memset( &header, 0, sizeof( header ) );
+    header.mMagic = SM_SNAPSHOT_MAGIC;
+    header.mVersion = SM_SNAPSHOT_VERSION;
+    header.mStateCount = ( UInt16 ) stateCount;
+    header.mTableHash = _SmSnapshotTableHash( pStates, stateCount );
+    header.mStateIdx = ( UInt16 ) stateIdx;
+    header.mEnginePhase = pSM->mEnginePhase;
+    header.mEngineFlags = ( ( TRUE == pSM->bActiveConsumed ) ? SM_SNAPSHOT_ACTIVE_CONSUMED : 0 ) |
+                          ( ( TRUE == pSM->bDeferredConsumed ) ? SM_SNAPSHOT_DEFERRED_CONSUMED : 0 );
+    header.mDeferredLeft = pSM->mDeferredLeft;
+    header.mDeferredDone = pSM->mDeferredDone;
+    header.mSize = ( UInt32 ) size;
+    free( pStates );
+
+    size = sizeof( header );
+    size += _SmSnapshotQueue( &pSM->deferredEvtQueue, SM_SNAPSHOT_Q_DEFERRED, pOut + size );
+    size += _SmSnapshotQueue( &pSM->mSelfEvtQueue, SM_SNAPSHOT_Q_SELF, pOut + size );
+    size += _SmSnapshotQueue( &pSM->activeEvtQueue, SM_SNAPSHOT_Q_ACTIVE, pOut + size );
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        size += _SmSnapshotQueue( &pSM->mPriorityEvtQueue[ lane ], lane + 1, pOut + size );
+    }
+
+    header.mEventCount = _SmQCount( &pSM->deferredEvtQueue ) + _SmQCount( &pSM->mSelfEvtQueue ) + _SmQCount( &pSM->activeEvtQueue );
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        header.mEventCount += ( NULL != pSM->mPriorityEvtQueue[ lane ].mpQData ) ? _SmQCount( &pSM->mPriorityEvtQueue[ lane ] ) : 0;
+    }
+    memcpy( pOut, &header, sizeof( header ) );
+
+    if ( pSM->logMask & SM_LOG_MASK_INFO )
+    {
+        XLOGD_INFO( "%s Snapshot: %s, %u events, %zu bytes" INST_NAME ST_NAME, header.mEventCount, size );
+    }
+
+    return size;
+}
+
+/*********************************************************************
+ *
+ * The queue an event of a blob goes back to, the same fallback as
+ * SmEnqueueEventPriority when the lane is not set up in this process.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  queue - tSmSnapshotEvent.mQueue, not SM_SNAPSHOT_Q_DEFERRED or
+ *          SM_SNAPSHOT_Q_SELF
+ *
+ * Returns:
+ *  the lane priority, or SM_SNAPSHOT_Q_ACTIVE
+ *
+ *********************************************************************/
+UInt8 _SmSnapshotLane( tSmInstance *pSM, UInt8 queue )
+{
+    for ( ; queue > SM_SNAPSHOT_Q_ACTIVE ; --queue )
+    {
+        if ( ( queue <= XRP_SM_PRIORITY_LANES ) && ( NULL != pSM->mPriorityEvtQueue[ queue - 1 ].mpQData ) )
+        {
+            break;
+        }
+    }
+
+    return queue;
+}
+
+/*********************************************************************
+ *
+ * Put an instance back into the state of a blob from SmSnapshot.  Call
+ * it after SmInit and the SmSetxxx calls of the instance, before any
+ * event is enqueued, the queues are emptied first.  No guard, enter or
+ * exit is called, the next SmProcessEvents carries on where the
+ * snapshot was taken.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pInitialStateInfo - the start state of the machine
+ *  pBuffer - the blob
+ *  bufferSize - bytes at pBuffer
+ *
+ * Returns:
+ *  TRUE, if the instance was restored
+ *  FALSE, the blob is damaged, was taken with other tables, or does not
+ *         fit the queues, the instance was not touched
+ *
+ *********************************************************************/
+BOOL SmRestore( tSmInstance *pSM, tStateInfo *pInitialStateInfo, const void *pBuffer, size_t bufferSize )
+{
+    const UInt8 *pIn = ( const UInt8 * ) pBuffer;
+    tSmSnapshotHeader header;
+    tSmSnapshotEvent in;
+    tStateEvent event;
+    tStateInfo **pStates;
+    tStateInfo *pStateInfo;
+    UInt32 counts[ SM_SNAPSHOT_COUNT_SELF + 1 ];
+    UInt32 evtIdx, countIdx;
+    UInt32 hash;
+    size_t pos;
+    int stateCount;
+    UInt8 lane;
+
+    if ( ( FALSE == pSM->bInitFinished ) || ( TRUE == pSM->bInEngine ) )
+    {
+        XLOGD_ERROR( "%s Restore: instance not idle" INST_NAME );
+        return FALSE;
+    }
+
+    if ( FALSE == _SmQueuesSet( pSM ) )
+    {
+        XLOGD_ERROR( "%s Restore: queue storage not set" INST_NAME );
+        return FALSE;
+    }
+
+    if ( bufferSize < sizeof( header ) )
+    {
+        XLOGD_ERROR( "%s Restore: blob too short" INST_NAME );
+        return FALSE;
+    }
+    memcpy( &header, pIn, sizeof( header ) );
+
+    if ( ( SM_SNAPSHOT_MAGIC != header.mMagic ) || ( SM_SNAPSHOT_VERSION != header.mVersion ) ||
+         ( header.mSize > bufferSize ) || ( header.mSize < sizeof( header ) ) || ( header.mEnginePhase > SM_PHASE_DEFERRED ) )
+    {
+        XLOGD_ERROR( "%s Restore: bad header, magic: 0x%08X, version: %u, size: %u" INST_NAME, header.mMagic, header.mVersion, header.mSize );
+        return FALSE;
+    }
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "%s Restore: out of memory" INST_NAME );
+        return FALSE;
+    }
+
+    hash = _SmSnapshotTableHash( pStates, stateCount );
+    pStateInfo = ( header.mStateIdx < stateCount ) ? pStates[ header.mStateIdx ] : NULL;
+    free( pStates );
+
+    if ( ( stateCount != header.mStateCount ) || ( hash != header.mTableHash ) || ( NULL == pStateInfo ) )
+    {
+        XLOGD_ERROR( "%s Restore: taken with other tables, states: %u, hash: 0x%08X" INST_NAME, header.mStateCount, header.mTableHash );
+        return FALSE;
+    }
+
+    // check every event before anything is changed
+    memset( counts, 0, sizeof( counts ) );
+    pos = sizeof( header );
+    for ( evtIdx = 0 ; evtIdx < header.mEventCount ; ++evtIdx )
+    {
+        if ( header.mSize - pos < sizeof( in ) )
+        {
+            break;
+        }
+        memcpy( &in, pIn + pos, sizeof( in ) );
+        pos += sizeof( in );
+
+        if ( ( in.mPayloadSize > XRP_SM_EVENT_PAYLOAD ) || ( header.mSize - pos < SM_SNAPSHOT_ALIGN( in.mPayloadSize ) ) )
+        {
+            break;
+        }
+        pos += SM_SNAPSHOT_ALIGN( in.mPayloadSize );
+
+        if ( SM_SNAPSHOT_Q_DEFERRED == in.mQueue )
+        {
+            countIdx = SM_SNAPSHOT_COUNT_DEFERRED;
+        }
+        else if ( SM_SNAPSHOT_Q_SELF == in.mQueue )
+        {
+            countIdx = SM_SNAPSHOT_COUNT_SELF;
+        }
+        else
+        {
+            countIdx = _SmSnapshotLane( pSM, in.mQueue );
+        }
+        ++counts[ countIdx ];
+    }
+
+    if ( ( evtIdx != header.mEventCount ) || ( pos != header.mSize ) )
+    {
+        XLOGD_ERROR( "%s Restore: bad event %u of %u" INST_NAME, evtIdx, header.mEventCount );
+        return FALSE;
+    }
+
+    if ( ( counts[ SM_SNAPSHOT_COUNT_DEFERRED ] < header.mDeferredLeft + header.mDeferredDone ) ||
+         ( counts[ SM_SNAPSHOT_COUNT_DEFERRED ] > pSM->deferredEvtQueue.mQSize ) ||
+         ( counts[ SM_SNAPSHOT_COUNT_SELF ] > pSM->mSelfEvtQueue.mQSize ) ||
+         ( counts[ SM_SNAPSHOT_Q_ACTIVE ] > pSM->activeEvtQueue.mQSize ) )
+    {
+        XLOGD_ERROR( "%s Restore: events do not fit, a: %u, d: %u, s: %u" INST_NAME, counts[ SM_SNAPSHOT_Q_ACTIVE ], counts[ SM_SNAPSHOT_COUNT_DEFERRED ], counts[ SM_SNAPSHOT_COUNT_SELF ] );
+        return FALSE;
+    }
+
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        if ( counts[ lane + 1 ] > pSM->mPriorityEvtQueue[ lane ].mQSize )
+        {
+            XLOGD_ERROR( "%s Restore: events do not fit, p: %u, c: %u" INST_NAME, lane + 1, counts[ lane + 1 ] );
+            return FALSE;
+        }
+    }
+
+    // start from empty queues, the index follows the deferred events back in
+    _SmQReset( &pSM->activeEvtQueue );
+    _SmQReset( &pSM->deferredEvtQueue );
+    for ( lane = 0 ; lane < XRP_SM_PRIORITY_LANES ; ++lane )
+    {
+        if ( NULL != pSM->mPriorityEvtQueue[ lane ].mpQData )
+        {
+            _SmQReset( &pSM->mPriorityEvtQueue[ lane ] );
+        }
+    }
+    _SmQReset( &pSM->mSelfEvtQueue );
+    pSM->mDeferPending = 0;
+    memset( pSM->mDeferPendingCount, 0, sizeof( pSM->mDeferPendingCount ) );
+
+    SmSetThisState( pSM, pStateInfo );
+
+    pos = sizeof( header );
+    for ( evtIdx = 0 ; evtIdx < header.mEventCount ; ++evtIdx )
+    {
+        memcpy( &in, pIn + pos, sizeof( in ) );
+        pos += sizeof( in );
+
+        event.mID = in.mEvtID;
+        event.mData = ( tStEventData ) ( uintptr_t ) in.mData;
+#if ( XRP_SM_EVENT_PAYLOAD )
+        event.mPayloadSize = in.mPayloadSize;
+        memcpy( event.mPayload, pIn + pos, in.mPayloadSize );
+#endif
+        pos += SM_SNAPSHOT_ALIGN( in.mPayloadSize );
+
+        if ( SM_SNAPSHOT_Q_DEFERRED == in.mQueue )
+        {
+            _SmEnqueueDeferredEvent( pSM, &event );
+            continue;
+        }
+
+        if ( SM_SNAPSHOT_Q_SELF == in.mQueue )
+        {
+            _SmEnqueueEvent( &pSM->mSelfEvtQueue, &event );
+            continue;
+        }
+
+        lane = _SmSnapshotLane( pSM, in.mQueue );
+        _SmEnqueueEvent( ( SM_SNAPSHOT_Q_ACTIVE == lane ) ? &pSM->activeEvtQueue : &pSM->mPriorityEvtQueue[ lane - 1 ], &event );
+    }
+
+    pSM->mEnginePhase = header.mEnginePhase;
+    pSM->bActiveConsumed = ( header.mEngineFlags & SM_SNAPSHOT_ACTIVE_CONSUMED ) ? TRUE : FALSE;
+    pSM->bDeferredConsumed = ( header.mEngineFlags & SM_SNAPSHOT_DEFERRED_CONSUMED ) ? TRUE : FALSE;
+    pSM->mDeferredLeft = ( tSmQIndex ) header.mDeferredLeft;
+    pSM->mDeferredDone = ( tSmQIndex ) header.mDeferredDone;
+
+    if ( pSM->logMask & SM_LOG_MASK_INFO )
+    {
+        XLOGD_INFO( "%s Restore: %s, %u events" INST_NAME ST_NAME, header.mEventCount );
+    }
+
+    if ( FALSE == _SmActiveEmpty( pSM ) )
+    {   // whoever runs the instance has work
+        if ( NULL != pSM->mpScheduler )
+        {
+            _SmSchedulerReady( pSM );
+        }
+        if ( NULL != pSM->mpNotify )
+        {
+            _SmNotify( pSM );
+        }
+    }
+
+    return TRUE;
+}
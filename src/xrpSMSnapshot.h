@@ -0,0 +1,111 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMSnapshot.h
+ Descripton:
+ Snapshot and restore of an instance, for a warm restart of the process
+ that runs it.  SmSnapshot writes the current state and every pending
+ event, with its payload, to a flat versioned blob that holds no
+ pointers, so it can be written to a file and mapped back in.
+ SmRestore puts a freshly initialised instance back into that state
+ without calling any guard, enter or exit, and refills its queues.
+ The state is saved as its index, breadth first from the initial state
+ as for the trace, together with a hash of the table layout, so a blob
+ taken with other tables is not restored.
+ The event data is saved as a number, a pointer in it only makes sense
+ if what it points to survives the restart.  State timers start over
+ with their full timeout.
+ Blob layout, in the byte order of the target, 8 byte aligned:
+   tSmSnapshotHeader
+   mEventCount times a tSmSnapshotEvent and mPayloadSize bytes of
+   payload, padded to 8 bytes
+ */
+
+#ifndef XRP_SMSNAPSHOT_H_
+#define XRP_SMSNAPSHOT_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Defines
+//-------------------------------------------------------------------------------
+
+// tSmSnapshotHeader.mMagic, "XSMS"
+#define SM_SNAPSHOT_MAGIC                0x534D5358
+#define SM_SNAPSHOT_VERSION              1
+
+// tSmSnapshotHeader.mEngineFlags
+#define SM_SNAPSHOT_ACTIVE_CONSUMED      0x01
+#define SM_SNAPSHOT_DEFERRED_CONSUMED    0x02
+
+// tSmSnapshotEvent.mQueue, priorities 1 up to SM_PRIORITY_HIGHEST are the
+// priority lanes
+#define SM_SNAPSHOT_Q_ACTIVE             0
+#define SM_SNAPSHOT_Q_SELF               0xFE
+#define SM_SNAPSHOT_Q_DEFERRED           0xFF
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmSnapshotHeader
+{
+    UInt32          mMagic;
+    UInt16          mVersion;
+    UInt16          mStateCount;
+        // layout of the state tables the blob was taken with
+    UInt32          mTableHash;
+        // index of the current state, breadth first from the initial state
+    UInt16          mStateIdx;
+        // ENGINE PROGRESS, tSmInstance.mEnginePhase and SM_SNAPSHOT_xxx
+    UInt8           mEnginePhase;
+    UInt8           mEngineFlags;
+    UInt32          mDeferredLeft;
+    UInt32          mDeferredDone;
+    UInt32          mEventCount;
+        // bytes of the whole blob
+    UInt32          mSize;
+} tSmSnapshotHeader;
+
+typedef struct _SmSnapshotEvent
+{
+    uint64_t        mData;
+    tStEventID      mEvtID;
+        // SM_SNAPSHOT_Q_xxx, or the priority of the lane
+    UInt8           mQueue;
+    UInt8           mReserved;
+    UInt16          mPayloadSize;
+    UInt16          mReserved2;
+} tSmSnapshotEvent;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+size_t SmSnapshotSize( tSmInstance *pSM );
+size_t SmSnapshot( tSmInstance *pSM, tStateInfo *pInitialStateInfo, void *pBuffer, size_t bufferSize );
+BOOL SmRestore( tSmInstance *pSM, tStateInfo *pInitialStateInfo, const void *pBuffer, size_t bufferSize );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,410 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+
+   File: xrpSMTableImage.c
+   Descripton:
+   This file contains the position independent table image, see
+   xrpSMTableImage.h.  The image is written from a packed table, so the
+   state numbers are the same as SmPackStateTable.  Binding checks every
+   offset and index of the image before any of it is used, a damaged
+   file is refused instead of being run.
+   */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrpSMTableImage.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+#define SM_IMAGE_ALIGN( size )           ( ( ( size ) + 3 ) & ~( ( size_t ) 3 ) )
+
+#if ( ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) ) || defined( RDK ) )
+#define SM_IMAGE_NAMES                   1
+#else
+#define SM_IMAGE_NAMES                   0
+#endif
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+BOOL _SmImageArray( const tSmTableImageHeader *pHeader, UInt32 offset, size_t size );
+BOOL _SmImageCheck( const UInt8 *pImage, size_t imageSize, const tSmTableImageHeader *pHeader );
+
+/*********************************************************************
+ *
+ * Write the image of every state that can be reached from the initial
+ * state.  Call it with a NULL buffer first to learn the size.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *  pBuffer - where to write the image, 4 byte aligned, or NULL
+ *  bufferSize - bytes at pBuffer
+ *
+ * Returns:
+ *  the size of the image, 0 if out of memory, the machine is too large
+ *  or the buffer is too small
+ *
+ *********************************************************************/
+size_t SmWriteTableImage( tStateInfo *pInitialStateInfo, void *pBuffer, size_t bufferSize )
+{
+    UInt8 *pOut = ( UInt8 * ) pBuffer;
+    tSmPackedTable *pPacked;
+    tSmTableImageHeader header;
+    tSmTableImageState state;
+    const tStateInfo *pStateInfo;
+    UInt32 deferCount = 0, namesSize = 0;
+    const char *pName;
+    size_t size;
+    UInt16 stateIdx;
+
+    pPacked = SmPackStateTable( pInitialStateInfo );
+    if ( NULL == pPacked )
+    {
+        return 0;
+    }
+
+    for ( stateIdx = 0 ; stateIdx < pPacked->mStateCount ; ++stateIdx )
+    {
+        deferCount += pPacked->mppStates[ stateIdx ]->mDeferEvtIDCount;
+#if ( SM_IMAGE_NAMES )
+        pName = ( NULL != pPacked->mppStates[ stateIdx ]->mStateName ) ? pPacked->mppStates[ stateIdx ]->mStateName : "";
+        namesSize += strlen( pName ) + 1;
+#else
+        namesSize += 1;
+#endif
+    }
+
+    if ( deferCount > 0xFFFF )
+    {
+        XLOGD_ERROR( "Image: %u deferred event ids do not fit", deferCount );
+        SmFreePackedTable( pPacked );
+        return 0;
+    }
+
+    memset( &header, 0, sizeof( header ) );
+    header.mMagic = SM_TABLE_IMAGE_MAGIC;
+    header.mVersion = SM_TABLE_IMAGE_VERSION;
+    header.mStateCount = pPacked->mStateCount;
+    header.mRowCount = pPacked->mRowCount;
+    header.mDeferCount = ( UInt16 ) deferCount;
+    size = SM_IMAGE_ALIGN( sizeof( header ) );
+    header.mStatesOffset = ( UInt32 ) size;
+    size += header.mStateCount * sizeof( tSmTableImageState );
+    header.mRowIDsOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + header.mRowCount * sizeof( tStEventID ) );
+    header.mRowNextOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + header.mRowCount * sizeof( UInt16 ) );
+    header.mRowStartOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + ( header.mStateCount + 1 ) * sizeof( UInt16 ) );
+    header.mParentsOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + header.mStateCount * sizeof( UInt16 ) );
+    header.mDeferIDsOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + deferCount * sizeof( tStEventID ) );
+    header.mNamesOffset = ( UInt32 ) size;
+    size = SM_IMAGE_ALIGN( size + namesSize );
+    header.mSize = ( UInt32 ) size;
+
+    if ( NULL == pOut )
+    {
+        SmFreePackedTable( pPacked );
+        return size;
+    }
+
+    if ( bufferSize < size )
+    {
+        XLOGD_ERROR( "Image: buffer too small, %zu < %zu", bufferSize, size );
+        SmFreePackedTable( pPacked );
+        return 0;
+    }
+
+    memset( pOut, 0, size );
+    memcpy( pOut, &header, sizeof( header ) );
+    memcpy( pOut + header.mRowIDsOffset, pPacked->mpRowIDs, header.mRowCount * sizeof( tStEventID ) );
+    memcpy( pOut + header.mRowNextOffset, pPacked->mpRowNext, header.mRowCount * sizeof( UInt16 ) );
+    memcpy( pOut + header.mRowStartOffset, pPacked->mpRowStart, ( header.mStateCount + 1 ) * sizeof( UInt16 ) );
+    memcpy( pOut + header.mParentsOffset, pPacked->mpParents, header.mStateCount * sizeof( UInt16 ) );
+
+    deferCount = 0;
+    namesSize = 0;
+    memset( &state, 0, sizeof( state ) );
+    for ( stateIdx = 0 ; stateIdx < pPacked->mStateCount ; ++stateIdx )
+    {
+        pStateInfo = pPacked->mppStates[ stateIdx ];
+        state.mTimeoutMs = pStateInfo->mTimeoutMs;
+        state.mTimeoutEvent = pStateInfo->mTimeoutEvent;
+        state.mFlags = pStateInfo->mFlags;
+        state.mDeferStart = ( UInt16 ) deferCount;
+        state.mDeferCount = pStateInfo->mDeferEvtIDCount;
+        state.mNameOffset = namesSize;
+        memcpy( pOut + header.mStatesOffset + stateIdx * sizeof( state ), &state, sizeof( state ) );
+
+        memcpy( pOut + header.mDeferIDsOffset + deferCount * sizeof( tStEventID ), pStateInfo->mpDeferEvtIDs, state.mDeferCount * sizeof( tStEventID ) );
+        deferCount += state.mDeferCount;
+#if ( SM_IMAGE_NAMES )
+        pName = ( NULL != pStateInfo->mStateName ) ? pStateInfo->mStateName : "";
+        memcpy( pOut + header.mNamesOffset + namesSize, pName, strlen( pName ) + 1 );
+        namesSize += strlen( pName ) + 1;
+#else
+        ( void ) pName;
+        namesSize += 1;
+#endif
+    }
+
+    SmFreePackedTable( pPacked );
+
+    return size;
+}
+
+/*********************************************************************
+ *
+ * Check that an array of the image lies inside it.
+ *
+ * Parameters:
+ *  pHeader - the image header
+ *  offset - where the array starts
+ *  size - bytes of the array
+ *
+ * Returns:
+ *  TRUE, if the array is inside the image and aligned
+ *  FALSE, if not
+ *
+ *********************************************************************/
+BOOL _SmImageArray( const tSmTableImageHeader *pHeader, UInt32 offset, size_t size )
+{
+    return ( ( offset >= sizeof( tSmTableImageHeader ) ) && ( 0 == ( offset & 3 ) ) && ( offset <= pHeader->mSize ) &&
+             ( size <= pHeader->mSize - offset ) ) ? TRUE : FALSE;
+}
+
+/*********************************************************************
+ *
+ * Check every offset and index of an image.
+ *
+ * Parameters:
+ *  pImage - the image
+ *  imageSize - bytes at pImage
+ *  pHeader - the image header
+ *
+ * Returns:
+ *  TRUE, if the engine can run from the image
+ *  FALSE, the image is damaged
+ *
+ *********************************************************************/
+BOOL _SmImageCheck( const UInt8 *pImage, size_t imageSize, const tSmTableImageHeader *pHeader )
+{
+    const tSmTableImageState *pStates;
+    const UInt16 *pRowNext, *pRowStart, *pParents;
+    UInt32 idx;
+
+    if ( ( SM_TABLE_IMAGE_MAGIC != pHeader->mMagic ) || ( SM_TABLE_IMAGE_VERSION != pHeader->mVersion ) ||
+         ( 0 == pHeader->mStateCount ) || ( pHeader->mStateCount >= SM_PACKED_NONE ) || ( pHeader->mSize > imageSize ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mStatesOffset, pHeader->mStateCount * sizeof( tSmTableImageState ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mRowIDsOffset, pHeader->mRowCount * sizeof( tStEventID ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mRowNextOffset, pHeader->mRowCount * sizeof( UInt16 ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mRowStartOffset, ( pHeader->mStateCount + 1 ) * sizeof( UInt16 ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mParentsOffset, pHeader->mStateCount * sizeof( UInt16 ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mDeferIDsOffset, pHeader->mDeferCount * sizeof( tStEventID ) ) ) ||
+         ( FALSE == _SmImageArray( pHeader, pHeader->mNamesOffset, 0 ) ) )
+    {
+        return FALSE;
+    }
+
+    pStates = ( const tSmTableImageState * ) ( pImage + pHeader->mStatesOffset );
+    pRowNext = ( const UInt16 * ) ( pImage + pHeader->mRowNextOffset );
+    pRowStart = ( const UInt16 * ) ( pImage + pHeader->mRowStartOffset );
+    pParents = ( const UInt16 * ) ( pImage + pHeader->mParentsOffset );
+
+    for ( idx = 0 ; idx < pHeader->mRowCount ; ++idx )
+    {
+        if ( pRowNext[ idx ] >= pHeader->mStateCount )
+        {
+            return FALSE;
+        }
+    }
+
+    if ( ( 0 != pRowStart[ 0 ] ) || ( pHeader->mRowCount != pRowStart[ pHeader->mStateCount ] ) )
+    {
+        return FALSE;
+    }
+
+    for ( idx = 0 ; idx < pHeader->mStateCount ; ++idx )
+    {
+        // a tStateInfo counts its rows and defers in a tStateCount
+        if ( ( pRowStart[ idx ] > pRowStart[ idx + 1 ] ) || ( pRowStart[ idx + 1 ] - pRowStart[ idx ] > SM_MAX_STATE_COUNT ) ||
+             ( ( SM_PACKED_NONE != pParents[ idx ] ) && ( pParents[ idx ] >= pHeader->mStateCount ) ) ||
+             ( pStates[ idx ].mDeferCount > SM_MAX_STATE_COUNT ) ||
+             ( ( UInt32 ) pStates[ idx ].mDeferStart + pStates[ idx ].mDeferCount > pHeader->mDeferCount ) ||
+             ( pStates[ idx ].mNameOffset >= pHeader->mSize - pHeader->mNamesOffset ) ||
+             ( NULL == memchr( pImage + pHeader->mNamesOffset + pStates[ idx ].mNameOffset, 0,
+                               pHeader->mSize - pHeader->mNamesOffset - pStates[ idx ].mNameOffset ) ) )
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Run a machine from an image, e.g. one mapped read only from a file.
+ * The image must stay mapped and unchanged while the table is used.
+ * Start the instances with SmInit( pSM, pPacked->mppStates[ 0 ] ) and
+ * SmSetPackedTable( pSM, pPacked ).  The entry points are given in
+ * state number order, see SmTableImageStateIndex.
+ *
+ * Parameters:
+ *  pImage - the image from SmWriteTableImage, 4 byte aligned
+ *  imageSize - bytes at pImage
+ *  pEntries - the state functions, one per state
+ *  entryCount - number of entries, the state count of the image
+ *
+ * Returns:
+ *  the table, free it with SmFreePackedTable
+ *  NULL, the image is damaged, the entry count is wrong or out of memory
+ *
+ *********************************************************************/
+tSmPackedTable *SmBindTableImage( const void *pImage, size_t imageSize, const tStateEntryPoint *pEntries, UInt16 entryCount )
+{
+    const UInt8 *pIn = ( const UInt8 * ) pImage;
+    const tSmTableImageHeader *pHeader = ( const tSmTableImageHeader * ) pImage;
+    const tSmTableImageState *pImgStates;
+    const tStEventID *pRowIDs, *pDeferIDs;
+    const UInt16 *pRowNext, *pRowStart, *pParents;
+    tSmPackedTable *pPacked;
+    tStateEntryPoint *pPackedEntries;
+    tStateInfo *pStateInfos;
+    tStateInfo **ppPackedStates;
+    tStateGuard *pGuards;
+    UInt8 *pBlock;
+    UInt16 stateIdx, stateCount, rowCount, row;
+
+    if ( ( imageSize < sizeof( tSmTableImageHeader ) ) || ( FALSE == _SmImageCheck( pIn, imageSize, pHeader ) ) )
+    {
+        XLOGD_ERROR( "Image: damaged image" );
+        return NULL;
+    }
+
+    stateCount = pHeader->mStateCount;
+    rowCount = pHeader->mRowCount;
+    if ( entryCount != stateCount )
+    {
+        XLOGD_ERROR( "Image: %u entry points for %u states", entryCount, stateCount );
+        return NULL;
+    }
+
+    pImgStates = ( const tSmTableImageState * ) ( pIn + pHeader->mStatesOffset );
+    pRowIDs = ( const tStEventID * ) ( pIn + pHeader->mRowIDsOffset );
+    pRowNext = ( const UInt16 * ) ( pIn + pHeader->mRowNextOffset );
+    pRowStart = ( const UInt16 * ) ( pIn + pHeader->mRowStartOffset );
+    pParents = ( const UInt16 * ) ( pIn + pHeader->mParentsOffset );
+    pDeferIDs = ( const tStEventID * ) ( pIn + pHeader->mDeferIDsOffset );
+
+    // only what holds a pointer is kept in the process, the pointers first
+    pBlock = ( UInt8 * ) malloc( sizeof( tSmPackedTable ) + ( stateCount * ( sizeof( tStateEntryPoint ) + sizeof( tStateInfo * ) + sizeof( tStateInfo ) ) ) +
+                                 ( rowCount * sizeof( tStateGuard ) ) );
+    if ( NULL == pBlock )
+    {
+        XLOGD_ERROR( "Image: out of memory" );
+        return NULL;
+    }
+    memset( pBlock, 0, sizeof( tSmPackedTable ) );
+
+    pPacked = ( tSmPackedTable * ) pBlock;
+    pPackedEntries = ( tStateEntryPoint * ) ( pPacked + 1 );
+    ppPackedStates = ( tStateInfo ** ) ( pPackedEntries + stateCount );
+    pStateInfos = ( tStateInfo * ) ( ppPackedStates + stateCount );
+    pGuards = ( tStateGuard * ) ( pStateInfos + stateCount );
+
+    for ( row = 0 ; row < rowCount ; ++row )
+    {
+        pGuards[ row ].mID = pRowIDs[ row ];
+        pGuards[ row ].mStInfo = &pStateInfos[ pRowNext[ row ] ];
+    }
+
+    memset( pStateInfos, 0, stateCount * sizeof( tStateInfo ) );
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        pPackedEntries[ stateIdx ] = pEntries[ stateIdx ];
+        ppPackedStates[ stateIdx ] = &pStateInfos[ stateIdx ];
+
+#if ( SM_IMAGE_NAMES )
+        // the engine never writes through it
+        pStateInfos[ stateIdx ].mStateName = ( char * ) ( pIn + pHeader->mNamesOffset + pImgStates[ stateIdx ].mNameOffset );
+#endif
+        pStateInfos[ stateIdx ].mEntry = pEntries[ stateIdx ];
+        pStateInfos[ stateIdx ].mNextStCount = ( tStateCount ) ( pRowStart[ stateIdx + 1 ] - pRowStart[ stateIdx ] );
+        pStateInfos[ stateIdx ].mpNextStates = &pGuards[ pRowStart[ stateIdx ] ];
+        pStateInfos[ stateIdx ].mDeferEvtIDCount = ( tStateCount ) pImgStates[ stateIdx ].mDeferCount;
+        pStateInfos[ stateIdx ].mpDeferEvtIDs = ( tStEventID * ) &pDeferIDs[ pImgStates[ stateIdx ].mDeferStart ];
+        pStateInfos[ stateIdx ].mpDispatch = NULL;
+        pStateInfos[ stateIdx ].mpParent = ( SM_PACKED_NONE == pParents[ stateIdx ] ) ? NULL : &pStateInfos[ pParents[ stateIdx ] ];
+        pStateInfos[ stateIdx ].mTimeoutMs = pImgStates[ stateIdx ].mTimeoutMs;
+        pStateInfos[ stateIdx ].mTimeoutEvent = pImgStates[ stateIdx ].mTimeoutEvent;
+        pStateInfos[ stateIdx ].mFlags = pImgStates[ stateIdx ].mFlags;
+    }
+
+    // the hot arrays are used in place, so every process shares them
+    pPacked->mStateCount = stateCount;
+    pPacked->mRowCount = rowCount;
+    pPacked->mpEntries = pPackedEntries;
+    pPacked->mpRowIDs = pRowIDs;
+    pPacked->mpRowNext = pRowNext;
+    pPacked->mpRowStart = pRowStart;
+    pPacked->mpParents = pParents;
+    pPacked->mppStates = ppPackedStates;
+
+    return pPacked;
+}
+
+/*********************************************************************
+ *
+ * Number of a state in an image, to put the entry points for
+ * SmBindTableImage in order.  Only works when the image was written
+ * with the state names compiled in.
+ *
+ * Parameters:
+ *  pImage - an image that SmBindTableImage accepts
+ *  pStateName - the name of the state
+ *
+ * Returns:
+ *  the state number, SM_PACKED_NONE if there is no state by that name
+ *
+ *********************************************************************/
+UInt16 SmTableImageStateIndex( const void *pImage, const char *pStateName )
+{
+    const UInt8 *pIn = ( const UInt8 * ) pImage;
+    const tSmTableImageHeader *pHeader = ( const tSmTableImageHeader * ) pImage;
+    const tSmTableImageState *pImgStates = ( const tSmTableImageState * ) ( pIn + pHeader->mStatesOffset );
+    UInt16 stateIdx;
+
+    for ( stateIdx = 0 ; stateIdx < pHeader->mStateCount ; ++stateIdx )
+    {
+        if ( 0 == strcmp( ( const char * ) ( pIn + pHeader->mNamesOffset + pImgStates[ stateIdx ].mNameOffset ), pStateName ) )
+        {
+            return stateIdx;
+        }
+    }
+
+    return SM_PACKED_NONE;
+}
@@ -0,0 +1,108 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMTableImage.h
+ Descripton:
+ Position independent state tables.  SmWriteTableImage turns the
+ tStateInfo tables of a machine into an image that holds indexes and
+ offsets only, no pointers, so it can live in a file that every process
+ maps read only, or in a const section, and needs no relocation.
+ SmBindTableImage gives a process a tSmPackedTable that runs straight
+ from the image: the row event ids, next states, row starts, parents,
+ defer lists and state names stay in the mapped pages and are shared,
+ only the entry points and a small tStateInfo per state are kept in
+ the process.  The states are numbered breadth first from the initial
+ state, as for SmPackStateTable, state 0 is the initial state.
+ Image layout, in the byte order of the target, every offset counted
+ from the start of the image:
+   tSmTableImageHeader
+   mStateCount tSmTableImageState
+   mRowCount tStEventID row event ids, mRowCount UInt16 next states
+   mStateCount + 1 UInt16 row starts, mStateCount UInt16 parents
+   mDeferCount tStEventID deferred event ids
+   mStateCount NUL terminated state names, empty when the names are not
+   compiled in
+ */
+
+#ifndef XRP_SMTABLEIMAGE_H_
+#define XRP_SMTABLEIMAGE_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Defines
+//-------------------------------------------------------------------------------
+
+// tSmTableImageHeader.mMagic, "XSMI"
+#define SM_TABLE_IMAGE_MAGIC             0x494D5358
+#define SM_TABLE_IMAGE_VERSION           1
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmTableImageHeader
+{
+    UInt32          mMagic;
+    UInt16          mVersion;
+    UInt16          mStateCount;
+    UInt16          mRowCount;
+    UInt16          mDeferCount;
+        // bytes of the whole image
+    UInt32          mSize;
+        // OFFSETS of the arrays, see the layout above
+    UInt32          mStatesOffset;
+    UInt32          mRowIDsOffset;
+    UInt32          mRowNextOffset;
+    UInt32          mRowStartOffset;
+    UInt32          mParentsOffset;
+    UInt32          mDeferIDsOffset;
+    UInt32          mNamesOffset;
+} tSmTableImageHeader;
+
+// the cold data of one state
+typedef struct _SmTableImageState
+{
+        // see tStateInfo
+    UInt32          mTimeoutMs;
+        // offset of the name from mNamesOffset
+    UInt32          mNameOffset;
+        // the defer list is mDeferCount ids from mDeferStart
+    UInt16          mDeferStart;
+    UInt16          mDeferCount;
+    tStEventID      mTimeoutEvent;
+    UInt8           mFlags;
+    UInt8           mReserved;
+} tSmTableImageState;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+size_t SmWriteTableImage( tStateInfo *pInitialStateInfo, void *pBuffer, size_t bufferSize );
+tSmPackedTable *SmBindTableImage( const void *pImage, size_t imageSize, const tStateEntryPoint *pEntries, UInt16 entryCount );
+UInt16 SmTableImageStateIndex( const void *pImage, const char *pStateName );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,670 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+   File: xrpSMTimer.c
+   Descripton:
+   This file contains the timing wheel behind the state timeouts, see
+   xrpSMTimer.h.  The wheel has SM_WHEEL_LEVELS levels of SM_WHEEL_SLOTS
+   slots.  A timer goes in the lowest level whose span covers the ticks
+   left until it expires, level 0 slots are one tick, level 1 slots are
+   SM_WHEEL_SLOTS ticks and so on.  Each time level 0 wraps around the
+   next slot of level 1 is cascaded, its timers are put back in, now
+   closer to level 0, and the same for the levels above.  Arming and
+   cancelling is O(1), a tick only touches the timers that expire or
+   move down a level.
+   */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "xrpSMTimer.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+#define SM_WHEEL_BITS                    6
+#define SM_WHEEL_SLOTS                   ( 1 << SM_WHEEL_BITS )
+#define SM_WHEEL_MASK                    ( SM_WHEEL_SLOTS - 1 )
+#define SM_WHEEL_LEVELS                  4
+// the longest timeout in ticks, longer ones are cut to this
+#define SM_WHEEL_MAX_TICKS               ( ( 1UL << ( SM_WHEEL_BITS * SM_WHEEL_LEVELS ) ) - 1 )
+// timers SmTimerWheelRun takes out of the wheel before it unlocks and
+// enqueues their events
+#define SM_WHEEL_FIRE_BATCH              32
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+// an expired timer, copied out of the instance while the lock is held,
+// the timer itself can be armed again as soon as the lock is released
+typedef struct _SmWheelFired
+{
+    tSmInstance     *mpSM;
+    tStateInfo      *mpStateInfo;
+} tSmWheelFired;
+
+struct _SmTimerWheel
+{
+    pthread_mutex_t mLock;
+    UInt32          mTickMs;
+    struct timespec mStart;
+        // ticks the wheel has run, every timer expiring at or before it fired
+    UInt32          mNow;
+        // number of timers in the slots
+    UInt32          mArmed;
+    tSmTimer        *mpSlots[ SM_WHEEL_LEVELS ][ SM_WHEEL_SLOTS ];
+        // the instances given this wheel by SmSetTimerWheel, linked through
+        // mpWheelNext, armed or not
+    tSmInstance     *mpInstances;
+        // TRUE while SmTimerWheelRun enqueues without the lock, detaching an
+        // instance waits for mFired so the events do not go into a freed one
+    BOOL            bFiring;
+    pthread_t       mFiringThread;
+    pthread_cond_t  mFired;
+};
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+uint64_t _SmWheelElapsedMs( tSmTimerWheel *pWheel );
+void _SmWheelInsert( tSmTimerWheel *pWheel, tSmTimer *pTimer );
+void _SmWheelUnlink( tSmTimerWheel *pWheel, tSmTimer *pTimer );
+void _SmWheelTick( tSmTimerWheel *pWheel );
+UInt32 _SmWheelExpire( tSmTimerWheel *pWheel, tSmWheelFired *pFired, UInt32 maxFired );
+void _SmWheelWaitFiring( tSmTimerWheel *pWheel );
+UInt8 _SmStateDepth( const tStateInfo *pStateInfo );
+void _SmTimerStart( tSmInstance *pSM, tStateInfo *pStateInfo );
+void _SmTimerStop( tSmInstance *pSM, tStateInfo *pStateInfo );
+void _SmTimerStopAll( tSmInstance *pSM );
+void _SmTimerStartAll( tSmInstance *pSM );
+void _SmTimerDetach( tSmInstance *pSM );
+
+/*********************************************************************
+ *
+ * Milliseconds since the wheel was created.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *
+ * Returns:
+ *  the elapsed time
+ *
+ *********************************************************************/
+uint64_t _SmWheelElapsedMs( tSmTimerWheel *pWheel )
+{
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    return ( uint64_t ) ( now.tv_sec - pWheel->mStart.tv_sec ) * 1000 + ( now.tv_nsec - pWheel->mStart.tv_nsec ) / 1000000;
+}
+
+/*********************************************************************
+ *
+ * Link a timer into the slot for its expiry.  Called with the lock.
+ * A timer expiring at mNow goes in the level 0 slot of mNow, that
+ * only happens while _SmWheelTick cascades, _SmWheelExpire takes that
+ * slot next.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *  pTimer - timer with mExpiry set, not armed
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmWheelInsert( tSmTimerWheel *pWheel, tSmTimer *pTimer )
+{
+    UInt32 delta = pTimer->mExpiry - pWheel->mNow;
+    UInt8 level;
+
+    if ( delta > SM_WHEEL_MAX_TICKS )
+    {
+        delta = SM_WHEEL_MAX_TICKS;
+        pTimer->mExpiry = pWheel->mNow + delta;
+    }
+
+    for ( level = 0 ; ( level < SM_WHEEL_LEVELS - 1 ) && ( delta >= ( 1UL << ( SM_WHEEL_BITS * ( level + 1 ) ) ) ) ; ++level )
+    {
+    }
+
+    pTimer->mppSlot = &pWheel->mpSlots[ level ][ ( pTimer->mExpiry >> ( SM_WHEEL_BITS * level ) ) & SM_WHEEL_MASK ];
+    pTimer->mpPrev = NULL;
+    pTimer->mpNext = *pTimer->mppSlot;
+    if ( NULL != pTimer->mpNext )
+    {
+        pTimer->mpNext->mpPrev = pTimer;
+    }
+    *pTimer->mppSlot = pTimer;
+    ++pWheel->mArmed;
+}
+
+/*********************************************************************
+ *
+ * Take an armed timer out of its slot.  Called with the lock.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *  pTimer - an armed timer
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmWheelUnlink( tSmTimerWheel *pWheel, tSmTimer *pTimer )
+{
+    if ( NULL != pTimer->mpPrev )
+    {
+        pTimer->mpPrev->mpNext = pTimer->mpNext;
+    }
+    else
+    {
+        *pTimer->mppSlot = pTimer->mpNext;
+    }
+    if ( NULL != pTimer->mpNext )
+    {
+        pTimer->mpNext->mpPrev = pTimer->mpPrev;
+    }
+    pTimer->mppSlot = NULL;
+    --pWheel->mArmed;
+}
+
+/*********************************************************************
+ *
+ * Move the wheel one tick and cascade the upper levels when level 0
+ * wraps, the timers of the new level 0 slot are left for
+ * _SmWheelExpire.  Called with the lock.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmWheelTick( tSmTimerWheel *pWheel )
+{
+    tSmTimer *pTimer, *pNext;
+    UInt8 level;
+    UInt32 slot;
+
+    ++pWheel->mNow;
+
+    for ( level = 1 ; ( level < SM_WHEEL_LEVELS ) && ( 0 == ( pWheel->mNow & ( ( 1UL << ( SM_WHEEL_BITS * level ) ) - 1 ) ) ) ; ++level )
+    {
+        slot = ( pWheel->mNow >> ( SM_WHEEL_BITS * level ) ) & SM_WHEEL_MASK;
+        pTimer = pWheel->mpSlots[ level ][ slot ];
+        pWheel->mpSlots[ level ][ slot ] = NULL;
+        for ( ; NULL != pTimer ; pTimer = pNext )
+        {
+            pNext = pTimer->mpNext;
+            --pWheel->mArmed;
+            _SmWheelInsert( pWheel, pTimer );
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * Take the expired timers out of the level 0 slot of mNow, copying
+ * what their events need.  Called with the lock.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *  pFired - filled with the expired timers
+ *  maxFired - entries in pFired, timers past it are left in the slot
+ *
+ * Returns:
+ *  number of entries filled
+ *
+ *********************************************************************/
+UInt32 _SmWheelExpire( tSmTimerWheel *pWheel, tSmWheelFired *pFired, UInt32 maxFired )
+{
+    tSmTimer **ppSlot = &pWheel->mpSlots[ 0 ][ pWheel->mNow & SM_WHEEL_MASK ];
+    tSmTimer *pTimer;
+    UInt32 count;
+
+    for ( count = 0 ; ( count < maxFired ) && ( NULL != ( pTimer = *ppSlot ) ) ; ++count )
+    {
+        _SmWheelUnlink( pWheel, pTimer );
+        pFired[ count ].mpSM = pTimer->mpSM;
+        pFired[ count ].mpStateInfo = pTimer->mpStateInfo;
+    }
+
+    return count;
+}
+
+/*********************************************************************
+ *
+ * Wait until no other thread is enqueueing the events of expired
+ * timers.  Called with the lock, returns with it.  The thread that is
+ * firing, through a notifier or scheduler it calls, does not wait.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmWheelWaitFiring( tSmTimerWheel *pWheel )
+{
+    while ( ( TRUE == pWheel->bFiring ) && ( 0 == pthread_equal( pWheel->mFiringThread, pthread_self() ) ) )
+    {
+        pthread_cond_wait( &pWheel->mFired, &pWheel->mLock );
+    }
+}
+
+/*********************************************************************
+ *
+ * Create a timing wheel.
+ *
+ * Parameters:
+ *  tickMs - resolution of the timeouts in milliseconds, timeouts are
+ *           rounded up to whole ticks
+ *
+ * Returns:
+ *  the wheel, NULL if out of memory
+ *
+ *********************************************************************/
+tSmTimerWheel *SmTimerWheelCreate( UInt32 tickMs )
+{
+    tSmTimerWheel *pWheel;
+
+    pWheel = ( tSmTimerWheel * ) calloc( 1, sizeof( tSmTimerWheel ) );
+    if ( NULL == pWheel )
+    {
+        return NULL;
+    }
+
+    pthread_mutex_init( &pWheel->mLock, NULL );
+    pthread_cond_init( &pWheel->mFired, NULL );
+    pWheel->mTickMs = ( 0 == tickMs ) ? 1 : tickMs;
+    clock_gettime( CLOCK_MONOTONIC, &pWheel->mStart );
+
+    return pWheel;
+}
+
+/*********************************************************************
+ *
+ * Free a timing wheel.  Every instance attached to it is left without
+ * a wheel, as after SmSetTimerWheel with NULL, and its armed timers
+ * are dropped.  None of them may be running its engine meanwhile, and
+ * no thread may be in SmTimerWheelRun.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmTimerWheelDestroy( tSmTimerWheel *pWheel )
+{
+    tSmInstance *pSM;
+    UInt8 depth;
+
+    pthread_mutex_lock( &pWheel->mLock );
+    while ( NULL != ( pSM = pWheel->mpInstances ) )
+    {
+        for ( depth = 0 ; depth < SM_TIMER_MAX_DEPTH ; ++depth )
+        {
+            if ( NULL != pSM->mStateTimers[ depth ].mppSlot )
+            {
+                _SmWheelUnlink( pWheel, &pSM->mStateTimers[ depth ] );
+            }
+        }
+        pWheel->mpInstances = pSM->mpWheelNext;
+        pSM->mpWheelNext = NULL;
+        pSM->mpWheelPrev = NULL;
+        pSM->mpTimerWheel = NULL;
+    }
+    pthread_mutex_unlock( &pWheel->mLock );
+
+    pthread_cond_destroy( &pWheel->mFired );
+    pthread_mutex_destroy( &pWheel->mLock );
+    free( pWheel );
+}
+
+/*********************************************************************
+ *
+ * Run the wheel up to the current time, enqueueing the timeout event
+ * of every timer that expired.  Call it again after the returned time
+ * at the latest, it may be called earlier or more often.  The expired
+ * timers are taken out SM_WHEEL_FIRE_BATCH at a time and their events
+ * enqueued without the lock, so arming and cancelling on the other
+ * threads, and their notifiers, never wait for a long run of enqueues.
+ *
+ * Parameters:
+ *  pWheel - the wheel
+ *
+ * Returns:
+ *  milliseconds until the next timer may expire, SM_TIMER_WAIT_FOREVER
+ *  when no timer is armed
+ *
+ *********************************************************************/
+UInt32 SmTimerWheelRun( tSmTimerWheel *pWheel )
+{
+    tSmWheelFired fired[ SM_WHEEL_FIRE_BATCH ];
+    uint64_t elapsedMs;
+    UInt32 nowTick, waitMs;
+    UInt32 ticks, count, i;
+
+    pthread_mutex_lock( &pWheel->mLock );
+
+    // one run at a time, a second one would move mNow under the first
+    _SmWheelWaitFiring( pWheel );
+
+    elapsedMs = _SmWheelElapsedMs( pWheel );
+    nowTick = ( UInt32 ) ( elapsedMs / pWheel->mTickMs );
+
+    for ( ;; )
+    {
+        count = _SmWheelExpire( pWheel, fired, SM_WHEEL_FIRE_BATCH );
+        if ( 0 != count )
+        {
+            pWheel->bFiring = TRUE;
+            pWheel->mFiringThread = pthread_self();
+            pthread_mutex_unlock( &pWheel->mLock );
+
+            for ( i = 0 ; i < count ; ++i )
+            {
+                SmEnqueueEvent( fired[ i ].mpSM, fired[ i ].mpStateInfo->mTimeoutEvent, ( tStEventData ) fired[ i ].mpStateInfo );
+            }
+
+            pthread_mutex_lock( &pWheel->mLock );
+            pWheel->bFiring = FALSE;
+            pthread_cond_broadcast( &pWheel->mFired );
+            continue;
+        }
+
+        if ( pWheel->mNow == nowTick )
+        {
+            break;
+        }
+        if ( 0 == pWheel->mArmed )
+        {   // nothing to fire on the way
+            pWheel->mNow = nowTick;
+            break;
+        }
+        _SmWheelTick( pWheel );
+    }
+
+    if ( 0 == pWheel->mArmed )
+    {
+        waitMs = SM_TIMER_WAIT_FOREVER;
+    }
+    else
+    {   // the next level 0 slot in use, or the next cascade
+        for ( ticks = 1 ; ticks < SM_WHEEL_SLOTS ; ++ticks )
+        {
+            if ( ( NULL != pWheel->mpSlots[ 0 ][ ( pWheel->mNow + ticks ) & SM_WHEEL_MASK ] ) ||
+                 ( 0 == ( ( pWheel->mNow + ticks ) & SM_WHEEL_MASK ) ) )
+            {
+                break;
+            }
+        }
+        waitMs = ( UInt32 ) ( ( elapsedMs / pWheel->mTickMs + ticks ) * pWheel->mTickMs - elapsedMs );
+    }
+
+    pthread_mutex_unlock( &pWheel->mLock );
+
+    return waitMs;
+}
+
+/*********************************************************************
+ *
+ * Nesting depth of a state, the index of its timer in the instance.
+ *
+ * Parameters:
+ *  pStateInfo - the state
+ *
+ * Returns:
+ *  0 for a state without a parent, 1 for its children and so on
+ *
+ *********************************************************************/
+UInt8 _SmStateDepth( const tStateInfo *pStateInfo )
+{
+    UInt8 depth = 0;
+
+    for ( pStateInfo = pStateInfo->mpParent ; NULL != pStateInfo ; pStateInfo = pStateInfo->mpParent )
+    {
+        ++depth;
+    }
+
+    return depth;
+}
+
+/*********************************************************************
+ *
+ * Arm the timeout of a state that was just entered.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance, with a timer wheel
+ *  pStateInfo - the state, with mTimeoutMs set
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTimerStart( tSmInstance *pSM, tStateInfo *pStateInfo )
+{
+    tSmTimerWheel *pWheel = pSM->mpTimerWheel;
+    UInt8 depth = _SmStateDepth( pStateInfo );
+    tSmTimer *pTimer;
+
+    if ( depth >= SM_TIMER_MAX_DEPTH )
+    {
+        XLOGD_ERROR( "%s Timer: %s is nested too deep for a timeout" INST_NAME INFO_ST_NAME( pStateInfo ) );
+        return;
+    }
+
+    pTimer = &pSM->mStateTimers[ depth ];
+
+    pthread_mutex_lock( &pWheel->mLock );
+    if ( NULL != pTimer->mppSlot )
+    {   // left without SmSetThisState or the engine knowing
+        _SmWheelUnlink( pWheel, pTimer );
+    }
+    pTimer->mpSM = pSM;
+    pTimer->mpStateInfo = pStateInfo;
+    // rounded up, always after the tick the wheel is at
+    pTimer->mExpiry = ( UInt32 ) ( ( _SmWheelElapsedMs( pWheel ) + pStateInfo->mTimeoutMs + pWheel->mTickMs - 1 ) / pWheel->mTickMs );
+    _SmWheelInsert( pWheel, pTimer );
+    pthread_mutex_unlock( &pWheel->mLock );
+}
+
+/*********************************************************************
+ *
+ * Cancel the timeout of a state that is being left.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance, with a timer wheel
+ *  pStateInfo - the state, with mTimeoutMs set
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTimerStop( tSmInstance *pSM, tStateInfo *pStateInfo )
+{
+    tSmTimerWheel *pWheel = pSM->mpTimerWheel;
+    UInt8 depth = _SmStateDepth( pStateInfo );
+    tSmTimer *pTimer;
+
+    if ( depth >= SM_TIMER_MAX_DEPTH )
+    {
+        return;
+    }
+
+    pTimer = &pSM->mStateTimers[ depth ];
+
+    pthread_mutex_lock( &pWheel->mLock );
+    if ( ( NULL != pTimer->mppSlot ) && ( pTimer->mpStateInfo == pStateInfo ) )
+    {
+        _SmWheelUnlink( pWheel, pTimer );
+    }
+    pthread_mutex_unlock( &pWheel->mLock );
+}
+
+/*********************************************************************
+ *
+ * Cancel every timer of an instance.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance, with a timer wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTimerStopAll( tSmInstance *pSM )
+{
+    tSmTimerWheel *pWheel = pSM->mpTimerWheel;
+    UInt8 depth;
+
+    pthread_mutex_lock( &pWheel->mLock );
+    for ( depth = 0 ; depth < SM_TIMER_MAX_DEPTH ; ++depth )
+    {
+        if ( NULL != pSM->mStateTimers[ depth ].mppSlot )
+        {
+            _SmWheelUnlink( pWheel, &pSM->mStateTimers[ depth ] );
+        }
+    }
+    pthread_mutex_unlock( &pWheel->mLock );
+}
+
+/*********************************************************************
+ *
+ * Arm the timeouts of the current state and its parents, for a state
+ * that was set without being entered.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance, with a timer wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTimerStartAll( tSmInstance *pSM )
+{
+    tStateInfo *pStateInfo;
+
+    for ( pStateInfo = pSM->pCurrState ; NULL != pStateInfo ; pStateInfo = pStateInfo->mpParent )
+    {
+        if ( 0 != pStateInfo->mTimeoutMs )
+        {
+            _SmTimerStart( pSM, pStateInfo );
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * Cancel every timer of an instance and take it off the list of its
+ * wheel, the wheel no longer knows the instance.  Waits for a run
+ * that is enqueueing on another thread, it may have an expired timer
+ * of the instance.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance, with a timer wheel
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTimerDetach( tSmInstance *pSM )
+{
+    tSmTimerWheel *pWheel = pSM->mpTimerWheel;
+    UInt8 depth;
+
+    pthread_mutex_lock( &pWheel->mLock );
+    // a run may hold events for the instance without the lock
+    _SmWheelWaitFiring( pWheel );
+    for ( depth = 0 ; depth < SM_TIMER_MAX_DEPTH ; ++depth )
+    {
+        if ( NULL != pSM->mStateTimers[ depth ].mppSlot )
+        {
+            _SmWheelUnlink( pWheel, &pSM->mStateTimers[ depth ] );
+        }
+    }
+    if ( NULL != pSM->mpWheelPrev )
+    {
+        pSM->mpWheelPrev->mpWheelNext = pSM->mpWheelNext;
+    }
+    else
+    {
+        pWheel->mpInstances = pSM->mpWheelNext;
+    }
+    if ( NULL != pSM->mpWheelNext )
+    {
+        pSM->mpWheelNext->mpWheelPrev = pSM->mpWheelPrev;
+    }
+    pSM->mpWheelNext = NULL;
+    pSM->mpWheelPrev = NULL;
+    pSM->mpTimerWheel = NULL;
+    pthread_mutex_unlock( &pWheel->mLock );
+}
+
+/*********************************************************************
+ *
+ * Give an instance a timer wheel for the timeouts of its states.  The
+ * timeouts of the current state and its parents start now, the state
+ * was entered before there was a wheel.  Call after SmInit, from the
+ * thread that runs SmProcessEvents.  The wheel keeps a list of its
+ * instances until they are given NULL or another wheel, or freed with
+ * SmFreeInstance, so SmTimerWheelDestroy can detach the ones left.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pWheel - the wheel, NULL to cancel the timers and stop using one
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetTimerWheel( tSmInstance *pSM, tSmTimerWheel *pWheel )
+{
+    if ( NULL != pSM->mpTimerWheel )
+    {
+        _SmTimerDetach( pSM );
+    }
+
+    if ( NULL != pWheel )
+    {
+        pthread_mutex_lock( &pWheel->mLock );
+        pSM->mpWheelPrev = NULL;
+        pSM->mpWheelNext = pWheel->mpInstances;
+        if ( NULL != pSM->mpWheelNext )
+        {
+            pSM->mpWheelNext->mpWheelPrev = pSM;
+        }
+        pWheel->mpInstances = pSM;
+        pSM->mpTimerWheel = pWheel;
+        pthread_mutex_unlock( &pWheel->mLock );
+
+        _SmTimerStartAll( pSM );
+    }
+}
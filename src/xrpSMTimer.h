@@ -0,0 +1,69 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMTimer.h
+ Descripton:
+ Engine managed state timeouts.  A state that sets mTimeoutMs and
+ mTimeoutEvent in its tStateInfo gets a timer armed when it is entered
+ and cancelled when it is left, the states no longer start and stop
+ their own OS timers.  All the timers live in one hierarchical timing
+ wheel that can be shared by any number of instances, so arming and
+ cancelling are a few list operations under one lock.
+ The wheel has no thread of its own, the client runs SmTimerWheelRun
+ from its main loop, or from a timer of its own, and sleeps for the
+ returned time.  An expired timer enqueues its event with SmEnqueueEvent
+ from that thread, so instances run on other threads must be set up for
+ SmSetMultiProducer.  A timeout that was already enqueued when its
+ state is left still arrives, as it would with an OS timer.
+ */
+
+#ifndef XRP_SMTIMER_H_
+#define XRP_SMTIMER_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Defines
+//-------------------------------------------------------------------------------
+
+// SmTimerWheelRun, no timer is armed
+#define SM_TIMER_WAIT_FOREVER            0xFFFFFFFF
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmTimerWheel tSmTimerWheel;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+tSmTimerWheel *SmTimerWheelCreate( UInt32 tickMs );
+void SmTimerWheelDestroy( tSmTimerWheel *pWheel );
+UInt32 SmTimerWheelRun( tSmTimerWheel *pWheel );
+void SmSetTimerWheel( tSmInstance *pSM, tSmTimerWheel *pWheel );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
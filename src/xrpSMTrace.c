@@ -0,0 +1,394 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+
+   File: xrpSMTrace.c
+   Descripton:
+   This file contains the per instance binary trace, see xrpSMTrace.h.
+   The engine thread is the only writer of a ring, a record is a few
+   stores and a clock read.  The records hold the tStateInfo pointer,
+   it is turned into the state index only when a snapshot is taken, by
+   a binary search on a list sorted when the trace was created.
+   */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "xrpSMTrace.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+#if ( ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) ) || defined( RDK ) )
+#define SM_TRACE_NAMES                   1
+#else
+#define SM_TRACE_NAMES                   0
+#endif
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmTraceRecord
+{
+    uint64_t            mTimeNs;
+    const tStateInfo    *mpState;
+    tStEventID          mEvtID;
+    UInt8               mAction;
+    UInt8               mResult;
+} tSmTraceRecord;
+
+// a state of the machine and its index, sorted on the address
+typedef struct _SmTraceState
+{
+    const tStateInfo    *mpState;
+    UInt16              mStateIdx;
+} tSmTraceState;
+
+struct _SmTrace
+{
+    tSmTraceRecord      *mpRecords;
+    UInt32              mMask;
+        // records written so far, the next one goes to mNext & mMask
+    uint64_t            mNext;
+        // the states in state index order, and sorted on the address
+    tStateInfo          **mppStates;
+    tSmTraceState       *mpSorted;
+    UInt16              mStateCount;
+    UInt32              mNamesSize;
+};
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+BOOL _SmCollectStates( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, int *pStateCount );
+int _SmTraceCompare( const void *pLeft, const void *pRight );
+UInt16 _SmTraceStateIdx( const tSmTrace *pTrace, const tStateInfo *pStateInfo );
+void _SmTrace( tSmInstance *pSM, const tStateInfo *pStateInfo, tStEventID evtID, UInt8 action, UInt8 result );
+
+/*********************************************************************
+ *
+ * qsort compare of two tSmTraceState entries, by the address of their
+ * state.
+ *
+ * Parameters:
+ *  pLeft - first tSmTraceState
+ *  pRight - second tSmTraceState
+ *
+ * Returns:
+ *  -1, 0 or 1 as the left state is below, the same as or above the right
+ *
+ *********************************************************************/
+int _SmTraceCompare( const void *pLeft, const void *pRight )
+{
+    uintptr_t left = ( uintptr_t ) ( ( const tSmTraceState * ) pLeft )->mpState;
+    uintptr_t right = ( uintptr_t ) ( ( const tSmTraceState * ) pRight )->mpState;
+
+    return ( left < right ) ? -1 : ( ( left > right ) ? 1 : 0 );
+}
+
+/*********************************************************************
+ *
+ * Create a trace for the instances of a machine, one trace per
+ * instance.  The ring is rounded up to a power of two records.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state of the machine, the states
+ *                      reachable from it are the ones named in a snapshot
+ *  recordCount - records the ring keeps
+ *
+ * Returns:
+ *  the trace, or NULL if out of memory or there are too many states
+ *
+ *********************************************************************/
+tSmTrace *SmTraceCreate( tStateInfo *pInitialStateInfo, UInt32 recordCount )
+{
+    tSmTrace *pTrace;
+    UInt32 size = 1;
+    int stateCount, idx;
+
+    if ( ( 0 == recordCount ) || ( recordCount > 0x80000000 ) )
+    {
+        XLOGD_ERROR( "Trace: bad record count %u", recordCount );
+        return NULL;
+    }
+
+    while ( size < recordCount )
+    {
+        size <<= 1;
+    }
+
+    pTrace = ( tSmTrace * ) calloc( 1, sizeof( tSmTrace ) );
+    if ( NULL == pTrace )
+    {
+        XLOGD_ERROR( "Trace: out of memory" );
+        return NULL;
+    }
+
+    if ( FALSE == _SmCollectStates( pInitialStateInfo, &pTrace->mppStates, &stateCount ) )
+    {
+        XLOGD_ERROR( "Trace: out of memory" );
+        free( pTrace );
+        return NULL;
+    }
+
+    if ( stateCount >= SM_TRACE_NO_STATE )
+    {
+        XLOGD_ERROR( "Trace: too many states, %d", stateCount );
+        SmTraceDestroy( pTrace );
+        return NULL;
+    }
+    pTrace->mStateCount = ( UInt16 ) stateCount;
+
+    pTrace->mpRecords = ( tSmTraceRecord * ) calloc( size, sizeof( tSmTraceRecord ) );
+    pTrace->mpSorted = ( tSmTraceState * ) malloc( stateCount * sizeof( tSmTraceState ) );
+    if ( ( NULL == pTrace->mpRecords ) || ( NULL == pTrace->mpSorted ) )
+    {
+        XLOGD_ERROR( "Trace: out of memory" );
+        SmTraceDestroy( pTrace );
+        return NULL;
+    }
+    pTrace->mMask = size - 1;
+
+    for ( idx = 0 ; idx < stateCount ; ++idx )
+    {
+        pTrace->mpSorted[ idx ].mpState = pTrace->mppStates[ idx ];
+        pTrace->mpSorted[ idx ].mStateIdx = ( UInt16 ) idx;
+#if ( SM_TRACE_NAMES )
+        pTrace->mNamesSize += strlen( ( NULL != pTrace->mppStates[ idx ]->mStateName ) ? pTrace->mppStates[ idx ]->mStateName : "" ) + 1;
+#else
+        pTrace->mNamesSize += 1;
+#endif
+    }
+    qsort( pTrace->mpSorted, stateCount, sizeof( tSmTraceState ), _SmTraceCompare );
+
+    return pTrace;
+}
+
+/*********************************************************************
+ *
+ * Release a trace, after SmSetTrace( pSM, NULL ) on its instance.
+ *
+ * Parameters:
+ *  pTrace - the trace
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmTraceDestroy( tSmTrace *pTrace )
+{
+    if ( NULL == pTrace )
+    {
+        return;
+    }
+
+    free( pTrace->mpRecords );
+    free( pTrace->mpSorted );
+    free( pTrace->mppStates );
+    free( pTrace );
+}
+
+/*********************************************************************
+ *
+ * Start or stop tracing an instance, the records already in the ring
+ * are kept.  Call after SmInit, from the thread that runs
+ * SmProcessEvents.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pTrace - the trace, NULL to stop tracing
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void SmSetTrace( tSmInstance *pSM, tSmTrace *pTrace )
+{
+    pSM->mpTrace = pTrace;
+}
+
+/*********************************************************************
+ *
+ * Add a record to the trace of an instance, the engine calls this
+ * around every state callback when mpTrace is set.
+ *
+ * Parameters:
+ *  pSM - pointer to state machine instance
+ *  pStateInfo - the state that is called
+ *  evtID - the event being handled
+ *  action - eStateAction of the call
+ *  result - the guard result for ACT_GUARD
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmTrace( tSmInstance *pSM, const tStateInfo *pStateInfo, tStEventID evtID, UInt8 action, UInt8 result )
+{
+    tSmTrace *pTrace = pSM->mpTrace;
+    tSmTraceRecord *pRecord = &pTrace->mpRecords[ pTrace->mNext & pTrace->mMask ];
+    struct timespec now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now );
+
+    pRecord->mTimeNs = ( uint64_t ) now.tv_sec * 1000000000 + now.tv_nsec;
+    pRecord->mpState = pStateInfo;
+    pRecord->mEvtID = evtID;
+    pRecord->mAction = action;
+    pRecord->mResult = result;
+    ++pTrace->mNext;
+}
+
+/*********************************************************************
+ *
+ * Find the state index of a state.
+ *
+ * Parameters:
+ *  pTrace - the trace
+ *  pStateInfo - the state
+ *
+ * Returns:
+ *  the index, or SM_TRACE_NO_STATE if the state is not in the machine
+ *
+ *********************************************************************/
+UInt16 _SmTraceStateIdx( const tSmTrace *pTrace, const tStateInfo *pStateInfo )
+{
+    UInt32 low = 0, high = pTrace->mStateCount, mid;
+
+    while ( low < high )
+    {
+        mid = ( low + high ) / 2;
+        if ( ( uintptr_t ) pTrace->mpSorted[ mid ].mpState < ( uintptr_t ) pStateInfo )
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    if ( ( low < pTrace->mStateCount ) && ( pTrace->mpSorted[ low ].mpState == pStateInfo ) )
+    {
+        return pTrace->mpSorted[ low ].mStateIdx;
+    }
+
+    return SM_TRACE_NO_STATE;
+}
+
+/*********************************************************************
+ *
+ * Number of bytes SmTraceSnapshot writes for a full ring.
+ *
+ * Parameters:
+ *  pTrace - the trace
+ *
+ * Returns:
+ *  the size in bytes
+ *
+ *********************************************************************/
+size_t SmTraceSnapshotSize( const tSmTrace *pTrace )
+{
+    return sizeof( tSmTraceHeader ) + pTrace->mNamesSize + ( size_t ) ( pTrace->mMask + 1 ) * sizeof( tSmTraceOut );
+}
+
+/*********************************************************************
+ *
+ * Copy the trace out in the snapshot format of xrpSMTrace.h.  Nothing
+ * is allocated and no lock is taken, so this may be called from a
+ * crash handler.  Take it from the thread that runs SmProcessEvents,
+ * or while that thread is stopped, records written meanwhile may be
+ * torn.  When the buffer is too small the oldest records are left out.
+ *
+ * Parameters:
+ *  pTrace - the trace
+ *  pBuffer - where to write the snapshot
+ *  bufferSize - bytes at pBuffer, see SmTraceSnapshotSize
+ *
+ * Returns:
+ *  the number of bytes written, 0 if not even the state names fit
+ *
+ *********************************************************************/
+size_t SmTraceSnapshot( const tSmTrace *pTrace, void *pBuffer, size_t bufferSize )
+{
+    UInt8 *pOut = ( UInt8 * ) pBuffer;
+    tSmTraceHeader header;
+    tSmTraceOut out;
+    const tSmTraceRecord *pRecord;
+    uint64_t next = pTrace->mNext;
+    uint64_t first, pos;
+    size_t count, fit;
+    UInt16 idx;
+#if ( SM_TRACE_NAMES )
+    const char *pName;
+#endif
+
+    if ( bufferSize < sizeof( tSmTraceHeader ) + pTrace->mNamesSize )
+    {
+        return 0;
+    }
+
+    count = ( next > ( uint64_t ) pTrace->mMask + 1 ) ? ( size_t ) pTrace->mMask + 1 : ( size_t ) next;
+    fit = ( bufferSize - sizeof( tSmTraceHeader ) - pTrace->mNamesSize ) / sizeof( tSmTraceOut );
+    if ( count > fit )
+    {
+        count = fit;
+    }
+    first = next - count;
+
+    memset( &header, 0, sizeof( header ) );
+    header.mMagic = SM_TRACE_MAGIC;
+    header.mVersion = SM_TRACE_VERSION;
+    header.mStateCount = pTrace->mStateCount;
+    header.mRecordCount = ( UInt32 ) count;
+    header.mNamesSize = pTrace->mNamesSize;
+    header.mLost = first;
+    memcpy( pOut, &header, sizeof( header ) );
+    pOut += sizeof( header );
+
+    for ( idx = 0 ; idx < pTrace->mStateCount ; ++idx )
+    {
+#if ( SM_TRACE_NAMES )
+        pName = ( NULL != pTrace->mppStates[ idx ]->mStateName ) ? pTrace->mppStates[ idx ]->mStateName : "";
+        memcpy( pOut, pName, strlen( pName ) + 1 );
+        pOut += strlen( pName ) + 1;
+#else
+        *pOut++ = 0;
+#endif
+    }
+
+    memset( &out, 0, sizeof( out ) );
+    for ( pos = first ; pos < next ; ++pos )
+    {
+        pRecord = &pTrace->mpRecords[ pos & pTrace->mMask ];
+        out.mTimeNs = pRecord->mTimeNs;
+        out.mStateIdx = _SmTraceStateIdx( pTrace, pRecord->mpState );
+        out.mEvtID = pRecord->mEvtID;
+        out.mAction = pRecord->mAction;
+        out.mResult = pRecord->mResult;
+        memcpy( pOut, &out, sizeof( out ) );
+        pOut += sizeof( out );
+    }
+
+    return pOut - ( UInt8 * ) pBuffer;
+}
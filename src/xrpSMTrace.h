@@ -0,0 +1,102 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMTrace.h
+ Descripton:
+ A binary trace of what the engine did, kept in memory per instance.
+ Every guard, enter, exit and internal call of a traced instance puts
+ one small record in a ring: a timestamp, the state, the event id, the
+ action and the guard result.  Nothing is formatted or printed while
+ the machine runs, so turning the trace on hardly changes the timing
+ of the bug being chased, and the ring keeps the last records only.
+ SmTraceSnapshot copies the ring out in the format below, without
+ allocating or locking, so it can be called from a crash handler.  The
+ xrpSMTraceDecode tool turns a snapshot back into readable lines with
+ the state names.
+ Snapshot layout, in the byte order of the target:
+   tSmTraceHeader
+   mNamesSize bytes, mStateCount NUL terminated state names in state
+   index order, empty when the names are not compiled in
+   mRecordCount tSmTraceOut, oldest first
+ */
+
+#ifndef XRP_SMTRACE_H_
+#define XRP_SMTRACE_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Defines
+//-------------------------------------------------------------------------------
+
+// tSmTraceHeader.mMagic, "XSMT"
+#define SM_TRACE_MAGIC                   0x544D5358
+#define SM_TRACE_VERSION                 1
+
+// tSmTraceOut.mStateIdx of a state that is not in the traced machine
+#define SM_TRACE_NO_STATE                0xFFFF
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmTrace tSmTrace;
+
+typedef struct _SmTraceHeader
+{
+    UInt32          mMagic;
+    UInt16          mVersion;
+    UInt16          mStateCount;
+    UInt32          mRecordCount;
+    UInt32          mNamesSize;
+        // records that were overwritten before the snapshot
+    uint64_t        mLost;
+} tSmTraceHeader;
+
+typedef struct _SmTraceOut
+{
+        // CLOCK_MONOTONIC
+    uint64_t        mTimeNs;
+        // index of the state, breadth first from the initial state
+    UInt16          mStateIdx;
+    tStEventID      mEvtID;
+        // eStateAction
+    UInt8           mAction;
+        // ACT_GUARD only, TRUE if the guard accepted the event
+    UInt8           mResult;
+    UInt16          mReserved;
+} tSmTraceOut;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+tSmTrace *SmTraceCreate( tStateInfo *pInitialStateInfo, UInt32 recordCount );
+void SmTraceDestroy( tSmTrace *pTrace );
+void SmSetTrace( tSmInstance *pSM, tSmTrace *pTrace );
+size_t SmTraceSnapshotSize( const tSmTrace *pTrace );
+size_t SmTraceSnapshot( const tSmTrace *pTrace, void *pBuffer, size_t bufferSize );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,396 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+
+   File: xrpSMValidate.c
+   Descripton:
+   This file contains the static checks of the state tables, see
+   xrpSMValidate.h.  The walk is the one of _SmCollectStates, except
+   that a row without a next state is reported instead of followed and
+   every parent chain is cut off after as many steps as there are
+   states, the tables being checked may be the broken ones.
+   */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xrpSMValidate.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+// one bit per tStEventID
+#define SM_VALIDATE_ID_WORDS             ( ( 0xFFFF >> 5 ) + 1 )
+#define SM_VALIDATE_ID_SET( pBits, id )  ( ( pBits )[ ( id ) >> 5 ] |= ( UInt32 ) 1 << ( ( id ) & 31 ) )
+#define SM_VALIDATE_ID_TEST( pBits, id ) ( 0 != ( ( pBits )[ ( id ) >> 5 ] & ( ( UInt32 ) 1 << ( ( id ) & 31 ) ) ) )
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+BOOL _SmValidateCollect( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, UInt32 *pStateCount );
+BOOL _SmValidateHasRow( const tStateInfo *pStateInfo, tStEventID evtID, UInt32 maxDepth );
+void _SmValidateRows( const tStateInfo *pStateInfo, tSmValidateReport *pReport, UInt32 *pRowIDs );
+
+/*********************************************************************
+ *
+ * Collect every state that can be reached from the initial state, in
+ * the breadth first order of _SmCollectStates.  Rows without a next
+ * state are skipped.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *  pppStates - returns the allocated list, caller must free() it
+ *  pStateCount - returns the number of states in the list
+ *
+ * Returns:
+ *  TRUE, if the list was built
+ *  FALSE, out of memory
+ *
+ *********************************************************************/
+BOOL _SmValidateCollect( tStateInfo *pInitialStateInfo, tStateInfo ***pppStates, UInt32 *pStateCount )
+{
+    tStateInfo **pStates, **pGrown;
+    tStateInfo *pNextStateInfo;
+    UInt32 stateCount = 0, stateSize = 16;
+    UInt32 stateIdx, idx;
+    int nextStateIdx;
+
+    pStates = ( tStateInfo ** ) malloc( stateSize * sizeof( tStateInfo * ) );
+    if ( NULL == pStates )
+    {
+        return FALSE;
+    }
+
+    pStates[ stateCount++ ] = pInitialStateInfo;
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        // the parent comes after the rows
+        for ( nextStateIdx = 0 ; nextStateIdx <= pStates[ stateIdx ]->mNextStCount ; ++nextStateIdx )
+        {
+            if ( nextStateIdx < pStates[ stateIdx ]->mNextStCount )
+            {
+                pNextStateInfo = ( tStateInfo * ) pStates[ stateIdx ]->mpNextStates[ nextStateIdx ].mStInfo;
+            }
+            else
+            {
+                pNextStateInfo = pStates[ stateIdx ]->mpParent;
+            }
+
+            if ( NULL == pNextStateInfo )
+            {   // reported by _SmValidateRows
+                continue;
+            }
+
+            for ( idx = 0 ; idx < stateCount ; ++idx )
+            {
+                if ( pStates[ idx ] == pNextStateInfo )
+                {
+                    break;
+                }
+            }
+
+            if ( idx < stateCount )
+            {   // already have this one
+                continue;
+            }
+
+            if ( stateCount == stateSize )
+            {
+                stateSize *= 2;
+                pGrown = ( tStateInfo ** ) realloc( pStates, stateSize * sizeof( tStateInfo * ) );
+                if ( NULL == pGrown )
+                {
+                    free( pStates );
+                    return FALSE;
+                }
+                pStates = pGrown;
+            }
+
+            pStates[ stateCount++ ] = pNextStateInfo;
+        }
+    }
+
+    *pppStates = pStates;
+    *pStateCount = stateCount;
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Check if a state or one of its parents has a row for an event id.
+ *
+ * Parameters:
+ *  pStateInfo - the state
+ *  evtID - the event id
+ *  maxDepth - most parents to look at, stops a parent loop
+ *
+ * Returns:
+ *  TRUE, if there is a row for the event id
+ *
+ *********************************************************************/
+BOOL _SmValidateHasRow( const tStateInfo *pStateInfo, tStEventID evtID, UInt32 maxDepth )
+{
+    int idx;
+
+    for ( ; ( NULL != pStateInfo ) && ( maxDepth > 0 ) ; pStateInfo = pStateInfo->mpParent, --maxDepth )
+    {
+        for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+        {
+            if ( pStateInfo->mpNextStates[ idx ].mID == evtID )
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*********************************************************************
+ *
+ * Check the rows of one state and add them to the report.  The rows
+ * with the same event id are tried in declared order until a guard
+ * says yes, so a row is never tried when an earlier one goes to the
+ * same state, or goes back to the state itself, which is an internal
+ * transition without a guard.
+ *
+ * Parameters:
+ *  pStateInfo - the state
+ *  pReport - the report
+ *  pRowIDs - SM_VALIDATE_ID_WORDS, the bits of the row event ids are set
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _SmValidateRows( const tStateInfo *pStateInfo, tSmValidateReport *pReport, UInt32 *pRowIDs )
+{
+    const tStateGuard *pRows = pStateInfo->mpNextStates;
+    int idx, earlier;
+
+    for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+    {
+        SM_VALIDATE_ID_SET( pRowIDs, pRows[ idx ].mID );
+        if ( pRows[ idx ].mID > pReport->mMaxEvtID )
+        {
+            pReport->mMaxEvtID = pRows[ idx ].mID;
+        }
+
+        if ( NULL == pRows[ idx ].mStInfo )
+        {
+            XLOGD_WARN( "Validate: %s row %d, e: %d has no next state" INFO_ST_NAME( pStateInfo ), idx, pRows[ idx ].mID );
+            ++pReport->mNullRows;
+            continue;
+        }
+
+        for ( earlier = 0 ; earlier < idx ; ++earlier )
+        {
+            if ( ( pRows[ earlier ].mID == pRows[ idx ].mID ) &&
+                 ( ( pRows[ earlier ].mStInfo == pRows[ idx ].mStInfo ) || ( pRows[ earlier ].mStInfo == pStateInfo ) ) )
+            {
+                XLOGD_WARN( "Validate: %s row %d, e: %d is never tried, row %d takes it" INFO_ST_NAME( pStateInfo ), idx, pRows[ idx ].mID, earlier );
+                ++pReport->mShadowedRows;
+                break;
+            }
+        }
+    }
+}
+
+/*********************************************************************
+ *
+ * Check the state tables of a machine, see xrpSMValidate.h.  Every
+ * problem found is logged.  The tables are only read, they may be
+ * compiled or not.
+ *
+ * Parameters:
+ *  pInitialStateInfo - the start state for the state machine.
+ *  ppAllStates - every state the client has, to find the ones that can
+ *                not be reached, or NULL
+ *  allStateCount - states in ppAllStates
+ *  pReport - returns the problems and the sizes, or NULL
+ *
+ * Returns:
+ *  TRUE, if no problem was found
+ *  FALSE, there are problems or out of memory
+ *
+ *********************************************************************/
+BOOL SmValidateMachine( tStateInfo *pInitialStateInfo, tStateInfo * const *ppAllStates, UInt32 allStateCount, tSmValidateReport *pReport )
+{
+    tSmValidateReport report;
+    tStateInfo **pStates;
+    const tStateInfo *pStateInfo, *pParentInfo;
+    UInt32 *pRowIDs, *pDeferIDs;
+    UInt32 stateCount, stateIdx, depth, deferIDs, word, problems;
+    tStEventID evtID, maxEvtID;
+    int idx;
+
+    memset( &report, 0, sizeof( report ) );
+    if ( NULL != pReport )
+    {
+        memset( pReport, 0, sizeof( *pReport ) );
+    }
+
+    if ( NULL == pInitialStateInfo )
+    {
+        XLOGD_ERROR( "Validate: no initial state" );
+        return FALSE;
+    }
+
+    pRowIDs = ( UInt32 * ) calloc( 2 * SM_VALIDATE_ID_WORDS, sizeof( UInt32 ) );
+    if ( ( NULL == pRowIDs ) || ( FALSE == _SmValidateCollect( pInitialStateInfo, &pStates, &stateCount ) ) )
+    {
+        XLOGD_ERROR( "Validate: out of memory" );
+        free( pRowIDs );
+        return FALSE;
+    }
+    pDeferIDs = pRowIDs + SM_VALIDATE_ID_WORDS;
+
+    report.mStateCount = stateCount;
+    report.bDeferIndexExact = TRUE;
+
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        pStateInfo = pStates[ stateIdx ];
+
+        _SmValidateRows( pStateInfo, &report, pRowIDs );
+        report.mRowCount += pStateInfo->mNextStCount;
+        if ( pStateInfo->mNextStCount > report.mMaxRows )
+        {
+            report.mMaxRows = pStateInfo->mNextStCount;
+        }
+
+        // the dispatch data SmCompileStateTable would build
+        maxEvtID = 0;
+        for ( idx = 0 ; idx < pStateInfo->mNextStCount ; ++idx )
+        {
+            maxEvtID = ( pStateInfo->mpNextStates[ idx ].mID > maxEvtID ) ? pStateInfo->mpNextStates[ idx ].mID : maxEvtID;
+        }
+        for ( idx = 0 ; idx < pStateInfo->mDeferEvtIDCount ; ++idx )
+        {
+            evtID = pStateInfo->mpDeferEvtIDs[ idx ];
+            maxEvtID = ( evtID > maxEvtID ) ? evtID : maxEvtID;
+            SM_VALIDATE_ID_SET( pDeferIDs, evtID );
+            if ( evtID >= SM_DEFER_INDEX_OTHER )
+            {
+                report.bDeferIndexExact = FALSE;
+            }
+        }
+        if ( maxEvtID > SM_DISPATCH_MAX_EVT_ID )
+        {
+            ++report.mScannedStates;
+        }
+        else
+        {
+            report.mDispatchBytes += sizeof( tStateDispatch ) + ( ( ( maxEvtID >> 5 ) + 1 ) * sizeof( UInt32 ) ) +
+                                     ( ( maxEvtID + 2 ) * sizeof( tStateCount ) ) + ( pStateInfo->mNextStCount * sizeof( tStateCount ) );
+        }
+        report.mMaxEvtID = ( maxEvtID > report.mMaxEvtID ) ? maxEvtID : report.mMaxEvtID;
+
+        // the parents, a chain longer than the number of states is a loop
+        deferIDs = pStateInfo->mDeferEvtIDCount;
+        depth = 0;
+        for ( pParentInfo = pStateInfo->mpParent ; ( NULL != pParentInfo ) && ( pParentInfo != pStateInfo ) && ( depth < stateCount ) ; pParentInfo = pParentInfo->mpParent )
+        {
+            deferIDs += pParentInfo->mDeferEvtIDCount;
+            ++depth;
+        }
+        if ( NULL != pParentInfo )
+        {   // another state of the loop reports the loop it leads to
+            if ( pParentInfo == pStateInfo )
+            {
+                XLOGD_WARN( "Validate: %s is its own parent" INFO_ST_NAME( pStateInfo ) );
+                ++report.mParentLoops;
+            }
+        }
+        else
+        {
+            report.mMaxDepth = ( depth > report.mMaxDepth ) ? depth : report.mMaxDepth;
+            report.mMaxDeferIDs = ( deferIDs > report.mMaxDeferIDs ) ? deferIDs : report.mMaxDeferIDs;
+        }
+
+        if ( 0 != pStateInfo->mTimeoutMs )
+        {
+            report.mMaxEvtID = ( pStateInfo->mTimeoutEvent > report.mMaxEvtID ) ? pStateInfo->mTimeoutEvent : report.mMaxEvtID;
+        }
+    }
+
+    // every row is known now
+    for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+    {
+        pStateInfo = pStates[ stateIdx ];
+
+        for ( idx = 0 ; idx < pStateInfo->mDeferEvtIDCount ; ++idx )
+        {
+            if ( FALSE == SM_VALIDATE_ID_TEST( pRowIDs, pStateInfo->mpDeferEvtIDs[ idx ] ) )
+            {
+                XLOGD_WARN( "Validate: %s defers e: %d, no state has a row for it" INFO_ST_NAME( pStateInfo ), pStateInfo->mpDeferEvtIDs[ idx ] );
+                ++report.mDeadDeferIDs;
+            }
+        }
+
+        if ( ( 0 != pStateInfo->mTimeoutMs ) && ( FALSE == _SmValidateHasRow( pStateInfo, pStateInfo->mTimeoutEvent, stateCount ) ) )
+        {
+            XLOGD_WARN( "Validate: %s timeout e: %d, the state has no row for it" INFO_ST_NAME( pStateInfo ), pStateInfo->mTimeoutEvent );
+            ++report.mDeadTimeouts;
+        }
+    }
+
+    for ( word = 0 ; word < SM_VALIDATE_ID_WORDS ; ++word )
+    {
+        report.mDeferIDCount += __builtin_popcount( pDeferIDs[ word ] );
+    }
+
+    for ( idx = 0 ; ( NULL != ppAllStates ) && ( ( UInt32 ) idx < allStateCount ) ; ++idx )
+    {
+        for ( stateIdx = 0 ; stateIdx < stateCount ; ++stateIdx )
+        {
+            if ( pStates[ stateIdx ] == ppAllStates[ idx ] )
+            {
+                break;
+            }
+        }
+        if ( stateIdx == stateCount )
+        {
+            XLOGD_WARN( "Validate: %s can not be reached" INFO_ST_NAME( ppAllStates[ idx ] ) );
+            ++report.mUnreachable;
+        }
+    }
+
+    // same limits as SmPackStateTable, and the next states have to be there
+    report.bPackable = ( ( stateCount < SM_PACKED_NONE ) && ( report.mRowCount <= 0xFFFF ) && ( 0 == report.mNullRows ) ) ? TRUE : FALSE;
+
+    problems = report.mShadowedRows + report.mNullRows + report.mDeadDeferIDs + report.mDeadTimeouts + report.mParentLoops + report.mUnreachable;
+
+    XLOGD_INFO( "Validate: %s, %u states, %u rows, e: %d, %u problems" INFO_ST_NAME( pInitialStateInfo ),
+                report.mStateCount, report.mRowCount, report.mMaxEvtID, problems );
+
+    free( pStates );
+    free( pRowIDs );
+
+    if ( NULL != pReport )
+    {
+        *pReport = report;
+    }
+
+    return ( 0 == problems ) ? TRUE : FALSE;
+}
@@ -0,0 +1,97 @@
+/*
+ ##########################################################################
+ # If not stated otherwise in this file or this component's LICENSE
+ # file the following copyright and licenses apply:
+ #
+ # Copyright 2019 RDK Management
+ #
+ # Licensed under the Apache License, Version 2.0 (the "License");
+ # you may not use this file except in compliance with the License.
+ # You may obtain a copy of the License at
+ #
+ # http://www.apache.org/licenses/LICENSE-2.0
+ #
+ # Unless required by applicable law or agreed to in writing, software
+ # distributed under the License is distributed on an "AS IS" BASIS,
+ # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ # See the License for the specific language governing permissions and
+ # limitations under the License.
+ ##########################################################################
+
+ File: xrpSMValidate.h
+ Descripton:
+ Static checks of the state tables.  SmValidateMachine walks the graph
+ from the initial state, the same way SmCompileStateTable and
+ SmPackStateTable do, and logs the tables that cost time or events
+ without anything going visibly wrong:
+   rows that are never tried, a row with the same event id and next
+   state as an earlier row, or after a row back to the state itself,
+   which takes the event without asking a guard
+   rows without a next state
+   deferred event ids that no state has a row for, they stay on the
+   deferred queue until it overflows
+   state timeouts whose event the state and its parents have no row for
+   parent links that lead back to the state
+   states of the client's list that can not be reached
+ It also returns the numbers to size the queues and the dispatch data
+ with.  Nothing is changed and no instance is needed, so it can run at
+ init or from a build time tool, xrpSMGen runs it on every spec.
+ */
+
+#ifndef XRP_SMVALIDATE_H_
+#define XRP_SMVALIDATE_H_
+
+#include "xrpSMEngine.h"
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _SmValidateReport
+{
+        // PROBLEMS, every one is also logged with the state it is in
+    UInt32          mShadowedRows;
+    UInt32          mNullRows;
+        // pairs of state and deferred event id no state has a row for
+    UInt32          mDeadDeferIDs;
+    UInt32          mDeadTimeouts;
+    UInt32          mParentLoops;
+    UInt32          mUnreachable;
+        // SIZING
+        // states that can be reached and their rows
+    UInt32          mStateCount;
+    UInt32          mRowCount;
+        // most rows of one state
+    UInt32          mMaxRows;
+        // highest event id of any row, defer list or state timeout
+    tStEventID      mMaxEvtID;
+        // most enclosing states of one state
+    UInt32          mMaxDepth;
+        // different event ids that are deferred, and the most entries of the
+        // defer lists of one state and its parents, a deferred queue smaller
+        // than that can overflow with each of them pending once
+    UInt32          mDeferIDCount;
+    UInt32          mMaxDeferIDs;
+        // TRUE if every deferred event id has a bit of its own in the
+        // deferred queue index, see SM_DEFER_INDEX_OTHER
+    BOOL            bDeferIndexExact;
+        // bytes SmCompileStateTable allocates, and the states it leaves to
+        // the linear scans
+    size_t          mDispatchBytes;
+    UInt32          mScannedStates;
+        // TRUE if SmPackStateTable and SmWriteTableImage take the machine
+    BOOL            bPackable;
+} tSmValidateReport;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C" {
+#endif
+BOOL SmValidateMachine( tStateInfo *pInitialStateInfo, tStateInfo * const *ppAllStates, UInt32 allStateCount, tSmValidateReport *pReport );
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,958 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+   File: xrpSMGen.c
+   Descripton:
+   State table generator.  Reads a compact description of a state machine
+   and writes the C tables for it, so the tStateGuard arrays, their counts
+   and the defer lists are no longer written by hand.  The tables come out
+   the way SmCompileStateTable would build them, the next state rows of a
+   state sorted by event id, in declared order within an event id, with
+   const dispatch data, so SmCompileStateTable has nothing left to do and
+   nothing is allocated at run time.
+   Usage:
+    xrpSMGen <spec> <out>
+   writes <out>.h with the event ids and the state declarations and <out>.c
+   with the tables.  The state functions are written by the client, named
+   after the states as with STATE_DECLARE.
+   Before anything is written the spec is checked with SmValidateMachine,
+   the first state taken as the initial state, the problems are printed as
+   warnings and <out>.h gets the sizes of tSmValidateReport, e.g.
+   XRP_SMGEN_<OUT>_MAX_DEFER_IDS, to size the queues with.
+   The spec has one statement per line, of at most 510 characters and 32
+   words, # starts a comment:
+    event <NAME> [= <value>]
+     an event id, numbered from 0 or from the previous one unless a value
+     is given
+    state <Name> [parent <Name>] [timeout <ms> <EVENT>] [pure]
+     a state, with its enclosing state, state timeout and SM_STATE_PURE_GUARD,
+     see tStateInfo
+    on <EVENT> <Next>
+     a next state row of the state above, a row back to the state itself
+     is an internal transition
+    defer <EVENT> [<EVENT> ...]
+     event ids the state above allows to be deferred
+   For example:
+    event EVT_PRESS
+    event EVT_RELEASE
+    event EVT_TMR_HOLD
+    state St_Idle
+     on EVT_PRESS St_Press
+    state St_Press timeout 500 EVT_TMR_HOLD
+     on EVT_RELEASE St_Idle
+     on EVT_TMR_HOLD St_Hold
+    state St_Hold
+     on EVT_RELEASE St_Idle
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xrpSMEngine.h"
+#include "xrpSMValidate.h"
+
+//-------------------------------------------------------------------------------
+// Macros
+//-------------------------------------------------------------------------------
+
+#define GEN_MAX_LINE                     512
+#define GEN_MAX_WORDS                    32
+
+//-------------------------------------------------------------------------------
+// Typedefs
+//-------------------------------------------------------------------------------
+
+typedef struct _GenEvent
+{
+    char            *mpName;
+    UInt32          mID;
+} tGenEvent;
+
+typedef struct _GenRow
+{
+    int             mEvent;
+    int             mNextState;
+} tGenRow;
+
+typedef struct _GenState
+{
+    char            *mpName;
+    int             mParent;
+    char            *mpParentName;
+    UInt32          mTimeoutMs;
+    BOOL            bPureGuard;
+    int             mTimeoutEvent;
+    tGenRow         *mpRows;
+    int             mRowCount;
+    char            **mppRowStates;
+    int             *mpDefers;
+    int             mDeferCount;
+    int             mLine;
+} tGenState;
+
+typedef struct _GenSpec
+{
+    const char      *mpFileName;
+    tGenEvent       *mpEvents;
+    int             mEventCount;
+    tGenState       *mpStates;
+    int             mStateCount;
+        // from _GenValidate
+    tSmValidateReport mReport;
+} tGenSpec;
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+void *_GenGrow( void *pList, int count, size_t size );
+int _GenFindEvent( tGenSpec *pSpec, const char *pName );
+int _GenFindState( tGenSpec *pSpec, const char *pName );
+BOOL _GenParse( tGenSpec *pSpec, FILE *pFile );
+BOOL _GenResolve( tGenSpec *pSpec );
+void _GenSortRows( tGenSpec *pSpec, tGenState *pState );
+void _GenValidate( tGenSpec *pSpec );
+void _GenWriteName( FILE *pFile, const char *pBase, const char *pSuffix );
+void _GenWriteSeparator( FILE *pFile, UInt32 idx, UInt32 perLine );
+BOOL _GenWriteHeader( tGenSpec *pSpec, const char *pOut );
+BOOL _GenWriteTables( tGenSpec *pSpec, const char *pOut );
+void _GenWriteState( tGenSpec *pSpec, FILE *pFile, tGenState *pState );
+
+/*********************************************************************
+ *
+ * Make room for one more entry at the end of a list, exits when out
+ * of memory.
+ *
+ * Parameters:
+ *  pList - the list, NULL for a new one
+ *  count - entries in the list
+ *  size - size of one entry
+ *
+ * Returns:
+ *  the list, with count + 1 entries
+ *
+ *********************************************************************/
+void *_GenGrow( void *pList, int count, size_t size )
+{
+    pList = realloc( pList, ( count + 1 ) * size );
+    if ( NULL == pList )
+    {
+        fprintf( stderr, "xrpSMGen: out of memory\n" );
+        exit( 1 );
+    }
+
+    memset( ( char * ) pList + ( count * size ), 0, size );
+
+    return pList;
+}
+
+/*********************************************************************
+ *
+ * Look up an event by name.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pName - event name
+ *
+ * Returns:
+ *  the index of the event, -1 if there is none
+ *
+ *********************************************************************/
+int _GenFindEvent( tGenSpec *pSpec, const char *pName )
+{
+    int idx;
+
+    for ( idx = 0 ; idx < pSpec->mEventCount ; ++idx )
+    {
+        if ( 0 == strcmp( pSpec->mpEvents[ idx ].mpName, pName ) )
+        {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+/*********************************************************************
+ *
+ * Look up a state by name.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pName - state name
+ *
+ * Returns:
+ *  the index of the state, -1 if there is none
+ *
+ *********************************************************************/
+int _GenFindState( tGenSpec *pSpec, const char *pName )
+{
+    int idx;
+
+    for ( idx = 0 ; idx < pSpec->mStateCount ; ++idx )
+    {
+        if ( 0 == strcmp( pSpec->mpStates[ idx ].mpName, pName ) )
+        {
+            return idx;
+        }
+    }
+
+    return -1;
+}
+
+/*********************************************************************
+ *
+ * Read the spec.  States may be used before they are declared, they
+ * are resolved by _GenResolve, events must be declared first.
+ *
+ * Parameters:
+ *  pSpec - the spec to fill in
+ *  pFile - the spec file
+ *
+ * Returns:
+ *  TRUE, if the spec was read
+ *  FALSE, an error was printed
+ *
+ *********************************************************************/
+BOOL _GenParse( tGenSpec *pSpec, FILE *pFile )
+{
+    char line[ GEN_MAX_LINE ];
+    char *pWords[ GEN_MAX_WORDS ];
+    char *pWord, *pComment;
+    int wordCount, lineNo = 0, idx, event, next;
+    UInt32 nextID = 0;
+    tGenState *pState = NULL;
+
+    while ( NULL != fgets( line, sizeof( line ), pFile ) )
+    {
+        ++lineNo;
+
+        if ( NULL == strchr( line, '\n' ) )
+        {   // no newline, either the last line of the file or one that did not fit
+            next = getc( pFile );
+            if ( EOF != next )
+            {
+                fprintf( stderr, "%s:%d: line longer than %d characters\n", pSpec->mpFileName, lineNo, GEN_MAX_LINE - 2 );
+                return FALSE;
+            }
+        }
+
+        pComment = strchr( line, '#' );
+        if ( NULL != pComment )
+        {
+            *pComment = '\0';
+        }
+
+        wordCount = 0;
+        for ( pWord = strtok( line, " \t\r\n" ) ; NULL != pWord ; pWord = strtok( NULL, " \t\r\n" ) )
+        {
+            if ( GEN_MAX_WORDS == wordCount )
+            {
+                fprintf( stderr, "%s:%d: more than %d words\n", pSpec->mpFileName, lineNo, GEN_MAX_WORDS );
+                return FALSE;
+            }
+            pWords[ wordCount++ ] = pWord;
+        }
+
+        if ( 0 == wordCount )
+        {
+            continue;
+        }
+
+        if ( 0 == strcmp( pWords[ 0 ], "event" ) )
+        {
+            if ( ( ( 2 != wordCount ) && ( 4 != wordCount ) ) || ( ( 4 == wordCount ) && ( 0 != strcmp( pWords[ 2 ], "=" ) ) ) )
+            {
+                fprintf( stderr, "%s:%d: expected event <NAME> [= <value>]\n", pSpec->mpFileName, lineNo );
+                return FALSE;
+            }
+            if ( -1 != _GenFindEvent( pSpec, pWords[ 1 ] ) )
+            {
+                fprintf( stderr, "%s:%d: event %s declared twice\n", pSpec->mpFileName, lineNo, pWords[ 1 ] );
+                return FALSE;
+            }
+            if ( 4 == wordCount )
+            {
+                nextID = ( UInt32 ) strtoul( pWords[ 3 ], NULL, 0 );
+            }
+            if ( nextID > 0xFFFF )
+            {
+                fprintf( stderr, "%s:%d: event %s does not fit a tStEventID\n", pSpec->mpFileName, lineNo, pWords[ 1 ] );
+                return FALSE;
+            }
+            pSpec->mpEvents = ( tGenEvent * ) _GenGrow( pSpec->mpEvents, pSpec->mEventCount, sizeof( tGenEvent ) );
+            pSpec->mpEvents[ pSpec->mEventCount ].mpName = strdup( pWords[ 1 ] );
+            pSpec->mpEvents[ pSpec->mEventCount ].mID = nextID++;
+            ++pSpec->mEventCount;
+        }
+        else if ( 0 == strcmp( pWords[ 0 ], "state" ) )
+        {
+            if ( wordCount < 2 )
+            {
+                fprintf( stderr, "%s:%d: expected state <Name> [parent <Name>] [timeout <ms> <EVENT>] [pure]\n", pSpec->mpFileName, lineNo );
+                return FALSE;
+            }
+            if ( -1 != _GenFindState( pSpec, pWords[ 1 ] ) )
+            {
+                fprintf( stderr, "%s:%d: state %s declared twice\n", pSpec->mpFileName, lineNo, pWords[ 1 ] );
+                return FALSE;
+            }
+            pSpec->mpStates = ( tGenState * ) _GenGrow( pSpec->mpStates, pSpec->mStateCount, sizeof( tGenState ) );
+            pState = &pSpec->mpStates[ pSpec->mStateCount++ ];
+            pState->mpName = strdup( pWords[ 1 ] );
+            pState->mParent = -1;
+            pState->mTimeoutEvent = -1;
+            pState->mLine = lineNo;
+
+            for ( idx = 2 ; idx < wordCount ; )
+            {
+                if ( ( 0 == strcmp( pWords[ idx ], "parent" ) ) && ( idx + 1 < wordCount ) )
+                {
+                    pState->mpParentName = strdup( pWords[ idx + 1 ] );
+                    idx += 2;
+                }
+                else if ( ( 0 == strcmp( pWords[ idx ], "timeout" ) ) && ( idx + 2 < wordCount ) )
+                {
+                    pState->mTimeoutMs = ( UInt32 ) strtoul( pWords[ idx + 1 ], NULL, 0 );
+                    pState->mTimeoutEvent = _GenFindEvent( pSpec, pWords[ idx + 2 ] );
+                    if ( ( 0 == pState->mTimeoutMs ) || ( -1 == pState->mTimeoutEvent ) )
+                    {
+                        fprintf( stderr, "%s:%d: bad timeout, expected timeout <ms> <EVENT>\n", pSpec->mpFileName, lineNo );
+                        return FALSE;
+                    }
+                    idx += 3;
+                }
+                else if ( 0 == strcmp( pWords[ idx ], "pure" ) )
+                {
+                    pState->bPureGuard = TRUE;
+                    ++idx;
+                }
+                else
+                {
+                    fprintf( stderr, "%s:%d: expected state <Name> [parent <Name>] [timeout <ms> <EVENT>] [pure]\n", pSpec->mpFileName, lineNo );
+                    return FALSE;
+                }
+            }
+        }
+        else if ( ( 0 == strcmp( pWords[ 0 ], "on" ) ) || ( 0 == strcmp( pWords[ 0 ], "defer" ) ) )
+        {
+            if ( NULL == pState )
+            {
+                fprintf( stderr, "%s:%d: %s before the first state\n", pSpec->mpFileName, lineNo, pWords[ 0 ] );
+                return FALSE;
+            }
+            if ( ( 0 == strcmp( pWords[ 0 ], "on" ) ) && ( 3 != wordCount ) )
+            {
+                fprintf( stderr, "%s:%d: expected on <EVENT> <Next>\n", pSpec->mpFileName, lineNo );
+                return FALSE;
+            }
+            for ( idx = 1 ; idx < ( ( 'o' == pWords[ 0 ][ 0 ] ) ? 2 : wordCount ) ; ++idx )
+            {
+                event = _GenFindEvent( pSpec, pWords[ idx ] );
+                if ( -1 == event )
+                {
+                    fprintf( stderr, "%s:%d: unknown event %s\n", pSpec->mpFileName, lineNo, pWords[ idx ] );
+                    return FALSE;
+                }
+                if ( 'o' == pWords[ 0 ][ 0 ] )
+                {
+                    pState->mpRows = ( tGenRow * ) _GenGrow( pState->mpRows, pState->mRowCount, sizeof( tGenRow ) );
+                    pState->mppRowStates = ( char ** ) _GenGrow( pState->mppRowStates, pState->mRowCount, sizeof( char * ) );
+                    pState->mpRows[ pState->mRowCount ].mEvent = event;
+                    pState->mppRowStates[ pState->mRowCount ] = strdup( pWords[ 2 ] );
+                    ++pState->mRowCount;
+                }
+                else
+                {
+                    pState->mpDefers = ( int * ) _GenGrow( pState->mpDefers, pState->mDeferCount, sizeof( int ) );
+                    pState->mpDefers[ pState->mDeferCount++ ] = event;
+                }
+            }
+        }
+        else
+        {
+            fprintf( stderr, "%s:%d: unknown statement %s\n", pSpec->mpFileName, lineNo, pWords[ 0 ] );
+            return FALSE;
+        }
+    }
+
+    if ( 0 == pSpec->mStateCount )
+    {
+        fprintf( stderr, "%s: no states\n", pSpec->mpFileName );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Look up the state names used by the rows and parents, and check the
+ * limits of the tables.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *
+ * Returns:
+ *  TRUE, if every name is a state
+ *  FALSE, an error was printed
+ *
+ *********************************************************************/
+BOOL _GenResolve( tGenSpec *pSpec )
+{
+    tGenState *pState;
+    int stateIdx, idx, parent;
+
+    for ( stateIdx = 0 ; stateIdx < pSpec->mStateCount ; ++stateIdx )
+    {
+        pState = &pSpec->mpStates[ stateIdx ];
+
+        if ( ( pState->mRowCount > SM_MAX_STATE_COUNT ) || ( pState->mDeferCount > SM_MAX_STATE_COUNT ) )
+        {
+            fprintf( stderr, "%s:%d: %s has more than %d rows or defers\n", pSpec->mpFileName, pState->mLine, pState->mpName, SM_MAX_STATE_COUNT );
+            return FALSE;
+        }
+
+        for ( idx = 0 ; idx < pState->mRowCount ; ++idx )
+        {
+            pState->mpRows[ idx ].mNextState = _GenFindState( pSpec, pState->mppRowStates[ idx ] );
+            if ( -1 == pState->mpRows[ idx ].mNextState )
+            {
+                fprintf( stderr, "%s:%d: %s goes to unknown state %s\n", pSpec->mpFileName, pState->mLine, pState->mpName, pState->mppRowStates[ idx ] );
+                return FALSE;
+            }
+        }
+
+        if ( NULL != pState->mpParentName )
+        {
+            pState->mParent = _GenFindState( pSpec, pState->mpParentName );
+            if ( -1 == pState->mParent )
+            {
+                fprintf( stderr, "%s:%d: %s has unknown parent %s\n", pSpec->mpFileName, pState->mLine, pState->mpName, pState->mpParentName );
+                return FALSE;
+            }
+        }
+    }
+
+    // a parent loop would hang the engine
+    for ( stateIdx = 0 ; stateIdx < pSpec->mStateCount ; ++stateIdx )
+    {
+        idx = 0;
+        for ( parent = pSpec->mpStates[ stateIdx ].mParent ; -1 != parent ; parent = pSpec->mpStates[ parent ].mParent )
+        {
+            if ( ++idx > pSpec->mStateCount )
+            {
+                fprintf( stderr, "%s:%d: %s is in a parent loop\n", pSpec->mpFileName, pSpec->mpStates[ stateIdx ].mLine, pSpec->mpStates[ stateIdx ].mpName );
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Sort the rows of a state by event id, keeping the declared order
+ * of the rows with the same event id, they are tried in that order.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pState - the state
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _GenSortRows( tGenSpec *pSpec, tGenState *pState )
+{
+    tGenRow row;
+    int idx, pos;
+
+    // insertion sort is stable and the lists are short
+    for ( idx = 1 ; idx < pState->mRowCount ; ++idx )
+    {
+        row = pState->mpRows[ idx ];
+        for ( pos = idx ; ( pos > 0 ) && ( pSpec->mpEvents[ pState->mpRows[ pos - 1 ].mEvent ].mID > pSpec->mpEvents[ row.mEvent ].mID ) ; --pos )
+        {
+            pState->mpRows[ pos ] = pState->mpRows[ pos - 1 ];
+        }
+        pState->mpRows[ pos ] = row;
+    }
+}
+
+/*********************************************************************
+ *
+ * Build the tStateInfo of the spec in memory and check them with
+ * SmValidateMachine, the first state is the initial state.  The states
+ * have no entry points, only the tables are looked at.  The problems
+ * are warnings, the tables are written anyway.
+ *
+ * Parameters:
+ *  pSpec - the resolved spec, gets the report
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _GenValidate( tGenSpec *pSpec )
+{
+    tStateInfo *pInfos, **ppAll;
+    tGenState *pState;
+    UInt32 problems;
+    int stateIdx, idx;
+
+    if ( 0 == pSpec->mStateCount )
+    {
+        return;
+    }
+
+    pInfos = ( tStateInfo * ) calloc( pSpec->mStateCount, sizeof( tStateInfo ) );
+    ppAll = ( tStateInfo ** ) calloc( pSpec->mStateCount, sizeof( tStateInfo * ) );
+    if ( ( NULL == pInfos ) || ( NULL == ppAll ) )
+    {
+        fprintf( stderr, "xrpSMGen: out of memory\n" );
+        exit( 1 );
+    }
+
+    for ( stateIdx = 0 ; stateIdx < pSpec->mStateCount ; ++stateIdx )
+    {
+        pState = &pSpec->mpStates[ stateIdx ];
+#if ( ( ( ( DGB_ENABLED_MODULES ) & DBG_MODULE_SM_ENGINE ) && ( DBG_LEVEL_SM_ENGINE >= DBG_MODULE_LEVEL ) ) || defined( RDK ) )
+        pInfos[ stateIdx ].mStateName = pState->mpName;
+#endif
+        pInfos[ stateIdx ].mNextStCount = ( tStateCount ) pState->mRowCount;
+        pInfos[ stateIdx ].mpNextStates = ( tStateGuard * ) calloc( pState->mRowCount + 1, sizeof( tStateGuard ) );
+        pInfos[ stateIdx ].mDeferEvtIDCount = ( tStateCount ) pState->mDeferCount;
+        pInfos[ stateIdx ].mpDeferEvtIDs = ( tStEventID * ) calloc( pState->mDeferCount + 1, sizeof( tStEventID ) );
+        if ( ( NULL == pInfos[ stateIdx ].mpNextStates ) || ( NULL == pInfos[ stateIdx ].mpDeferEvtIDs ) )
+        {
+            fprintf( stderr, "xrpSMGen: out of memory\n" );
+            exit( 1 );
+        }
+        for ( idx = 0 ; idx < pState->mRowCount ; ++idx )
+        {
+            pInfos[ stateIdx ].mpNextStates[ idx ].mID = ( tStEventID ) pSpec->mpEvents[ pState->mpRows[ idx ].mEvent ].mID;
+            pInfos[ stateIdx ].mpNextStates[ idx ].mStInfo = &pInfos[ pState->mpRows[ idx ].mNextState ];
+        }
+        for ( idx = 0 ; idx < pState->mDeferCount ; ++idx )
+        {
+            pInfos[ stateIdx ].mpDeferEvtIDs[ idx ] = ( tStEventID ) pSpec->mpEvents[ pState->mpDefers[ idx ] ].mID;
+        }
+        pInfos[ stateIdx ].mpParent = ( -1 != pState->mParent ) ? &pInfos[ pState->mParent ] : NULL;
+        pInfos[ stateIdx ].mTimeoutMs = pState->mTimeoutMs;
+        if ( 0 != pState->mTimeoutMs )
+        {
+            pInfos[ stateIdx ].mTimeoutEvent = ( tStEventID ) pSpec->mpEvents[ pState->mTimeoutEvent ].mID;
+        }
+        ppAll[ stateIdx ] = &pInfos[ stateIdx ];
+    }
+
+    if ( FALSE == SmValidateMachine( &pInfos[ 0 ], ppAll, ( UInt32 ) pSpec->mStateCount, &pSpec->mReport ) )
+    {
+        problems = pSpec->mReport.mShadowedRows + pSpec->mReport.mNullRows + pSpec->mReport.mDeadDeferIDs +
+                   pSpec->mReport.mDeadTimeouts + pSpec->mReport.mParentLoops + pSpec->mReport.mUnreachable;
+        fflush( stdout );
+        fprintf( stderr, "\n%s: warning, %u problems in the tables\n", pSpec->mpFileName, problems );
+    }
+
+    // the process ends soon, the tables are not freed
+}
+
+/*********************************************************************
+ *
+ * Write a name of <out>.h, XRP_SMGEN_<OUT><suffix> with every
+ * character that can not be in a name turned into _.
+ *
+ * Parameters:
+ *  pFile - <out>.h
+ *  pBase - file name of the output without the directory
+ *  pSuffix - end of the name, e.g. _H_ for the include guard
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _GenWriteName( FILE *pFile, const char *pBase, const char *pSuffix )
+{
+    fprintf( pFile, "XRP_SMGEN_" );
+    for ( ; '\0' != *pBase ; ++pBase )
+    {
+        if ( ( *pBase >= 'a' ) && ( *pBase <= 'z' ) )
+        {
+            fputc( *pBase - 'a' + 'A', pFile );
+        }
+        else if ( ( ( *pBase >= 'A' ) && ( *pBase <= 'Z' ) ) || ( ( *pBase >= '0' ) && ( *pBase <= '9' ) ) )
+        {
+            fputc( *pBase, pFile );
+        }
+        else
+        {
+            fputc( '_', pFile );
+        }
+    }
+    fprintf( pFile, "%s", pSuffix );
+}
+
+/*********************************************************************
+ *
+ * Write <out>.h, the event ids and the state declarations.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pOut - output path without the extension
+ *
+ * Returns:
+ *  TRUE, if the file was written
+ *  FALSE, an error was printed
+ *
+ *********************************************************************/
+BOOL _GenWriteHeader( tGenSpec *pSpec, const char *pOut )
+{
+    char path[ GEN_MAX_LINE ];
+    const char *pBase;
+    FILE *pFile;
+    int idx;
+
+    snprintf( path, sizeof( path ), "%s.h", pOut );
+    pFile = fopen( path, "w" );
+    if ( NULL == pFile )
+    {
+        fprintf( stderr, "xrpSMGen: can not write %s\n", path );
+        return FALSE;
+    }
+
+    pBase = strrchr( pOut, '/' );
+    pBase = ( NULL == pBase ) ? pOut : pBase + 1;
+
+    fprintf( pFile, "// generated by xrpSMGen from %s, do not edit\n\n", pSpec->mpFileName );
+    fprintf( pFile, "#ifndef " );
+    _GenWriteName( pFile, pBase, "_H_" );
+    fprintf( pFile, "\n#define " );
+    _GenWriteName( pFile, pBase, "_H_" );
+    fprintf( pFile, "\n\n#include \"xrpSMEngine.h\"\n\n" );
+
+    fprintf( pFile, "// sizes from SmValidateMachine, see tSmValidateReport\n" );
+    fprintf( pFile, "#define " );
+    _GenWriteName( pFile, pBase, "_STATE_COUNT" );
+    fprintf( pFile, " %u\n#define ", pSpec->mReport.mStateCount );
+    _GenWriteName( pFile, pBase, "_MAX_EVT_ID" );
+    fprintf( pFile, " %u\n#define ", pSpec->mReport.mMaxEvtID );
+    _GenWriteName( pFile, pBase, "_MAX_DEPTH" );
+    fprintf( pFile, " %u\n#define ", pSpec->mReport.mMaxDepth );
+    _GenWriteName( pFile, pBase, "_DEFER_ID_COUNT" );
+    fprintf( pFile, " %u\n#define ", pSpec->mReport.mDeferIDCount );
+    _GenWriteName( pFile, pBase, "_MAX_DEFER_IDS" );
+    fprintf( pFile, " %u\n\n", pSpec->mReport.mMaxDeferIDs );
+
+    if ( 0 != pSpec->mEventCount )
+    {
+        fprintf( pFile, "enum\n{\n" );
+        for ( idx = 0 ; idx < pSpec->mEventCount ; ++idx )
+        {
+            fprintf( pFile, "    %s = %u,\n", pSpec->mpEvents[ idx ].mpName, pSpec->mpEvents[ idx ].mID );
+        }
+        fprintf( pFile, "};\n\n" );
+    }
+
+    fprintf( pFile, "#ifdef __cplusplus\nextern \"C\" {\n#endif\n" );
+    for ( idx = 0 ; idx < pSpec->mStateCount ; ++idx )
+    {
+        fprintf( pFile, "void %s( tStateEvent *pEvent, eStateAction eAction, BOOL *bGuardRespone );\n", pSpec->mpStates[ idx ].mpName );
+        fprintf( pFile, "extern tStateInfo %s_Info;\n", pSpec->mpStates[ idx ].mpName );
+    }
+    fprintf( pFile, "#ifdef __cplusplus\n}\n#endif\n\n#endif\n" );
+
+    if ( 0 != fclose( pFile ) )
+    {
+        fprintf( stderr, "xrpSMGen: can not write %s\n", path );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/*********************************************************************
+ *
+ * Start the next value of an initializer list that is broken into
+ * lines of perLine values.
+ *
+ * Parameters:
+ *  pFile - <out>.c
+ *  idx - index of the value
+ *  perLine - values per line
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _GenWriteSeparator( FILE *pFile, UInt32 idx, UInt32 perLine )
+{
+    if ( 0 != ( idx % perLine ) )
+    {
+        fprintf( pFile, ", " );
+    }
+    else
+    {
+        fprintf( pFile, "%s\n    ", ( 0 == idx ) ? "" : "," );
+    }
+}
+
+/*********************************************************************
+ *
+ * Write the tables of one state.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pFile - <out>.c
+ *  pState - the state, rows sorted
+ *
+ * Returns:
+ *  none
+ *
+ *********************************************************************/
+void _GenWriteState( tGenSpec *pSpec, FILE *pFile, tGenState *pState )
+{
+    UInt32 maxEvtID = 0, evtID, word;
+    uint64_t rowMask = 0, deferMask = 0;
+    UInt32 *pDeferBits;
+    int idx, rangeStart;
+    BOOL bDispatch;
+
+    for ( idx = 0 ; idx < pState->mRowCount ; ++idx )
+    {
+        evtID = pSpec->mpEvents[ pState->mpRows[ idx ].mEvent ].mID;
+        maxEvtID = ( evtID > maxEvtID ) ? evtID : maxEvtID;
+        rowMask |= SM_DEFER_INDEX_BIT( evtID );
+    }
+    for ( idx = 0 ; idx < pState->mDeferCount ; ++idx )
+    {
+        evtID = pSpec->mpEvents[ pState->mpDefers[ idx ] ].mID;
+        maxEvtID = ( evtID > maxEvtID ) ? evtID : maxEvtID;
+        if ( evtID < SM_DEFER_INDEX_OTHER )
+        {
+            deferMask |= SM_DEFER_INDEX_BIT( evtID );
+        }
+    }
+
+    bDispatch = ( maxEvtID <= SM_DISPATCH_MAX_EVT_ID ) ? TRUE : FALSE;
+    if ( FALSE == bDispatch )
+    {   // same as SmCompileStateTable
+        fprintf( stderr, "%s:%d: warning, %s uses e: %u, not compiled\n", pSpec->mpFileName, pState->mLine, pState->mpName, maxEvtID );
+    }
+
+    fprintf( pFile, "// %s\n", pState->mpName );
+
+    if ( 0 != pState->mRowCount )
+    {
+        fprintf( pFile, "static tStateGuard %s_NextStates[] =\n{\n", pState->mpName );
+        for ( idx = 0 ; idx < pState->mRowCount ; ++idx )
+        {
+            fprintf( pFile, "    { %s, &%s_Info },\n", pSpec->mpEvents[ pState->mpRows[ idx ].mEvent ].mpName, pSpec->mpStates[ pState->mpRows[ idx ].mNextState ].mpName );
+        }
+        fprintf( pFile, "};\n" );
+    }
+
+    if ( 0 != pState->mDeferCount )
+    {
+        fprintf( pFile, "static tStEventID %s_DeferEvtIDs[] = {", pState->mpName );
+        for ( idx = 0 ; idx < pState->mDeferCount ; ++idx )
+        {
+            fprintf( pFile, "%s %s", ( 0 == idx ) ? "" : ",", pSpec->mpEvents[ pState->mpDefers[ idx ] ].mpName );
+        }
+        fprintf( pFile, " };\n" );
+    }
+
+    if ( TRUE == bDispatch )
+    {
+        pDeferBits = ( UInt32 * ) calloc( ( maxEvtID >> 5 ) + 1, sizeof( UInt32 ) );
+        if ( NULL == pDeferBits )
+        {
+            fprintf( stderr, "xrpSMGen: out of memory\n" );
+            exit( 1 );
+        }
+        for ( idx = 0 ; idx < pState->mDeferCount ; ++idx )
+        {
+            evtID = pSpec->mpEvents[ pState->mpDefers[ idx ] ].mID;
+            pDeferBits[ evtID >> 5 ] |= ( UInt32 ) 1 << ( evtID & 31 );
+        }
+        fprintf( pFile, "static const UInt32 %s_DeferBits[] =\n{", pState->mpName );
+        for ( word = 0 ; word <= ( maxEvtID >> 5 ) ; ++word )
+        {
+            _GenWriteSeparator( pFile, word, 8 );
+            fprintf( pFile, "0x%08x", pDeferBits[ word ] );
+        }
+        fprintf( pFile, "\n};\n" );
+        free( pDeferBits );
+
+        // the rows are sorted, so the start of an event id is the number of rows below it
+        fprintf( pFile, "static const tStateCount %s_RangeStart[] =\n{", pState->mpName );
+        rangeStart = 0;
+        for ( evtID = 0 ; evtID <= maxEvtID + 1 ; ++evtID )
+        {
+            while ( ( rangeStart < pState->mRowCount ) && ( pSpec->mpEvents[ pState->mpRows[ rangeStart ].mEvent ].mID < evtID ) )
+            {
+                ++rangeStart;
+            }
+            _GenWriteSeparator( pFile, evtID, 16 );
+            fprintf( pFile, "%d", rangeStart );
+        }
+        fprintf( pFile, "\n};\n" );
+
+        if ( 0 != pState->mRowCount )
+        {
+            fprintf( pFile, "static const tStateCount %s_GuardIdx[] = {", pState->mpName );
+            for ( idx = 0 ; idx < pState->mRowCount ; ++idx )
+            {
+                fprintf( pFile, "%s %d", ( 0 == idx ) ? "" : ",", idx );
+            }
+            fprintf( pFile, " };\n" );
+        }
+
+        fprintf( pFile, "static const tStateDispatch %s_Dispatch = { %u, FALSE, %s_RangeStart, %s%s, %s_DeferBits, 0x%016llxULL, 0x%016llxULL };\n",
+                 pState->mpName, maxEvtID, pState->mpName, ( 0 != pState->mRowCount ) ? pState->mpName : "NULL", ( 0 != pState->mRowCount ) ? "_GuardIdx" : "",
+                 pState->mpName, ( unsigned long long ) rowMask, ( unsigned long long ) deferMask );
+    }
+
+    fprintf( pFile, "tStateInfo %s_Info = { SHOW_ST_NAME( \"%s\" ) %s, %d, ", pState->mpName, pState->mpName, pState->mpName, pState->mRowCount );
+    if ( 0 != pState->mRowCount )
+    {
+        fprintf( pFile, "%s_NextStates, ", pState->mpName );
+    }
+    else
+    {
+        fprintf( pFile, "NULL, " );
+    }
+    fprintf( pFile, "%d, ", pState->mDeferCount );
+    if ( 0 != pState->mDeferCount )
+    {
+        fprintf( pFile, "%s_DeferEvtIDs, ", pState->mpName );
+    }
+    else
+    {
+        fprintf( pFile, "NULL, " );
+    }
+    if ( TRUE == bDispatch )
+    {
+        fprintf( pFile, "&%s_Dispatch, ", pState->mpName );
+    }
+    else
+    {
+        fprintf( pFile, "NULL, " );
+    }
+    if ( -1 != pState->mParent )
+    {
+        fprintf( pFile, "&%s_Info, ", pSpec->mpStates[ pState->mParent ].mpName );
+    }
+    else
+    {
+        fprintf( pFile, "NULL, " );
+    }
+    fprintf( pFile, "%u, %s, %s };\n\n", pState->mTimeoutMs, ( -1 != pState->mTimeoutEvent ) ? pSpec->mpEvents[ pState->mTimeoutEvent ].mpName : "0",
+             ( TRUE == pState->bPureGuard ) ? "SM_STATE_PURE_GUARD" : "0" );
+}
+
+/*********************************************************************
+ *
+ * Write <out>.c, the tables of every state.
+ *
+ * Parameters:
+ *  pSpec - the spec
+ *  pOut - output path without the extension
+ *
+ * Returns:
+ *  TRUE, if the file was written
+ *  FALSE, an error was printed
+ *
+ *********************************************************************/
+BOOL _GenWriteTables( tGenSpec *pSpec, const char *pOut )
+{
+    char path[ GEN_MAX_LINE ];
+    const char *pBase;
+    FILE *pFile;
+    int idx;
+
+    snprintf( path, sizeof( path ), "%s.c", pOut );
+    pFile = fopen( path, "w" );
+    if ( NULL == pFile )
+    {
+        fprintf( stderr, "xrpSMGen: can not write %s\n", path );
+        return FALSE;
+    }
+
+    pBase = strrchr( pOut, '/' );
+    pBase = ( NULL == pBase ) ? pOut : pBase + 1;
+
+    fprintf( pFile, "// generated by xrpSMGen from %s, do not edit\n\n#include \"%s.h\"\n\n", pSpec->mpFileName, pBase );
+
+    for ( idx = 0 ; idx < pSpec->mStateCount ; ++idx )
+    {
+        _GenSortRows( pSpec, &pSpec->mpStates[ idx ] );
+        _GenWriteState( pSpec, pFile, &pSpec->mpStates[ idx ] );
+    }
+
+    if ( 0 != fclose( pFile ) )
+    {
+        fprintf( stderr, "xrpSMGen: can not write %s\n", path );
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+int main( int argc, char *argv[] )
+{
+    tGenSpec spec;
+    FILE *pFile;
+    BOOL bOk;
+
+    if ( 3 != argc )
+    {
+        fprintf( stderr, "usage: xrpSMGen <spec> <out>, writes <out>.h and <out>.c\n" );
+        return 2;
+    }
+
+    memset( &spec, 0, sizeof( spec ) );
+    spec.mpFileName = argv[ 1 ];
+
+    pFile = fopen( argv[ 1 ], "r" );
+    if ( NULL == pFile )
+    {
+        fprintf( stderr, "xrpSMGen: can not read %s\n", argv[ 1 ] );
+        return 1;
+    }
+    bOk = _GenParse( &spec, pFile );
+    fclose( pFile );
+
+    if ( ( FALSE == bOk ) || ( FALSE == _GenResolve( &spec ) ) )
+    {
+        return 1;
+    }
+
+    _GenValidate( &spec );
+
+    if ( ( FALSE == _GenWriteHeader( &spec, argv[ 2 ] ) ) || ( FALSE == _GenWriteTables( &spec, argv[ 2 ] ) ) )
+    {
+        return 1;
+    }
+
+    // the process ends here, the spec is not freed
+    return 0;
+}
@@ -0,0 +1,230 @@
+  /*
+   ##########################################################################
+   # If not stated otherwise in this file or this component's LICENSE
+   # file the following copyright and licenses apply:
+   #
+   # Copyright 2019 RDK Management
+   #
+   # Licensed under the Apache License, Version 2.0 (the "License");
+   # you may not use this file except in compliance with the License.
+   # You may obtain a copy of the License at
+   #
+   # http://www.apache.org/licenses/LICENSE-2.0
+   #
+   # Unless required by applicable law or agreed to in writing, software
+   # distributed under the License is distributed on an "AS IS" BASIS,
+   # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   # See the License for the specific language governing permissions and
+   # limitations under the License.
+   ##########################################################################
+
+   File: xrpSMTraceDecode.c
+   Descripton:
+   Host side decoder for the snapshots taken with SmTraceSnapshot, see
+   xrpSMTrace.h.  Prints one line per record, the time since the first
+   record, the state name, the action, the event id and for ACT_GUARD
+   whether the guard accepted the event.  Snapshots from a target with
+   the other byte order are swapped.
+   Usage:
+    xrpSMTraceDecode <snapshot>
+   For example:
+         0.000000 ms  St_Idle               GUARD     e: 4  accepted
+         0.000412 ms  St_Idle               EXIT      e: 4
+         0.000583 ms  St_Press              ENTER     e: 4
+   */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "xrpSMTrace.h"
+
+//-------------------------------------------------------------------------------
+// Prototypes
+//-------------------------------------------------------------------------------
+
+UInt16 _DecSwap16( UInt16 value, BOOL bSwap );
+UInt32 _DecSwap32( UInt32 value, BOOL bSwap );
+uint64_t _DecSwap64( uint64_t value, BOOL bSwap );
+BOOL _DecRead( FILE *pFile, void *pData, size_t size );
+
+/*********************************************************************
+ *
+ * Byte swap a 16 bit snapshot field written on a host of the other
+ * byte order.
+ *
+ * Parameters:
+ *  value - the field as read
+ *  bSwap - TRUE if the snapshot has the other byte order
+ *
+ * Returns:
+ *  the field in host byte order
+ *
+ *********************************************************************/
+UInt16 _DecSwap16( UInt16 value, BOOL bSwap )
+{
+    return ( TRUE == bSwap ) ? ( UInt16 ) ( ( value >> 8 ) | ( value << 8 ) ) : value;
+}
+
+/*********************************************************************
+ *
+ * Byte swap a 32 bit snapshot field, see _DecSwap16.
+ *
+ * Parameters:
+ *  value - the field as read
+ *  bSwap - TRUE if the snapshot has the other byte order
+ *
+ * Returns:
+ *  the field in host byte order
+ *
+ *********************************************************************/
+UInt32 _DecSwap32( UInt32 value, BOOL bSwap )
+{
+    return ( TRUE == bSwap ) ? ( ( UInt32 ) _DecSwap16( ( UInt16 ) value, TRUE ) << 16 ) | _DecSwap16( ( UInt16 ) ( value >> 16 ), TRUE ) : value;
+}
+
+/*********************************************************************
+ *
+ * Byte swap a 64 bit snapshot field, see _DecSwap16.
+ *
+ * Parameters:
+ *  value - the field as read
+ *  bSwap - TRUE if the snapshot has the other byte order
+ *
+ * Returns:
+ *  the field in host byte order
+ *
+ *********************************************************************/
+uint64_t _DecSwap64( uint64_t value, BOOL bSwap )
+{
+    return ( TRUE == bSwap ) ? ( ( uint64_t ) _DecSwap32( ( UInt32 ) value, TRUE ) << 32 ) | _DecSwap32( ( UInt32 ) ( value >> 32 ), TRUE ) : value;
+}
+
+/*********************************************************************
+ *
+ * Read the next part of the snapshot.
+ *
+ * Parameters:
+ *  pFile - the snapshot file
+ *  pData - where to store it
+ *  size - number of bytes to read
+ *
+ * Returns:
+ *  TRUE, if all of it was read
+ *  FALSE, if the file ended or could not be read
+ *
+ *********************************************************************/
+BOOL _DecRead( FILE *pFile, void *pData, size_t size )
+{
+    return ( 1 == fread( pData, size, 1, pFile ) ) ? TRUE : FALSE;
+}
+
+int main( int argc, char *argv[] )
+{
+    static const char *actionNames[] = { "GUARD", "ENTER", "EXIT", "INTERNAL" };
+    tSmTraceHeader header;
+    tSmTraceOut out;
+    char **ppNames;
+    char *pNames;
+    char unknown[ 16 ];
+    const char *pName;
+    BOOL bSwap;
+    uint64_t startNs = 0, timeNs;
+    UInt32 idx, pos;
+    UInt16 stateIdx;
+    FILE *pFile;
+
+    if ( 2 != argc )
+    {
+        fprintf( stderr, "usage: xrpSMTraceDecode <snapshot>\n" );
+        return 2;
+    }
+
+    pFile = fopen( argv[ 1 ], "rb" );
+    if ( NULL == pFile )
+    {
+        fprintf( stderr, "xrpSMTraceDecode: can not read %s\n", argv[ 1 ] );
+        return 1;
+    }
+
+    if ( FALSE == _DecRead( pFile, &header, sizeof( header ) ) )
+    {
+        fprintf( stderr, "xrpSMTraceDecode: %s is too short\n", argv[ 1 ] );
+        return 1;
+    }
+
+    bSwap = ( SM_TRACE_MAGIC != header.mMagic ) ? TRUE : FALSE;
+    if ( SM_TRACE_MAGIC != _DecSwap32( header.mMagic, bSwap ) )
+    {
+        fprintf( stderr, "xrpSMTraceDecode: %s is not a trace snapshot\n", argv[ 1 ] );
+        return 1;
+    }
+
+    header.mVersion = _DecSwap16( header.mVersion, bSwap );
+    header.mStateCount = _DecSwap16( header.mStateCount, bSwap );
+    header.mRecordCount = _DecSwap32( header.mRecordCount, bSwap );
+    header.mNamesSize = _DecSwap32( header.mNamesSize, bSwap );
+    header.mLost = _DecSwap64( header.mLost, bSwap );
+
+    if ( SM_TRACE_VERSION != header.mVersion )
+    {
+        fprintf( stderr, "xrpSMTraceDecode: version %u is not supported\n", header.mVersion );
+        return 1;
+    }
+
+    // the names are NUL terminated one after the other
+    pNames = ( char * ) malloc( header.mNamesSize + 1 );
+    ppNames = ( char ** ) calloc( header.mStateCount + 1, sizeof( char * ) );
+    if ( ( NULL == pNames ) || ( NULL == ppNames ) || ( FALSE == _DecRead( pFile, pNames, header.mNamesSize ) ) )
+    {
+        fprintf( stderr, "xrpSMTraceDecode: bad state names\n" );
+        return 1;
+    }
+    pNames[ header.mNamesSize ] = 0;
+
+    for ( idx = 0, pos = 0 ; ( idx < header.mStateCount ) && ( pos < header.mNamesSize ) ; ++idx )
+    {
+        ppNames[ idx ] = &pNames[ pos ];
+        pos += strlen( ppNames[ idx ] ) + 1;
+    }
+
+    printf( "%u records, %llu older records lost, %u states\n", header.mRecordCount, ( unsigned long long ) header.mLost, header.mStateCount );
+
+    for ( idx = 0 ; idx < header.mRecordCount ; ++idx )
+    {
+        if ( FALSE == _DecRead( pFile, &out, sizeof( out ) ) )
+        {
+            fprintf( stderr, "xrpSMTraceDecode: snapshot ends after %u records\n", idx );
+            return 1;
+        }
+
+        timeNs = _DecSwap64( out.mTimeNs, bSwap );
+        stateIdx = _DecSwap16( out.mStateIdx, bSwap );
+        if ( 0 == idx )
+        {
+            startNs = timeNs;
+        }
+
+        if ( ( stateIdx < header.mStateCount ) && ( NULL != ppNames[ stateIdx ] ) && ( 0 != ppNames[ stateIdx ][ 0 ] ) )
+        {
+            pName = ppNames[ stateIdx ];
+        }
+        else
+        {   // no names compiled in, or a state of another machine
+            snprintf( unknown, sizeof( unknown ), ( SM_TRACE_NO_STATE == stateIdx ) ? "?" : "#%u", stateIdx );
+            pName = unknown;
+        }
+
+        printf( "%14.6f ms  %-20s  %-8s  e: %u", ( double ) ( timeNs - startNs ) / 1000000.0, pName,
+                ( out.mAction < ARRAY_COUNT( actionNames ) ) ? actionNames[ out.mAction ] : "?", _DecSwap16( out.mEvtID, bSwap ) );
+        if ( ACT_GUARD == out.mAction )
+        {
+            printf( "  %s", ( 0 != out.mResult ) ? "accepted" : "rejected" );
+        }
+        printf( "\n" );
+    }
+
+    fclose( pFile );
+
+    // the process ends here, the names are not freed
+    return 0;
+}